@@ -0,0 +1,343 @@
+// Benchmarks of netcdfpp hot paths, next to the equivalent NetCDF-C calls where there is one.
+//
+// Usage: bench_netcdfpp [options]
+//   -o FILE     write results as JSON to FILE instead of stdout
+//   -f TEXT     only run benchmarks whose name contains TEXT
+//   -t SECONDS  minimum measuring time per benchmark (default 0.2)
+//
+// Benchmarks named `.../netcdf-c` call NetCDF-C directly and are the baseline
+// for the wrapper overhead of the benchmark with the same name without that
+// suffix. The JSON output follows the layout of Google Benchmark, so tools for
+// comparing and tracking its results can be used in CI.
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "netcdfpp.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string name;
+    std::size_t iterations;
+    double real_time;  // in ns per iteration
+    double bytes_per_second;
+};
+
+// keeps the compiler from dropping values that are read but not used
+volatile double sink;
+
+// quoted JSON string, e.g. for executable paths with backslashes on Windows
+std::string json_string(const std::string& s) {
+    std::string res = "\"";
+    for (const auto c : s) {
+        if (c == '"' || c == '\\') {
+            res += '\\';
+            res += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            const char* hex = "0123456789abcdef";
+            res += "\\u00";
+            res += hex[(c >> 4) & 0xf];
+            res += hex[c & 0xf];
+        } else {
+            res += c;
+        }
+    }
+    return res + '"';
+}
+
+class Runner {
+  private:
+    std::string filter;
+    double min_time;
+    std::vector<Result> results;
+
+  public:
+    Runner(std::string filter_p, double min_time_p) : filter(std::move(filter_p)), min_time(min_time_p) {}
+
+    // runs `f` in doubling batches until one batch takes at least the minimum time, `bytes` are moved per call
+    template<typename Function>
+    void run(const std::string& name, std::size_t bytes, Function&& f) {
+        if (name.find(filter) == std::string::npos) {
+            return;
+        }
+        f();  // warm up caches
+        std::size_t iterations = 1;
+        double elapsed;
+        while (true) {
+            const auto begin = Clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) {
+                f();
+            }
+            elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+            if (elapsed >= min_time || iterations >= (std::size_t(1) << 30)) {
+                break;
+            }
+            iterations *= elapsed > 0 ? std::min<std::size_t>(std::max<std::size_t>(static_cast<std::size_t>(min_time / elapsed * 1.2), 2), 16) : 16;
+        }
+        results.push_back(Result{name, iterations, elapsed * 1e9 / iterations, bytes * iterations / elapsed});
+        std::cerr << name << ": " << results.back().real_time << " ns" << std::endl;
+    }
+
+    void write_json(std::ostream& out, const std::string& executable) const {
+        char date[64];
+        const auto now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+        out << "{\n"
+            << "  \"context\": {\n"
+            << "    \"date\": \"" << date << "\",\n"
+            << "    \"executable\": " << json_string(executable) << ",\n"
+            << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+            << "    \"netcdf_version\": \"" << nc_inq_libvers() << "\",\n"
+            << "    \"min_time\": " << min_time << "\n"
+            << "  },\n"
+            << "  \"benchmarks\": [";
+        for (std::size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": " << json_string(r.name) << ", \"run_name\": " << json_string(r.name)
+                << ", \"run_type\": \"iteration\", \"iterations\": " << r.iterations << ", \"real_time\": " << r.real_time << ", \"cpu_time\": " << r.real_time
+                << ", \"time_unit\": \"ns\", \"bytes_per_second\": " << r.bytes_per_second << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+};
+
+const std::size_t sizes[] = {1 << 10, 1 << 16, 1 << 20};
+const char* const layouts[] = {"contiguous", "chunked", "deflate"};
+
+std::string name(const char* layout, std::size_t n) { return std::string(layout) + "_" + std::to_string(n); }
+
+void bench_values(Runner& runner) {
+    {
+        netCDF::File file("bench.nc", 'w');
+        for (const auto n : sizes) {
+            file.add_dimension("x_" + std::to_string(n), n);
+            for (const auto layout : layouts) {
+                auto v = file.add_variable<float>(name(layout, n), std::vector<std::string>{"x_" + std::to_string(n)});
+                if (layout != layouts[0]) {
+                    v.set_chunking({std::min<std::size_t>(n, 4096)});
+                }
+                if (layout == layouts[2]) {
+                    v.set_compression(true, 1);
+                }
+            }
+        }
+    }
+
+    netCDF::File file("bench.nc", 'a');
+    for (const auto n : sizes) {
+        std::vector<float> values(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            values[i] = static_cast<float>(i % 1000) * 0.5f;
+        }
+        const std::size_t start = 0;
+        const auto bytes = n * sizeof(float);
+        for (const auto layout : layouts) {
+            auto v = file.variable(name(layout, n)).require();
+            const auto prefix = "/" + std::string(layout) + "/" + std::to_string(n);
+            runner.run("write" + prefix + "/netcdf-c", bytes, [&]() { nc_put_vara_float(file.id(), v.id(), &start, &n, values.data()); });
+            runner.run("write" + prefix, bytes, [&]() { v.write(values.data(), &start, &n); });
+            runner.run("read" + prefix + "/netcdf-c", bytes, [&]() {
+                nc_get_vara_float(file.id(), v.id(), &start, &n, values.data());
+                sink = values[n / 2];
+            });
+            runner.run("read" + prefix, bytes, [&]() {
+                v.read(values.data(), &start, &n);
+                sink = values[n / 2];
+            });
+            runner.run("get" + prefix, bytes, [&]() { sink = v.get<float>()[n / 2]; });
+            runner.run("get_as_double" + prefix, bytes, [&]() { sink = v.get<double>()[n / 2]; });
+        }
+
+        // scattered points in a chunked variable
+        const auto v = file.variable(name(layouts[1], n)).require();
+        std::vector<std::size_t> indices(std::min<std::size_t>(n, 1000));
+        std::mt19937 random(42);
+        for (auto& i : indices) {
+            i = random() % n;
+        }
+        std::vector<float> points(indices.size());
+        const auto point_bytes = indices.size() * sizeof(float);
+        const auto prefix = "/" + std::to_string(n);
+        runner.run("points" + prefix + "/netcdf-c", point_bytes, [&]() {
+            for (std::size_t i = 0; i < indices.size(); ++i) {
+                nc_get_var1_float(file.id(), v.id(), &indices[i], &points[i]);
+            }
+            sink = points[0];
+        });
+        runner.run("points" + prefix, point_bytes, [&]() {
+            v.read_points(points.data(), indices.data(), indices.size());
+            sink = points[0];
+        });
+    }
+}
+
+// creating and completely writing a classic file, whose variables NetCDF-C first fills with fill values unless in NC_NOFILL mode
+void bench_fill(Runner& runner) {
+    const std::size_t n = 1 << 20;
+    const std::vector<float> values(n, 1.5f);
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_64BIT_OFFSET;
+    for (const auto mode : {NC_FILL, NC_NOFILL}) {
+        runner.run(std::string(mode == NC_FILL ? "create/fill/" : "create/nofill/") + std::to_string(n), n * sizeof(float), [&]() {
+            netCDF::File file("bench_fill.nc", 'w', options);
+            file.set_fill_mode(mode);
+            file.add_dimension("x", n);
+            file.add_variable<float>("v", std::vector<std::string>{"x"}).write(values.data());
+        });
+    }
+}
+
+void bench_strings_and_vlens(Runner& runner) {
+    const std::size_t n = 1 << 14;
+    netCDF::File file("bench_strings.nc", 'w');
+    file.add_dimension("x", n);
+    auto strings = file.add_variable<std::string>("strings", std::vector<std::string>{"x"});
+    std::vector<std::string> string_values(n);
+    std::size_t string_bytes = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        string_values[i] = "value " + std::to_string(i * 7919);
+        string_bytes += string_values[i].size();
+    }
+    strings.set<std::string>(string_values);
+    auto type = file.add_type_vlen<int>("samples");
+    auto vlens = file.add_variable("vlens", type, std::vector<std::string>{"x"});
+    netCDF::VLenArray<int> vlen_values;
+    for (std::size_t i = 0; i < n; ++i) {
+        vlen_values.push_back(std::vector<int>(i % 16, static_cast<int>(i)));
+    }
+    vlens.set_vlen(vlen_values);
+    const auto vlen_bytes = vlen_values.values().size() * sizeof(int);
+
+    runner.run("get_strings/" + std::to_string(n) + "/netcdf-c", string_bytes, [&]() {
+        std::vector<char*> buf(n);
+        nc_get_var_string(file.id(), strings.id(), buf.data());
+        sink = buf[n / 2][0];
+        nc_free_string(n, buf.data());
+    });
+    runner.run("get_strings/" + std::to_string(n), string_bytes, [&]() { sink = strings.get<std::string>()[n / 2][0]; });
+    runner.run("get_vlen/" + std::to_string(n) + "/netcdf-c", vlen_bytes, [&]() {
+        std::vector<nc_vlen_t> buf(n);
+        nc_get_var(file.id(), vlens.id(), buf.data());
+        sink = static_cast<double>(buf[n / 2].len);
+        nc_free_vlens(n, buf.data());
+    });
+    runner.run("get_vlen/" + std::to_string(n), vlen_bytes, [&]() { sink = static_cast<double>(vlens.get_vlen<int>().size()); });
+}
+
+void bench_metadata(Runner& runner) {
+    const std::size_t n = 1000;
+    {
+        netCDF::File file("bench_metadata.nc", 'w');
+        file.add_dimension("x", 16);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto v = file.add_variable<float>("variable_" + std::to_string(i), std::vector<std::string>{"x"});
+            v.add_attribute("units").set<std::string>("m s-1");
+            v.add_attribute("long_name").set<std::string>("variable number " + std::to_string(i));
+            v.add_attribute("scale_factor").set<double>(0.5);
+            v.add_attribute("add_offset").set<double>(1.0);
+            v.add_attribute("valid_range").set<float>({0.0f, 100.0f});
+        }
+    }
+
+    netCDF::File file("bench_metadata.nc", 'r');
+    std::vector<std::string> names(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        names[(i * 7) % n] = "variable_" + std::to_string(i);
+    }
+    std::size_t next = 0;
+    runner.run("lookup/variable/netcdf-c", 0, [&]() {
+        int id;
+        nc_inq_varid(file.id(), names[next++ % n].c_str(), &id);
+        sink = id;
+    });
+    runner.run("lookup/variable", 0, [&]() { sink = file.variable(names[next++ % n]).require().id(); });
+    runner.run("enumerate/variables/netcdf-c", 0, [&]() {
+        int count;
+        nc_inq_varids(file.id(), &count, nullptr);
+        std::vector<int> ids(count);
+        nc_inq_varids(file.id(), nullptr, ids.data());
+        char name[NC_MAX_NAME + 1];
+        for (const auto id : ids) {
+            nc_inq_varname(file.id(), id, name);
+        }
+        sink = name[0];
+    });
+    runner.run("enumerate/variables", 0, [&]() { sink = static_cast<double>(file.variables().size()); });
+    runner.run("traverse/attributes", 0, [&]() {
+        std::size_t total = 0;
+        for (const auto& v : file.variables()) {
+            for (const auto& a : v.attributes()) {
+                total += a.size();
+            }
+        }
+        sink = static_cast<double>(total);
+    });
+    runner.run("copy_from/metadata", 0, [&]() {
+        netCDF::File out("bench_copy.nc", 'w');
+        out.copy_from(file);
+    });
+
+    netCDF::File values("bench.nc", 'r');
+    std::size_t bytes = 0;
+    for (const auto& v : values.variables()) {
+        bytes += v.size() * sizeof(float);  // all variables of bench_values()
+    }
+    runner.run("copy_from/values", bytes, [&]() {
+        netCDF::File out("bench_copy.nc", 'w');
+        out.copy_from(values, true);
+    });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string output;
+    std::string filter;
+    double min_time = 0.2;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string arg = argv[i];
+        if (arg == "-o") {
+            output = argv[i + 1];
+        } else if (arg == "-f") {
+            filter = argv[i + 1];
+        } else if (arg == "-t") {
+            min_time = std::atof(argv[i + 1]);
+        } else {
+            std::cerr << "Usage: bench_netcdfpp [-o FILE] [-f TEXT] [-t SECONDS]\n";
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        std::cerr << "Usage: bench_netcdfpp [-o FILE] [-f TEXT] [-t SECONDS]\n";
+        return 1;
+    }
+
+    try {
+        Runner runner(filter, min_time);
+        bench_values(runner);
+        bench_fill(runner);
+        bench_strings_and_vlens(runner);
+        bench_metadata(runner);
+        if (output.empty()) {
+            runner.write_json(std::cout, argv[0]);
+        } else {
+            std::ofstream out(output);
+            runner.write_json(out, argv[0]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -33,17 +33,70 @@
 #define NETCDFPP_H
 
 #include <netcdf.h>
+#include <netcdf_meta.h>
+
+#if NC_VERSION_MAJOR > 4 || (NC_VERSION_MAJOR == 4 && NC_VERSION_MINOR >= 9)
+// generic filters, zstd, bzip2, and quantization need NetCDF-C 4.9
+#include <netcdf_filter.h>
+#define NETCDFPP_HAS_FILTERS 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+// reading with several processes, see ProcessReader
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define NETCDFPP_HAS_PROCESSES 1
+#endif
+
+#ifdef NETCDFPP_WITH_HDF5
+// direct chunk access, see DirectChunkIO
+#include <hdf5.h>
+#include <zlib.h>
+#ifdef NETCDFPP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifdef NETCDFPP_WITH_INSTRUMENTATION
+// counting and timing of NetCDF-C calls, see InstrumentationSink
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#endif
+
+#ifdef NETCDFPP_WITH_MPI
+// parallel I/O needs a NetCDF-C build with parallel HDF5 or PnetCDF, see File::open_parallel()
+#include <mpi.h>
+#include <netcdf_par.h>
+#endif
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <list>
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -91,6 +144,29 @@ NETCDFPP_IMPL_TYPE(std::uint32_t, NC_UINT)
 NETCDFPP_IMPL_TYPE(std::uint64_t, NC_UINT64)
 NETCDFPP_IMPL_TYPE(std::uint8_t, NC_UBYTE)
 
+template<typename T>
+/// Compile-time description of the compound fields of a C++ struct.
+///
+/// Specialize it with NETCDFPP_COMPOUND_BEGIN, NETCDFPP_COMPOUND_FIELD, and
+/// NETCDFPP_COMPOUND_END at global scope.
+struct CompoundBinding {
+    static constexpr bool is_bound = false;
+};
+
+/// Starts the compound field table for a C++ struct.
+#define NETCDFPP_COMPOUND_BEGIN(type_p)                         \
+    namespace netCDF {                                          \
+    template<>                                                  \
+    struct CompoundBinding<type_p> {                            \
+        using type = type_p;                                    \
+        static constexpr bool is_bound = true;                  \
+        static std::vector<UserType::CompoundField> fields() { \
+            return {
+/// Adds a scalar or array member to the compound field table.
+#define NETCDFPP_COMPOUND_FIELD(field) detail::compound_field<decltype(type::field)>(#field, offsetof(type, field)),
+/// Ends the compound field table.
+#define NETCDFPP_COMPOUND_END() }; } }; }
+
 template<typename T, typename Function>
 /// Calls a callable with a default value of the C++ type matching a NetCDF atomic type.
 ///
@@ -150,6 +226,10 @@ inline T for_type(nc_type t, Function&& f) {
     }
 }
 
+namespace detail {
+struct Path;
+}  // namespace detail
+
 /// Exception thrown when a NetCDF-C call fails.
 ///
 /// The message includes the NetCDF error text and the path of the affected
@@ -157,19 +237,121 @@ inline T for_type(nc_type t, Function&& f) {
 class Exception final : public std::runtime_error {
   private:
     int ret;
+    const char* prefix = nullptr;  // static message text before the path, or null for the error message of `ret`
+    std::shared_ptr<const detail::Path> object;
+    mutable std::string message;  // formatted on the first call of what() if there is an object
 
   public:
     /// Creates an exception with the NetCDF return code and a complete message.
     explicit Exception(int r, std::string s) : std::runtime_error(std::move(s)), ret(r) {}
 
+    /// Creates an exception with the NetCDF return code whose message is only formatted when what() is first called.
+    ///
+    /// The message is `prefix`, which has to be a string literal, or the
+    /// NetCDF-C error message for `r` if null, followed by the full path of
+    /// `object_p`. This keeps throwing cheap where exceptions are caught
+    /// without looking at the message. Call what() once before sharing the
+    /// exception between threads.
+    Exception(int r, std::shared_ptr<const detail::Path> object_p, const char* prefix_p = nullptr)
+        : std::runtime_error(std::string()), ret(r), prefix(prefix_p), object(std::move(object_p)) {}
+
     /// Returns the NetCDF-C return code that caused the exception.
     int return_code() const { return ret; }
+
+    /// Returns the message, formatting it first if needed.
+    const char* what() const noexcept override;
+};
+
+/// Start and count of one hyperslab, e.g. for batched reads.
+struct Hyperslab {
+    /// Start index in each dimension.
+    std::vector<std::size_t> start;
+    /// Number of elements in each dimension.
+    std::vector<std::size_t> count;
+};
+
+/// Options for creating and opening files, see File::open().
+struct FileOptions {
+    /// Format of created files: NC_FORMAT_NETCDF4, NC_FORMAT_NETCDF4_CLASSIC,
+    /// NC_FORMAT_CLASSIC, NC_FORMAT_64BIT_OFFSET, or NC_FORMAT_CDF5.
+    int format = NC_FORMAT_NETCDF4;
+    /// Overwrite existing files when creating (NC_CLOBBER) instead of failing (NC_NOCLOBBER).
+    bool clobber = true;
+    /// Open or create with NC_SHARE, e.g. for readers of a classic file while it is written.
+    bool share = false;
+    /// Further mode flags passed to NetCDF-C, e.g. NC_DISKLESS.
+    int flags = 0;
+    /// Initial size of created classic files in bytes (`nc__create`).
+    std::size_t initial_size = 0;
+    /// I/O buffer size hint for classic files in bytes, 0 for the NetCDF-C default (`nc__create`, `nc__open`).
+    std::size_t buffer_size = 0;
+    /// Free space after the header of classic files in bytes, so that later
+    /// attributes and variables do not move all data (`nc__enddef`).
+    std::size_t header_free = 0;
+    /// Alignment of the fixed-size variables section of classic files in bytes (`nc__enddef`).
+    std::size_t variable_align = 1;
+    /// Free space after the fixed-size variables section of classic files in bytes (`nc__enddef`).
+    std::size_t variable_free = 0;
+    /// Alignment of the record variables section of classic files in bytes (`nc__enddef`).
+    std::size_t record_align = 1;
+    /// Number of implicit switches back to define mode in classic files after
+    /// which schema changes throw, see File::define().
+    std::size_t max_redefinitions = static_cast<std::size_t>(-1);
+};
+
+/// Id and parameters of one HDF5 filter, e.g. for Variable::add_filter().
+struct Filter {
+    /// HDF5 filter id, e.g. H5Z_FILTER_ZSTD.
+    unsigned int id;
+    /// Filter parameters as stored in the file.
+    std::vector<unsigned int> params;
+};
+
+/// Storage settings for a copied variable, see Group::add_variable(const Variable&, const VariableLayout&, bool).
+struct VariableLayout {
+    /// Chunk sizes, or empty to keep the chunking of the source variable.
+    std::vector<std::size_t> chunks;
+    /// Use contiguous storage instead of chunks.
+    bool contiguous = false;
+    /// Filter chain replacing the one of the source variable if `replace_filters` is set.
+    std::vector<Filter> filters;
+    /// Use `filters` instead of the filter chain of the source variable.
+    bool replace_filters = false;
+    /// NC_ENDIAN_NATIVE, NC_ENDIAN_LITTLE, or NC_ENDIAN_BIG, or -1 to leave the endianness at the default.
+    int endianness = -1;
+};
+
+/// Records added to an unlimited dimension, see Dimension::refresh() and File::poll().
+struct RecordRange {
+    /// Index of the first new record.
+    std::size_t begin;
+    /// Index after the last new record, i.e. the new dimension length.
+    std::size_t end;
+
+    /// Returns the number of new records.
+    std::size_t count() const { return end - begin; }
+    /// Returns true when there are no new records.
+    bool empty() const { return end == begin; }
 };
 
+class AggregatedVariable;
+class Aggregation;
+class AnyArray;
 class Attribute;
+class ChunkAdvisor;
+class CompoundColumns;
+template<typename T>
+class CompoundPlan;
+class DefineScope;
 class Dimension;
+class DirectChunkIO;
 class File;
 class Group;
+template<typename T>
+class LazyVariable;
+class ProcessReader;
+class RaggedArray;
+class Rechunker;
 class UserType;
 class Variable;
 
@@ -181,6 +363,16 @@ namespace detail {
 
 constexpr bool is_user_type(nc_type type) { return type >= NC_FIRSTUSERTYPEID; }
 
+// NetCDF type id of a C++ type, NC_NAT if it has none
+template<typename T, bool = Type<T>::is_atomic>
+struct TypeId {
+    static constexpr nc_type id = NC_NAT;
+};
+template<typename T>
+struct TypeId<T, true> {
+    static constexpr nc_type id = Type<T>::id;
+};
+
 template<typename T>
 inline T* data_or_null(std::vector<T>& v) {
     return v.empty() ? nullptr : &v[0];
@@ -215,174 +407,1094 @@ inline std::vector<const char*> process_string_vector(const std::vector<std::str
     return buf;
 }
 
+inline std::size_t product(const std::vector<std::size_t>& v) {
+    std::size_t res = 1;
+    for (const auto i : v) {
+        res *= i;
+    }
+    return res;
+}
+
+// value range of `From` that converts to `To` without NC_ERANGE, and how out-of-range values are clamped in between
+template<typename From, typename To, bool = std::is_floating_point<From>::value, bool = std::is_floating_point<To>::value>
+struct Conversion;
+
+template<typename From, typename To>
+struct Conversion<From, To, false, false> {
+    static From lowest() {
+        return static_cast<std::intmax_t>(std::numeric_limits<To>::min()) > static_cast<std::intmax_t>(std::numeric_limits<From>::min())
+                   ? static_cast<From>(std::numeric_limits<To>::min())
+                   : std::numeric_limits<From>::min();
+    }
+    static From highest() {
+        return static_cast<std::uintmax_t>(std::numeric_limits<To>::max()) < static_cast<std::uintmax_t>(std::numeric_limits<From>::max())
+                   ? static_cast<From>(std::numeric_limits<To>::max())
+                   : std::numeric_limits<From>::max();
+    }
+    static bool in_range(From x, From lo, From hi) { return x >= lo && x <= hi; }
+    static To convert(From x, From lo, From hi) { return static_cast<To>(x < lo ? lo : (x > hi ? hi : x)); }
+};
+
+template<typename From, typename To>
+struct Conversion<From, To, true, false> {
+    // NaN is out of range, -2^digits and everything below 2^digits truncate to representable values
+    static From lowest() { return std::numeric_limits<To>::is_signed ? -std::ldexp(From(1), std::numeric_limits<To>::digits) : From(0); }
+    static From highest() { return std::nextafter(std::ldexp(From(1), std::numeric_limits<To>::digits), From(0)); }
+    static bool in_range(From x, From lo, From hi) { return x >= lo && x <= hi; }
+    static To convert(From x, From lo, From hi) { return static_cast<To>(x >= lo ? (x <= hi ? x : hi) : lo); }
+};
+
+template<typename From, typename To>
+struct Conversion<From, To, false, true> {
+    static From lowest() { return std::numeric_limits<From>::lowest(); }
+    static From highest() { return std::numeric_limits<From>::max(); }
+    static bool in_range(From, From, From) { return true; }
+    static To convert(From x, From, From) { return static_cast<To>(x); }
+};
+
+template<typename From, typename To>
+struct Conversion<From, To, true, true> {
+    // like NetCDF-C, infinities are out of range of a narrower type while NaN is not
+    static From lowest() { return sizeof(To) < sizeof(From) ? static_cast<From>(std::numeric_limits<To>::lowest()) : std::numeric_limits<From>::lowest(); }
+    static From highest() { return sizeof(To) < sizeof(From) ? static_cast<From>(std::numeric_limits<To>::max()) : std::numeric_limits<From>::max(); }
+    static bool in_range(From x, From lo, From hi) { return sizeof(To) >= sizeof(From) || !(x < lo || x > hi); }
+    static To convert(From x, From lo, From hi) {
+        return x < lo ? -std::numeric_limits<To>::infinity() : (x > hi ? std::numeric_limits<To>::infinity() : static_cast<To>(x));
+    }
+};
+
+// converts `n` values in one branch-free loop the compiler can vectorize,
+// clamps values out of the range of `To` and returns false if there were any
+template<typename From, typename To>
+inline bool convert(const From* src, To* dst, std::size_t n) {
+    using C = Conversion<From, To>;
+    const From lo = C::lowest();
+    const From hi = C::highest();
+    unsigned int out_of_range = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        out_of_range |= !C::in_range(src[i], lo, hi);
+        dst[i] = C::convert(src[i], lo, hi);
+    }
+    return out_of_range == 0;
+}
+
+// typed NetCDF-C calls for generic code, e.g. to leave out-of-range values to NetCDF-C, which handles them depending on the file format
+#define NETCDFPP_IMPL_VARA(type, name)                                                                            \
+    inline int get_vara(int ncid, int varid, const std::size_t* start, const std::size_t* count, type* v) {       \
+        return nc_get_vara##name(ncid, varid, start, count, v);                                                   \
+    }                                                                                                             \
+    inline int put_vara(int ncid, int varid, const std::size_t* start, const std::size_t* count, const type* v) { \
+        return nc_put_vara##name(ncid, varid, start, count, v);                                                   \
+    }
+NETCDFPP_IMPL_VARA(char, _text)
+NETCDFPP_IMPL_VARA(double, _double)
+NETCDFPP_IMPL_VARA(float, _float)
+NETCDFPP_IMPL_VARA(int, _int)
+NETCDFPP_IMPL_VARA(long long, _longlong)
+NETCDFPP_IMPL_VARA(long, _long)
+NETCDFPP_IMPL_VARA(short, _short)
+NETCDFPP_IMPL_VARA(signed char, _schar)
+NETCDFPP_IMPL_VARA(unsigned char, _uchar)
+NETCDFPP_IMPL_VARA(unsigned int, _uint)
+NETCDFPP_IMPL_VARA(unsigned long long, _ulonglong)
+NETCDFPP_IMPL_VARA(unsigned short, _ushort)
+#undef NETCDFPP_IMPL_VARA
+
+// copies the box `count` at `src_offset` of the row-major array `src` with
+// shape `src_shape` to `dst_offset` of the row-major array `dst` with shape
+// `dst_shape`, one contiguous row at a time
+inline void copy_box(const char* src,
+                     const std::size_t* src_shape,
+                     const std::size_t* src_offset,
+                     char* dst,
+                     const std::size_t* dst_shape,
+                     const std::size_t* dst_offset,
+                     const std::size_t* count,
+                     std::size_t ndims,
+                     std::size_t bytes) {
+    if (ndims == 0) {
+        std::memcpy(dst, src, bytes);
+        return;
+    }
+    std::vector<std::size_t> src_stride(ndims);
+    std::vector<std::size_t> dst_stride(ndims);
+    src_stride[ndims - 1] = bytes;
+    dst_stride[ndims - 1] = bytes;
+    for (std::size_t i = ndims - 1; i > 0; --i) {
+        src_stride[i - 1] = src_stride[i] * src_shape[i];
+        dst_stride[i - 1] = dst_stride[i] * dst_shape[i];
+    }
+    std::size_t src_pos = 0;
+    std::size_t dst_pos = 0;
+    for (std::size_t i = 0; i < ndims; ++i) {
+        if (count[i] == 0) {
+            return;
+        }
+        src_pos += src_offset[i] * src_stride[i];
+        dst_pos += dst_offset[i] * dst_stride[i];
+    }
+    const auto row_bytes = count[ndims - 1] * bytes;
+    std::vector<std::size_t> index(ndims, 0);
+    while (true) {
+        std::memcpy(dst + dst_pos, src + src_pos, row_bytes);
+        std::size_t d = ndims - 1;
+        while (d > 0) {
+            --d;
+            ++index[d];
+            src_pos += src_stride[d];
+            dst_pos += dst_stride[d];
+            if (index[d] < count[d]) {
+                break;
+            }
+            src_pos -= index[d] * src_stride[d];
+            dst_pos -= index[d] * dst_stride[d];
+            index[d] = 0;
+            if (d == 0) {
+                return;
+            }
+        }
+        if (ndims == 1) {
+            return;
+        }
+    }
+}
+
+struct BatchCluster {
+    std::vector<std::size_t> start;
+    std::vector<std::size_t> end;
+    std::vector<std::size_t> members;
+
+    std::vector<std::size_t> count() const {
+        std::vector<std::size_t> res(start.size());
+        std::transform(std::begin(end), std::end(end), std::begin(start), std::begin(res), std::minus<std::size_t>());
+        return res;
+    }
+};
+
+inline std::size_t box_volume(const std::vector<std::size_t>& start, const std::vector<std::size_t>& end) {
+    std::size_t res = 1;
+    for (std::size_t i = 0; i < start.size(); ++i) {
+        res *= end[i] - start[i];
+    }
+    return res;
+}
+
+inline std::size_t chunk_span(const std::vector<std::size_t>& start, const std::vector<std::size_t>& end, const std::vector<std::size_t>& chunks) {
+    std::size_t res = 1;
+    for (std::size_t i = 0; i < start.size(); ++i) {
+        res *= (end[i] - 1) / chunks[i] - start[i] / chunks[i] + 1;
+    }
+    return res;
+}
+
+// merging is worthwhile if reading the bounding box reads no more values
+// than both boxes separately (overlapping or adjacent boxes) or, for chunked
+// storage, touches no more chunks than both boxes separately
+inline bool worth_merging(const BatchCluster& a, const BatchCluster& b, const std::vector<std::size_t>& chunks) {
+    std::vector<std::size_t> start(a.start.size());
+    std::vector<std::size_t> end(a.start.size());
+    for (std::size_t i = 0; i < start.size(); ++i) {
+        start[i] = std::min(a.start[i], b.start[i]);
+        end[i] = std::max(a.end[i], b.end[i]);
+    }
+    if (box_volume(start, end) <= box_volume(a.start, a.end) + box_volume(b.start, b.end)) {
+        return true;
+    }
+    return !chunks.empty() && chunk_span(start, end, chunks) <= chunk_span(a.start, a.end, chunks) + chunk_span(b.start, b.end, chunks);
+}
+
+// merges hyperslabs into clusters of at most `max_values` values (larger hyperslabs stay alone): sorted by the chunk (or, for
+// contiguous storage, the position) of their start, each one is merged into the cluster before it if worth_merging() says so
+inline std::vector<BatchCluster> coalesce(const std::vector<Hyperslab>& slabs, const std::vector<std::size_t>& chunks, std::size_t max_values) {
+    std::vector<BatchCluster> clusters;
+    for (std::size_t i = 0; i < slabs.size(); ++i) {
+        BatchCluster c{slabs[i].start, slabs[i].start, {i}};
+        std::transform(std::begin(c.start), std::end(c.start), std::begin(slabs[i].count), std::begin(c.end), std::plus<std::size_t>());
+        if (box_volume(c.start, c.end) > 0) {
+            clusters.emplace_back(std::move(c));
+        }
+    }
+    std::sort(std::begin(clusters), std::end(clusters), [&chunks](const BatchCluster& a, const BatchCluster& b) {
+        for (std::size_t d = 0; d < chunks.size(); ++d) {
+            if (a.start[d] / chunks[d] != b.start[d] / chunks[d]) {
+                return a.start[d] / chunks[d] < b.start[d] / chunks[d];
+            }
+        }
+        return a.start < b.start;
+    });
+    std::vector<BatchCluster> res;
+    std::vector<std::size_t> start;
+    std::vector<std::size_t> end;
+    for (auto& c : clusters) {
+        if (!res.empty()) {
+            auto& last = res.back();
+            start = last.start;
+            end = last.end;
+            for (std::size_t d = 0; d < start.size(); ++d) {
+                start[d] = std::min(start[d], c.start[d]);
+                end[d] = std::max(end[d], c.end[d]);
+            }
+            if (box_volume(start, end) <= max_values && worth_merging(last, c, chunks)) {
+                last.start = start;
+                last.end = end;
+                last.members.insert(std::end(last.members), std::begin(c.members), std::end(c.members));
+                continue;
+            }
+        }
+        res.emplace_back(std::move(c));
+    }
+    return res;
+}
+
+// first of `blocks` blocks in part `part` of `parts` near-equal parts, earlier parts get the remainder
+inline std::size_t part_begin(std::size_t blocks, std::size_t part, std::size_t parts) { return blocks / parts * part + std::min(part, blocks % parts); }
+
+inline Hyperslab partition(std::vector<std::size_t> count, std::size_t unit, std::size_t part, std::size_t parts) {
+    Hyperslab res{std::vector<std::size_t>(count.size(), 0), std::move(count)};
+    const auto len = res.count[0];
+    const auto blocks = (len + unit - 1) / unit;
+    const auto begin = std::min(part_begin(blocks, part, parts) * unit, len);
+    const auto end = std::min(part_begin(blocks, part + 1, parts) * unit, len);
+    res.start[0] = begin;
+    res.count[0] = end - begin;
+    return res;
+}
+
+struct FilePath;
+
 struct Path {
     std::string name;
     int id;
     bool is_group;
-    std::shared_ptr<Path> parent;
+    Path* parent;  // kept alive by the handles of this path, see make_path()
+
+    FilePath& root();
 
+    // e.g. `file.nc:group/var`, sized once instead of inserting each parent at the front
     std::string get_full_path() const {
-        std::string res = name;
-        const std::shared_ptr<Path>* current = &parent;
-        while (*current) {
-            res.insert(0, (*current)->name + ((*current)->parent ? "/" : ":"));
-            current = &(*current)->parent;
+        std::size_t len = name.size();
+        for (const Path* p = parent; p; p = p->parent) {
+            len += p->name.size() + 1;
+        }
+        std::string res(len, ':');
+        auto pos = len - name.size();
+        std::copy(std::begin(name), std::end(name), std::begin(res) + static_cast<std::ptrdiff_t>(pos));
+        for (const Path* p = parent; p; p = p->parent) {
+            res[pos - 1] = p->parent ? '/' : ':';
+            pos -= p->name.size() + 1;
+            std::copy(std::begin(p->name), std::end(p->name), std::begin(res) + static_cast<std::ptrdiff_t>(pos));
         }
         return res;
     }
-};
-
-template<typename T>
-struct ClassName {};
 
-template<>
-struct ClassName<Attribute> {
-    static constexpr const char* name = "Attribute";
+    // copies the full path into `n` > 3 chars without allocating, replacing the beginning of longer paths by "..."
+    void copy_full_path(char* out, std::size_t n) const {
+        std::size_t len = name.size();
+        for (const Path* p = parent; p; p = p->parent) {
+            len += p->name.size() + 1;
+        }
+        const std::size_t first = len < n ? 0 : 3;
+        auto pos = std::min(len, n - 1);
+        out[pos] = '\0';
+        for (const Path* p = this; p && pos > first; p = p->parent) {
+            for (auto it = p->name.rbegin(); it != p->name.rend() && pos > first; ++it) {
+                out[--pos] = *it;
+            }
+            if (p->parent && pos > first) {
+                out[--pos] = p->parent->parent ? '/' : ':';
+            }
+        }
+        std::copy_n("...", first, out);
+    }
 };
 
-template<>
-struct ClassName<Dimension> {
-    static constexpr const char* name = "Dimension";
+// state of an open file, kept in its root path
+struct FileState {
+    bool classic_model;  // define and data mode have to be switched explicitly
+    bool define_mode;
+    std::size_t header_free;
+    std::size_t variable_align;
+    std::size_t variable_free;
+    std::size_t record_align;
+    std::size_t redefinitions;  // implicit switches back to define mode
+    std::size_t max_redefinitions;
+    unsigned int scopes;  // active DefineScope objects
 };
 
-template<>
-struct ClassName<File> {
-    static constexpr const char* name = "File";
+// objects with separate id spaces
+enum class PathKind { attribute, dimension, group, type, variable };
+
+struct PathKey {
+    const Path* parent;
+    PathKind kind;
+    int id;
+
+    bool operator==(const PathKey& other) const { return parent == other.parent && kind == other.kind && id == other.id; }
 };
 
-template<>
-struct ClassName<Group> {
-    static constexpr const char* name = "Group";
+struct PathKeyHash {
+    std::size_t operator()(const PathKey& k) const {
+        return std::hash<const Path*>()(k.parent) ^ (std::hash<int>()(k.id) * 31 + static_cast<std::size_t>(k.kind));
+    }
 };
 
-template<>
-struct ClassName<UserType> {
-    static constexpr const char* name = "UserType";
+struct FilePath : Path {
+    FileState state;
+    std::map<int, std::size_t> polled_lengths;  // unlimited dimension lengths by id at the last File::poll()
+    std::deque<Path> paths;                     // paths of existing objects in the file, which do not move when more are added
+    std::unordered_map<PathKey, Path*, PathKeyHash> interned;
 };
 
-template<>
-struct ClassName<Variable> {
-    static constexpr const char* name = "Variable";
+// path of a missing object, which keeps its parent alive on its own
+struct DetachedPath {
+    std::shared_ptr<Path> owner;
+    Path path;
 };
 
-class Object {
-  protected:
-    std::shared_ptr<Path> path;
-    explicit Object(std::shared_ptr<Path> path_p) : path(std::move(path_p)) {}
+inline std::string error_message(int ret) {
+    if (NC_ISSYSERR(ret)) {
+        return std::strerror(ret);
+    }
+    return nc_strerror(ret);
+}
+
+}  // namespace detail
 
-    static inline std::string get_error_message(int ret) {
-        if (NC_ISSYSERR(ret)) {
-            return std::strerror(ret);
+inline const char* Exception::what() const noexcept {
+    if (!object) {
+        return std::runtime_error::what();
+    }
+    if (message.empty()) {
+        try {
+            message = (prefix ? std::string(prefix) : detail::error_message(ret)) + ": " + object->get_full_path();
+        } catch (...) {
+            return prefix ? prefix : nc_strerror(ret);
         }
-        return nc_strerror(ret);
     }
+    return message.c_str();
+}
 
-    void raise_error(int ret) const { throw Exception(ret, get_error_message(ret) + ": " + path->get_full_path()); }
+namespace detail {
 
-    inline void check(int ret) const {
-        if (ret != NC_NOERR) {
-            raise_error(ret);
+// only files create paths without parent (File::new_path()), all others are created below an existing parent by make_path()
+inline FilePath& Path::root() {
+    Path* res = this;
+    while (res->parent) {
+        res = res->parent;
+    }
+    return static_cast<FilePath&>(*res);
+}
+
+// Returns the path of object `id` of `kind` below `parent` for a handle, with `owner` being a handle that keeps `parent` alive.
+//
+// Paths of existing objects are created once per file in its arena, at most
+// one per parent, kind, and id, and reused as long as the name matches. All
+// their handles share the ownership of the file path instead of having a
+// control block each. Missing objects, i.e. with a negative `id`, and objects
+// whose id now has another name than when it was first looked up, e.g. after
+// an attribute has been deleted, get a path of their own. Lookups thus
+// modify the file path even through const handles.
+inline std::shared_ptr<Path> make_path(const std::shared_ptr<Path>& owner, Path* parent, PathKind kind, const char* name, int id) {
+    if (id >= 0) {
+        auto& root = parent->root();
+        auto& res = root.interned[PathKey{parent, kind, id}];
+        if (!res) {
+            root.paths.push_back(Path{name, id, kind == PathKind::group, parent});
+            res = &root.paths.back();
+        }
+        if (res->name == name) {
+            return std::shared_ptr<Path>(owner, res);
         }
     }
+    auto res = std::make_shared<DetachedPath>(DetachedPath{owner, Path{name, id, kind == PathKind::group, parent}});
+    return std::shared_ptr<Path>(res, &res->path);
+}
 
-  public:
-    const std::string& name() const { return path->name; }
-    int id() const { return path->id; }
+#ifdef NETCDFPP_WITH_INSTRUMENTATION
+}  // namespace detail
+
+/// Kind of an instrumented operation, see IOEvent.
+enum class IOOperation {
+    call,   ///< NetCDF-C call checked by an object
+    read,   ///< Variable::read()
+    write,  ///< Variable::write()
+    open,   ///< File::open()
+    close,  ///< File::close()
+    sync,   ///< File::sync()
+    copy,   ///< Group::copy_from(), Variable::copy_values(), Rechunker::copy_values()
 };
 
-}  // namespace detail
+/// One instrumented operation, see InstrumentationSink.
+struct IOEvent {
+    /// Kind of the operation.
+    IOOperation operation;
+    /// Object the operation was made on, only valid during InstrumentationSink::record().
+    const detail::Path* object;
+    /// NetCDF-C return code of calls. Other operations report NC_NOERR if
+    /// they succeeded and otherwise the error of their last failed call, or
+    /// NC_EINVAL if they failed without one.
+    int return_code;
+    /// Bytes of values read, written, or copied, zero for failed operations.
+    std::size_t bytes;
+    /// Wall time of all operations but calls in seconds.
+    double seconds;
+    /// Start time of all operations but calls.
+    std::chrono::steady_clock::time_point begin;
+
+    /// Returns the full path of the object, e.g. `file.nc:group/var`.
+    std::string path() const { return object->get_full_path(); }
+
+    /// Returns the name of the file of the object.
+    const std::string& filename() const {
+        const detail::Path* res = object;
+        while (res->parent) {
+            res = res->parent;
+        }
+        return res->name;
+    }
+};
 
-template<typename T>
-/// Optional result returned by object lookup functions.
+/// Receives instrumentation events, see set_instrumentation_sink().
 ///
-/// `Maybe<T>` is false when the requested object does not exist. Call require()
-/// to either receive the object or throw netCDF::Exception with a not-found
-/// message.
-class Maybe final {
+/// Only available with NETCDFPP_WITH_INSTRUMENTATION defined before
+/// including netcdfpp.h. Without it, the hooks compile to nothing. Events are
+/// reported by the thread making the call, so sinks used from several
+/// threads have to synchronize themselves. Sinks must not throw, not even
+/// std::bad_alloc, since noexcept functions like Variable::try_read() report
+/// events as well.
+class InstrumentationSink {
+  public:
+    virtual ~InstrumentationSink() = default;
+
+    /// Called after each operation.
+    virtual void record(const IOEvent& event) = 0;
+};
+
+namespace detail {
+
+inline std::atomic<InstrumentationSink*>& instrumentation_sink() {
+    static std::atomic<InstrumentationSink*> sink(nullptr);
+    return sink;
+}
+
+// error of the last failed call of this thread, reported for operations that fail by throwing
+inline int& last_instrumented_error() {
+    static thread_local int ret = NC_NOERR;
+    return ret;
+}
+
+inline void instrument_call(const Path& object, int ret) {
+    if (ret != NC_NOERR) {
+        last_instrumented_error() = ret;
+    }
+    auto* sink = instrumentation_sink().load(std::memory_order_acquire);
+    if (sink) {
+        sink->record(IOEvent{IOOperation::call, &object, ret, 0, 0, std::chrono::steady_clock::time_point()});
+    }
+}
+
+// reports an operation with its duration and outcome when leaving the scope, `Bytes` returns its bytes and is only called if it succeeded
+template<typename Bytes>
+class Instrument {
   private:
-    std::shared_ptr<detail::Path> path;
+    InstrumentationSink* sink;
+    IOOperation operation;
+    const Path& object;
+    const Bytes& bytes;
+    std::chrono::steady_clock::time_point begin;
+#ifdef __cpp_lib_uncaught_exceptions
+    int exceptions = std::uncaught_exceptions();
+#endif
 
-    void raise_error() const {
-        throw Exception(NC_ENOTFOUND, std::string(detail::ClassName<typename std::remove_const<T>::type>::name) + " not found: " + path->get_full_path());
+    bool unwinding() const {
+#ifdef __cpp_lib_uncaught_exceptions
+        return std::uncaught_exceptions() > exceptions;
+#else
+        return std::uncaught_exception();
+#endif
     }
 
   public:
-    explicit Maybe(std::shared_ptr<detail::Path> path_p) : path(std::move(path_p)) {}
+    int return_code = NC_NOERR;  // set by operations returning it instead of throwing
 
-    /// Returns the object or throws netCDF::Exception if the lookup failed.
-    inline T require() const {
-        if (!valid()) {
-            raise_error();
+    Instrument(IOOperation operation_p, const Path& object_p, const Bytes& bytes_p)
+        : sink(instrumentation_sink().load(std::memory_order_acquire)), operation(operation_p), object(object_p), bytes(bytes_p) {
+        if (sink) {
+            last_instrumented_error() = NC_NOERR;
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+    Instrument(const Instrument&) = delete;
+    Instrument& operator=(const Instrument&) = delete;
+
+    ~Instrument() {
+        if (sink) {
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            if (unwinding()) {
+                const auto ret = last_instrumented_error();
+                sink->record(IOEvent{operation, &object, ret == NC_NOERR ? NC_EINVAL : ret, 0, seconds, begin});
+            } else {
+                sink->record(IOEvent{operation, &object, return_code, return_code == NC_NOERR ? bytes() : 0, seconds, begin});
+            }
         }
-        return T(path);
     }
+};
 
-    /// Returns true when the lookup found an object.
-    inline bool valid() const { return path->id >= 0; }
+}  // namespace detail
 
-    /// Returns true when the lookup found an object.
-    inline operator bool() const { return valid(); }
+/// Installs the sink receiving instrumentation events, or none for `nullptr`, and returns the previous one.
+///
+/// The sink has to outlive all operations made while it is installed.
+inline InstrumentationSink* set_instrumentation_sink(InstrumentationSink* sink) { return detail::instrumentation_sink().exchange(sink); }
+
+/// Counters of one object or file, see IOStatistics.
+struct IOCounters {
+    /// Full object path, or file name for file totals.
+    std::string path;
+    /// NetCDF-C calls, including those for reads and writes.
+    std::size_t calls = 0;
+    /// NetCDF-C calls that returned an error.
+    std::size_t errors = 0;
+    /// Variable::read() calls.
+    std::size_t reads = 0;
+    /// Variable::write() calls.
+    std::size_t writes = 0;
+    /// Bytes of values read.
+    std::size_t bytes_read = 0;
+    /// Bytes of values written.
+    std::size_t bytes_written = 0;
+    /// Wall time spent in reads and writes in seconds.
+    double seconds = 0;
+    /// Chunk cache size in bytes of variables in NetCDF-4 files, as set at their first read or write.
+    std::size_t chunk_cache_size = 0;
+    /// Number of chunk cache slots of variables in NetCDF-4 files, as set at their first read or write.
+    std::size_t chunk_cache_slots = 0;
+    /// Chunk cache preemption of variables in NetCDF-4 files, as set at their first read or write.
+    float chunk_cache_preemption = 0;
 };
 
-/// NetCDF attribute attached to a group or variable.
-class Attribute final : public detail::Object {
-    friend class Group;
-    friend class Maybe<Attribute>;
-    friend class Variable;
-
+/// Instrumentation sink counting calls, bytes, and time of reads and writes per object and per file.
+///
+/// NetCDF-C does not count chunk cache hits, so only the cache settings
+/// are reported, to be compared with the chunk sizes and access patterns.
+class IOStatistics final : public InstrumentationSink {
   private:
-    explicit Attribute(std::shared_ptr<detail::Path> path_p) : detail::Object(std::move(path_p)) {}
+    struct Entry {
+        IOCounters counters;
+        bool cache_queried = false;
+    };
 
-    int ncid() const {
-        if (path->parent->is_group) {
-            return path->parent->id;
-        } else {
-            return path->parent->parent->id;
+    mutable std::mutex mutex;
+    std::map<std::string, Entry> objects;
+    std::map<std::string, Entry> files;
+
+    static Entry& entry(std::map<std::string, Entry>& entries, const std::string& path) {
+        auto it = entries.find(path);
+        if (it == std::end(entries)) {
+            it = entries.emplace(path, Entry()).first;
+            it->second.counters.path = path;
         }
+        return it->second;
     }
 
-    int othid() const {
-        if (path->parent->is_group) {
-            return NC_GLOBAL;
-        } else {
-            return path->parent->id;
+    static void add(IOCounters& c, const IOEvent& event) {
+        switch (event.operation) {
+            case IOOperation::call:
+                ++c.calls;
+                c.errors += event.return_code != NC_NOERR;
+                break;
+            case IOOperation::read:
+                ++c.reads;
+                c.bytes_read += event.bytes;
+                c.seconds += event.seconds;
+                break;
+            case IOOperation::write:
+                ++c.writes;
+                c.bytes_written += event.bytes;
+                c.seconds += event.seconds;
+                break;
+            default:
+                break;
         }
     }
 
-    template<typename T>
-    int get_internal(int ncid_p, int othid_p, const char* name_p, T* v) const {
-        static_assert(!Type<T>::is_atomic, "Should only be used for user types");
-        return nc_get_att(ncid_p, othid_p, name_p, v);
+    static std::vector<IOCounters> snapshot(const std::map<std::string, Entry>& entries) {
+        std::vector<IOCounters> res;
+        res.reserve(entries.size());
+        for (const auto& it : entries) {
+            res.push_back(it.second.counters);
+        }
+        return res;
     }
 
-    template<typename T>
-    int set_internal(int ncid_p, int othid_p, const char* name_p, std::size_t len, const T* v);
-
   public:
-    /// Copies the value and type metadata from another attribute.
-    void copy_values(const Attribute& a);
-
-    template<typename T>
-    /// Reads the attribute as a vector of values.
-    ///
-    /// Use get_string() for classic text attributes. Use get<std::string>() for
-    /// NetCDF string attributes.
-    std::vector<T> get() const {
-        static_assert(!std::is_same<char*, T>::value && !std::is_same<const char*, T>::value, "Use get_string() for reading string attributes");
-        std::size_t len;
-        check(nc_inq_attlen(ncid(), othid(), path->name.c_str(), &len));
-        std::vector<T> res(len);
-        if (res.empty()) {
-            return res;
+    void record(const IOEvent& event) override {
+        try {
+            const auto path = event.path();
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& object = entry(objects, path);
+            add(object.counters, event);
+            add(entry(files, event.filename()).counters, event);
+            if ((event.operation == IOOperation::read || event.operation == IOOperation::write) && !object.cache_queried) {
+                object.cache_queried = true;
+                auto& c = object.counters;
+                if (nc_get_var_chunk_cache(event.object->parent->id, event.object->id, &c.chunk_cache_size, &c.chunk_cache_slots, &c.chunk_cache_preemption)
+                    != NC_NOERR) {
+                    c.chunk_cache_size = c.chunk_cache_slots = 0;
+                    c.chunk_cache_preemption = 0;
+                }
+            }
+        } catch (const std::exception&) {
+            // the event is not counted if adding its object runs out of memory
         }
-        check(get_internal<T>(ncid(), othid(), path->name.c_str(), detail::data_or_null(res)));
-        return res;
     }
 
-    /// Reads a classic NetCDF text attribute as a C++ string.
-    std::string get_string() const {
-        std::size_t len;
-        check(nc_inq_attlen(ncid(), othid(), path->name.c_str(), &len));
+    /// Returns the counters of all objects, ordered by path.
+    std::vector<IOCounters> counters() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return snapshot(objects);
+    }
+
+    /// Returns the totals of all files, ordered by file name.
+    std::vector<IOCounters> file_counters() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return snapshot(files);
+    }
+
+    /// Resets all counters.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        objects.clear();
+        files.clear();
+    }
+};
+
+/// Instrumentation sink recording a timeline of operations for Perfetto and the Chrome trace viewer.
+///
+/// Records opening, closing, and syncing files, reads, writes, and copies
+/// with their object paths and byte counts, but not single NetCDF-C calls.
+/// Each thread writes to its own ring buffer of `capacity` events, keeping
+/// the newest ones, and only contends for it with write_json(). Paths
+/// longer than 99 characters are shortened at the beginning, so that
+/// recording does not allocate after the first event of a thread. If the
+/// ring of a thread cannot be allocated, its events are dropped.
+/// write_json() writes all events in the Chrome trace event format, which
+/// ui.perfetto.dev and chrome://tracing open.
+class ChromeTracer final : public InstrumentationSink {
+  private:
+    struct Event {
+        std::size_t bytes;
+        std::int64_t begin;     // in ns since the tracer was created
+        std::int64_t duration;  // in ns
+        IOOperation operation;
+        char path[100];
+    };
+
+    struct Ring {
+        std::mutex mutex;  // guards events and head
+        std::vector<Event> events;
+        std::size_t head = 0;  // number of events written so far
+        std::thread::id owner;
+        std::size_t thread;
+    };
+
+    std::uint64_t id;
+    std::size_t capacity_m;
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;  // guards rings
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    static std::uint64_t next_id() {
+        static std::atomic<std::uint64_t> res(0);
+        return ++res;
+    }
+
+    // ring of the calling thread, registered on its first event, null if that fails
+    Ring* ring() noexcept {
+        // for the tracer this thread used last, ids are not reused
+        static thread_local std::pair<std::uint64_t, Ring*> cache(0, nullptr);
+        if (cache.first != id) {
+            try {
+                const auto owner = std::this_thread::get_id();
+                std::lock_guard<std::mutex> lock(mutex);
+                const auto it = std::find_if(std::begin(rings), std::end(rings), [&](const std::unique_ptr<Ring>& r) { return r->owner == owner; });
+                if (it == std::end(rings)) {
+                    std::unique_ptr<Ring> r(new Ring);
+                    r->events.resize(capacity_m);
+                    r->owner = owner;
+                    r->thread = rings.size() + 1;
+                    rings.push_back(std::move(r));
+                    cache = std::make_pair(id, rings.back().get());
+                } else {
+                    cache = std::make_pair(id, it->get());
+                }
+            } catch (const std::exception&) {
+                return nullptr;
+            }
+        }
+        return cache.second;
+    }
+
+    static const char* name(IOOperation operation) {
+        switch (operation) {
+            case IOOperation::read:
+                return "read";
+            case IOOperation::write:
+                return "write";
+            case IOOperation::open:
+                return "open";
+            case IOOperation::close:
+                return "close";
+            case IOOperation::sync:
+                return "sync";
+            case IOOperation::copy:
+                return "copy";
+            default:
+                return "call";
+        }
+    }
+
+    // writes nanoseconds as microseconds with three decimals
+    static void write_microseconds(std::ostream& out, std::int64_t ns) {
+        const auto fraction = std::to_string(1000 + (ns < 0 ? -ns : ns) % 1000);
+        out << (ns < 0 ? "-" : "") << (ns < 0 ? -ns : ns) / 1000 << '.' << fraction.substr(1);
+    }
+
+    static void write_string(std::ostream& out, const char* s) {
+        out << '"';
+        for (; *s; ++s) {
+            const auto c = *s;
+            if (c == '"' || c == '\\') {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                const char* hex = "0123456789abcdef";
+                out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+  public:
+    /// Creates a tracer keeping the newest `capacity` events of each thread.
+    explicit ChromeTracer(std::size_t capacity = 1 << 16)
+        : id(next_id()), capacity_m(std::max<std::size_t>(capacity, 1)), origin(std::chrono::steady_clock::now()) {}
+
+    /// Returns the number of events kept per thread.
+    std::size_t capacity() const { return capacity_m; }
+
+    void record(const IOEvent& event) override {
+        if (event.operation == IOOperation::call) {
+            return;
+        }
+        auto* r = ring();
+        if (!r) {
+            return;  // events of threads without a ring are dropped
+        }
+        std::lock_guard<std::mutex> lock(r->mutex);
+        auto& e = r->events[r->head % capacity_m];
+        e.bytes = event.bytes;
+        e.begin = std::chrono::duration_cast<std::chrono::nanoseconds>(event.begin - origin).count();
+        e.duration = static_cast<std::int64_t>(event.seconds * 1e9);
+        e.operation = event.operation;
+        event.object->copy_full_path(e.path, sizeof(e.path));
+        ++r->head;
+    }
+
+    /// Returns the number of events kept, over all threads.
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t res = 0;
+        for (const auto& r : rings) {
+            std::lock_guard<std::mutex> ring_lock(r->mutex);
+            res += std::min(r->head, capacity_m);
+        }
+        return res;
+    }
+
+    /// Drops all events.
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& r : rings) {
+            std::lock_guard<std::mutex> ring_lock(r->mutex);
+            r->head = 0;
+        }
+    }
+
+    /// Writes the events as a JSON object in the Chrome trace event format.
+    void write_json(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        bool first = true;
+        for (const auto& r : rings) {
+            std::lock_guard<std::mutex> ring_lock(r->mutex);
+            const auto head = r->head;
+            for (auto i = head > capacity_m ? head - capacity_m : 0; i < head; ++i) {
+                const auto& e = r->events[i % capacity_m];
+                out << (first ? "\n" : ",\n") << "{\"name\": \"" << name(e.operation) << "\", \"cat\": \"netcdf\", \"ph\": \"X\", \"ts\": ";
+                write_microseconds(out, e.begin);
+                out << ", \"dur\": ";
+                write_microseconds(out, e.duration);
+                out << ", \"pid\": 1, \"tid\": " << r->thread << ", \"args\": {\"path\": ";
+                write_string(out, e.path);
+                out << ", \"bytes\": " << e.bytes << "}}";
+                first = false;
+            }
+        }
+        out << "\n]}\n";
+    }
+};
+
+namespace detail {
+
+#define NETCDFPP_INSTRUMENT_CALL(object, ret) detail::instrument_call(object, ret)
+// `n` bytes, only evaluated after a successful operation while a sink is installed, so it must not throw or make checked calls
+#define NETCDFPP_INSTRUMENT_IO(operation, object, n)                                                                 \
+    const auto netcdfpp_bytes = [&]() noexcept -> std::size_t { return (n); };                                       \
+    detail::Instrument<decltype(netcdfpp_bytes)> netcdfpp_instrument(IOOperation::operation, object, netcdfpp_bytes)
+// outcome of operations that return an error code instead of throwing
+#define NETCDFPP_INSTRUMENT_RESULT(ret) netcdfpp_instrument.return_code = (ret)
+#else
+#define NETCDFPP_INSTRUMENT_CALL(object, ret)
+#define NETCDFPP_INSTRUMENT_IO(operation, object, n)
+#define NETCDFPP_INSTRUMENT_RESULT(ret)
+#endif
+
+template<typename T>
+struct ClassName {};
+
+template<>
+struct ClassName<Attribute> {
+    static constexpr const char* name = "Attribute";
+    static constexpr const char* not_found = "Attribute not found";
+};
+
+template<>
+struct ClassName<Dimension> {
+    static constexpr const char* name = "Dimension";
+    static constexpr const char* not_found = "Dimension not found";
+};
+
+template<>
+struct ClassName<File> {
+    static constexpr const char* name = "File";
+    static constexpr const char* not_found = "File not found";
+};
+
+template<>
+struct ClassName<Group> {
+    static constexpr const char* name = "Group";
+    static constexpr const char* not_found = "Group not found";
+};
+
+template<>
+struct ClassName<UserType> {
+    static constexpr const char* name = "UserType";
+    static constexpr const char* not_found = "UserType not found";
+};
+
+template<>
+struct ClassName<Variable> {
+    static constexpr const char* name = "Variable";
+    static constexpr const char* not_found = "Variable not found";
+};
+
+// turns off prefilling with fill values in classic formats while copying values into a file that had no variables before, so
+// that the copy writes all values of the file; with other variables, new records of those would be left undefined instead
+class NoFillScope {
+  private:
+    int ncid;
+    int old_mode = -1;
+
+  public:
+    NoFillScope(int ncid_p, int variables_before) : ncid(ncid_p) {
+        int format;
+        if (variables_before == 0 && nc_inq_format(ncid, &format) == NC_NOERR && format != NC_FORMAT_NETCDF4 && format != NC_FORMAT_NETCDF4_CLASSIC
+            && nc_set_fill(ncid, NC_NOFILL, &old_mode) != NC_NOERR) {
+            old_mode = -1;
+        }
+    }
+    NoFillScope(const NoFillScope&) = delete;
+    NoFillScope& operator=(const NoFillScope&) = delete;
+
+    ~NoFillScope() {
+        if (old_mode >= 0) {
+            nc_set_fill(ncid, old_mode, nullptr);
+        }
+    }
+};
+
+// removes a temporary file when leaving the scope, also when an exception is thrown
+class RemoveFileScope {
+  private:
+    const std::string& filename;
+
+  public:
+    explicit RemoveFileScope(const std::string& filename_p) : filename(filename_p) {}
+    RemoveFileScope(const RemoveFileScope&) = delete;
+    RemoveFileScope& operator=(const RemoveFileScope&) = delete;
+
+    ~RemoveFileScope() { std::remove(filename.c_str()); }
+};
+
+class Object {
+  protected:
+    std::shared_ptr<Path> path;
+    explicit Object(std::shared_ptr<Path> path_p) : path(std::move(path_p)) {}
+
+    static inline std::string get_error_message(int ret) { return error_message(ret); }
+
+    // handles of the parent and of child objects share the ownership of this one
+    std::shared_ptr<Path> parent_path() const { return std::shared_ptr<Path>(path, path->parent); }
+    std::shared_ptr<Path> child_path(PathKind kind, const char* name, int id) const { return make_path(path, path.get(), kind, name, id); }
+
+    void raise_error(int ret) const { throw Exception(ret, path); }
+
+    inline void check(int ret) const {
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);
+        if (ret != NC_NOERR) {
+            raise_error(ret);
+        }
+    }
+
+    // classic formats need explicit switches between define mode for schema changes and data mode for values
+    void define_mode() const {
+        auto& root = path->root();
+        if (root.state.classic_model && !root.state.define_mode) {
+            if (++root.state.redefinitions > root.state.max_redefinitions) {
+                throw Exception(NC_ENOTINDEFINE, "Too many implicit redefinitions: " + path->get_full_path());
+            }
+            check(nc_redef(root.id));
+            root.state.define_mode = true;
+        }
+    }
+
+    void data_mode() const {
+        auto& root = path->root();
+        if (root.state.scopes > 0) {
+            throw Exception(NC_EINDEFINE, "Values accessed in define scope: " + path->get_full_path());
+        }
+        if (root.state.define_mode) {
+            const auto& state = root.state;
+            check(nc__enddef(root.id, state.header_free, state.variable_align, state.variable_free, state.record_align));
+            root.state.define_mode = false;
+        }
+    }
+
+    // like data_mode(), but returns the NetCDF-C return code instead of throwing
+    int try_data_mode() const noexcept {
+        auto& root = path->root();
+        if (root.state.scopes > 0) {
+            return NC_EINDEFINE;
+        }
+        if (root.state.define_mode) {
+            const auto& state = root.state;
+            const auto ret = nc__enddef(root.id, state.header_free, state.variable_align, state.variable_free, state.record_align);
+            if (ret != NC_NOERR) {
+                return ret;
+            }
+            root.state.define_mode = false;
+        }
+        return NC_NOERR;
+    }
+
+  public:
+    const std::string& name() const { return path->name; }
+    int id() const { return path->id; }
+};
+
+}  // namespace detail
+
+template<typename T>
+/// Optional result returned by object lookup functions.
+///
+/// `Maybe<T>` is false when the requested object does not exist. Call require()
+/// to either receive the object or throw netCDF::Exception with a not-found
+/// message.
+class Maybe final {
+  private:
+    std::shared_ptr<detail::Path> path;
+
+    void raise_error() const { throw Exception(NC_ENOTFOUND, path, detail::ClassName<typename std::remove_const<T>::type>::not_found); }
+
+  public:
+    explicit Maybe(std::shared_ptr<detail::Path> path_p) : path(std::move(path_p)) {}
+
+    /// Returns the object or throws netCDF::Exception if the lookup failed.
+    inline T require() const {
+        if (!valid()) {
+            raise_error();
+        }
+        return T(path);
+    }
+
+    /// Returns true when the lookup found an object.
+    inline bool valid() const { return path->id >= 0; }
+
+    /// Returns true when the lookup found an object.
+    inline operator bool() const { return valid(); }
+};
+
+/// NetCDF attribute attached to a group or variable.
+class Attribute final : public detail::Object {
+    friend class Group;
+    friend class Maybe<Attribute>;
+    friend class Variable;
+
+  private:
+    explicit Attribute(std::shared_ptr<detail::Path> path_p) : detail::Object(std::move(path_p)) {}
+
+    int ncid() const {
+        if (path->parent->is_group) {
+            return path->parent->id;
+        } else {
+            return path->parent->parent->id;
+        }
+    }
+
+    int othid() const {
+        if (path->parent->is_group) {
+            return NC_GLOBAL;
+        } else {
+            return path->parent->id;
+        }
+    }
+
+    template<typename T>
+    int get_internal(int ncid_p, int othid_p, const char* name_p, T* v) const {
+        static_assert(!Type<T>::is_atomic, "Should only be used for user types");
+        return nc_get_att(ncid_p, othid_p, name_p, v);
+    }
+
+    template<typename T>
+    int set_internal(int ncid_p, int othid_p, const char* name_p, std::size_t len, const T* v);
+
+  public:
+    /// Copies the value and type metadata from another attribute.
+    void copy_values(const Attribute& a);
+
+    template<typename T>
+    /// Reads the attribute as a vector of values.
+    ///
+    /// Use get_string() for classic text attributes. Use get<std::string>() for
+    /// NetCDF string attributes.
+    std::vector<T> get() const {
+        static_assert(!std::is_same<char*, T>::value && !std::is_same<const char*, T>::value, "Use get_string() for reading string attributes");
+        std::size_t len;
+        check(nc_inq_attlen(ncid(), othid(), path->name.c_str(), &len));
+        std::vector<T> res(len);
+        if (res.empty()) {
+            return res;
+        }
+        check(get_internal<T>(ncid(), othid(), path->name.c_str(), detail::data_or_null(res)));
+        return res;
+    }
+
+    /// Reads a classic NetCDF text attribute as a C++ string.
+    std::string get_string() const {
+        std::size_t len;
+        check(nc_inq_attlen(ncid(), othid(), path->name.c_str(), &len));
         std::vector<char> buf(len + 1);
         buf[len] = '\0';
         check(nc_get_att_text(ncid(), othid(), path->name.c_str(), &buf[0]));
@@ -395,21 +1507,22 @@ class Attribute final : public detail::Object {
     /// Returns the parent group for group attributes.
     Maybe<Group> parent_group() const {
         if (is_group_attribute()) {
-            return Maybe<Group>(path->parent);
+            return Maybe<Group>(parent_path());
         }
-        return Maybe<Group>(std::make_shared<detail::Path>(detail::Path{"..", -1, true, path}));
+        return Maybe<Group>(child_path(detail::PathKind::group, "..", -1));
     }
 
     /// Returns the parent variable for variable attributes.
     Maybe<Variable> parent_variable() const {
         if (!is_group_attribute()) {
-            return Maybe<Variable>(path->parent);
+            return Maybe<Variable>(parent_path());
         }
-        return Maybe<Variable>(std::make_shared<detail::Path>(detail::Path{"..", -1, true, path}));
+        return Maybe<Variable>(child_path(detail::PathKind::group, "..", -1));
     }
 
     /// Renames the attribute in place.
     void rename(std::string name) {
+        define_mode();
         check(nc_rename_att(ncid(), othid(), path->name.c_str(), name.c_str()));
         path->name = std::move(name);
     }
@@ -418,6 +1531,7 @@ class Attribute final : public detail::Object {
     /// Writes a vector of atomic values to the attribute.
     void set(const std::vector<T>& v) {
         static_assert(Type<T>::is_atomic, "For user type attributes use Attribute::set(const std::vector<T>& v, const UserType& type)");
+        define_mode();
         check(set_internal<T>(ncid(), othid(), path->name.c_str(), v.size(), detail::data_or_null(v)));
     }
 
@@ -431,11 +1545,13 @@ class Attribute final : public detail::Object {
     template<typename T>
     /// Writes a string attribute.
     typename std::enable_if<std::is_same<std::string, T>::value, void>::type set(T v) {
+        define_mode();
         check(set_internal(ncid(), othid(), path->name.c_str(), v.length() + 1, v.c_str()));
     }
     template<typename T>
     /// Writes a string attribute from a C string.
     typename std::enable_if<std::is_same<const char*, T>::value || std::is_same<char*, T>::value, void>::type set(T v) {
+        define_mode();
         check(set_internal(ncid(), othid(), path->name.c_str(), std::strlen(v) + 1, v));
     }
     template<typename T>
@@ -443,6 +1559,7 @@ class Attribute final : public detail::Object {
     typename std::enable_if<!std::is_same<std::string, T>::value && !std::is_same<const char*, T>::value && !std::is_same<char*, T>::value, void>::type set(
         T v) {
         static_assert(Type<T>::is_atomic, "For user type attributes use Attribute::set(T v, const UserType& type)");
+        define_mode();
         check(set_internal<T>(ncid(), othid(), path->name.c_str(), 1, &v));
     }
 
@@ -502,6 +1619,18 @@ class Dimension final : public detail::Object {
         return size_m;
     }
 
+    /// Queries the length again and returns the records added since this handle last read it.
+    ///
+    /// size() caches the length, so call this on unlimited dimensions of
+    /// growing files, e.g. after File::sync(), to read only the new records.
+    /// The first call on a handle returns all records.
+    RecordRange refresh() const {
+        const auto begin = size_read ? size_m : 0;
+        check(nc_inq_dimlen(path->parent->id, path->id, &size_m));
+        size_read = true;
+        return RecordRange{std::min(begin, size_m), size_m};
+    }
+
     /// Returns true when the dimension is unlimited.
     bool is_unlimited() const {
         int len;
@@ -519,6 +1648,7 @@ class Dimension final : public detail::Object {
 
     /// Renames the dimension in place.
     void rename(std::string name) {
+        define_mode();
         check(nc_rename_dim(path->parent->id, path->id, name.c_str()));
         path->name = std::move(name);
     }
@@ -529,6 +1659,7 @@ class Group : public detail::Object {
     friend class Attribute;
     friend class Dimension;
     friend class Maybe<Group>;
+    friend class Rechunker;
     friend class UserType;
     friend class Variable;
 
@@ -537,7 +1668,7 @@ class Group : public detail::Object {
 
   public:
     /// Defines an attribute handle. The attribute is created when a value is written.
-    Attribute add_attribute(std::string name) { return Attribute(std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path})); }
+    Attribute add_attribute(std::string name) { return Attribute(child_path(detail::PathKind::attribute, name.c_str(), -1)); }
 
     /// Copies an attribute into this group.
     Attribute add_attribute(const Attribute& a) {
@@ -552,8 +1683,9 @@ class Group : public detail::Object {
     /// Defines a fixed-size dimension.
     Dimension add_dimension(std::string name, std::size_t len) {
         int id;
+        define_mode();
         check(nc_def_dim(path->id, name.c_str(), len, &id));
-        return Dimension(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+        return Dimension(child_path(detail::PathKind::dimension, name.c_str(), id));
     }
     /// Copies a dimension into this group.
     Dimension add_dimension(const Dimension& d) { return add_dimension(d.name(), d.is_unlimited() ? NC_UNLIMITED : d.size()); }
@@ -571,8 +1703,9 @@ class Group : public detail::Object {
     /// Defines a child group.
     Group add_group(std::string name) {
         int id;
+        define_mode();
         check(nc_def_grp(path->id, name.c_str(), &id));
-        return Group(std::make_shared<detail::Path>(detail::Path{std::move(name), id, true, path}));
+        return Group(child_path(detail::PathKind::group, name.c_str(), id));
     }
     /// Copies a group into this group.
     Group add_group(const Group& g, bool variable_values = false) {
@@ -586,6 +1719,9 @@ class Group : public detail::Object {
     template<typename T>
     /// Defines a compound user type with `sizeof(T)`.
     UserType add_type_compound(std::string name);
+    template<typename T>
+    /// Defines a compound user type with all fields from the CompoundBinding of T.
+    UserType add_type_compound_bound(std::string name);
 
     /// Defines an enum user type with an explicit NetCDF base type.
     UserType add_type_enum(std::string name, nc_type basetype);
@@ -628,15 +1764,17 @@ class Group : public detail::Object {
     Variable add_variable(std::string name, const std::vector<std::string>& dims);
     /// Copies a variable definition into this group.
     Variable add_variable(const Variable& v, bool with_values = false);
+    /// Copies a variable definition into this group with a different chunking, filter chain, or endianness.
+    Variable add_variable(const Variable& v, const VariableLayout& layout, bool with_values = false);
 
     /// Looks up a group attribute by name.
     Maybe<Attribute> attribute(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path});
-        const auto ret = nc_inq_attid(path->id, NC_GLOBAL, res->name.c_str(), &res->id);
+        int id = -1;
+        const auto ret = nc_inq_attid(path->id, NC_GLOBAL, name.c_str(), &id);
         if (ret != NC_ENOTATT) {
             check(ret);
         }
-        return Maybe<Attribute>(std::move(res));
+        return Maybe<Attribute>(child_path(detail::PathKind::attribute, name.c_str(), id));
     }
 
     /// Returns all group attributes.
@@ -648,7 +1786,7 @@ class Group : public detail::Object {
         char name[NC_MAX_NAME + 1];
         for (int id = 0; id < count; ++id) {
             check(nc_inq_attname(path->id, NC_GLOBAL, id, name));
-            res.emplace_back(Attribute{std::make_shared<detail::Path>(detail::Path{std::string(name), id, false, path})});
+            res.emplace_back(Attribute(child_path(detail::PathKind::attribute, name, id)));
         }
         return res;
     }
@@ -667,6 +1805,7 @@ class Group : public detail::Object {
     }
     /// Copies attributes, dimensions, user types, variables, and child groups.
     void copy_from(const Group& g, bool variable_values = false) {
+        NETCDFPP_INSTRUMENT_IO(copy, *path, 0);
         copy_attributes(g);
         copy_dimensions(g);
         copy_user_types(g);
@@ -687,12 +1826,12 @@ class Group : public detail::Object {
 
     /// Looks up a dimension by name.
     Maybe<Dimension> dimension(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path});
-        const auto ret = nc_inq_dimid(path->id, res->name.c_str(), &res->id);
+        int id = -1;
+        const auto ret = nc_inq_dimid(path->id, name.c_str(), &id);
         if (ret != NC_EBADDIM) {
             check(ret);
         }
-        return Maybe<Dimension>(std::move(res));
+        return Maybe<Dimension>(child_path(detail::PathKind::dimension, name.c_str(), id));
     }
 
     /// Returns all dimensions visible in this group.
@@ -711,19 +1850,40 @@ class Group : public detail::Object {
         res.reserve(count);
         std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
             check(nc_inq_dimname(path->id, id, name));
-            return Dimension(std::make_shared<detail::Path>(detail::Path{name, id, false, path}));
+            return Dimension(child_path(detail::PathKind::dimension, name, id));
+        });
+        return res;
+    }
+
+    /// Returns the unlimited dimensions defined in this group.
+    std::vector<Dimension> unlimited_dimensions() const {
+        int count;
+        check(nc_inq_unlimdims(path->id, &count, nullptr));
+        if (count == 0) {
+            return {};
+        }
+
+        std::vector<int> ids(count);
+        check(nc_inq_unlimdims(path->id, nullptr, detail::data_or_null(ids)));
+
+        char name[NC_MAX_NAME + 1];
+        std::vector<Dimension> res;
+        res.reserve(count);
+        std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
+            check(nc_inq_dimname(path->id, id, name));
+            return Dimension(child_path(detail::PathKind::dimension, name, id));
         });
         return res;
     }
 
     /// Looks up a child group by name.
     Maybe<Group> group(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, true, path});
-        const auto ret = nc_inq_grp_ncid(path->id, res->name.c_str(), &res->id);
+        int id = -1;
+        const auto ret = nc_inq_grp_ncid(path->id, name.c_str(), &id);
         if (ret != NC_ENOGRP) {
             check(ret);
         }
-        return Maybe<Group>(std::move(res));
+        return Maybe<Group>(child_path(detail::PathKind::group, name.c_str(), id));
     }
 
     /// Returns all direct child groups.
@@ -742,13 +1902,14 @@ class Group : public detail::Object {
         res.reserve(count);
         std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
             check(nc_inq_grpname(id, name));
-            return Group(std::make_shared<detail::Path>(detail::Path{name, id, true, path}));
+            return Group(child_path(detail::PathKind::group, name, id));
         });
         return res;
     }
 
     /// Renames the group in place.
     void rename(std::string name) {
+        define_mode();
         check(nc_rename_grp(path->id, name.c_str()));
         path->name = std::move(name);
     }
@@ -756,22 +1917,19 @@ class Group : public detail::Object {
     /// Returns the parent group, if this is not the root group.
     Maybe<Group> parent() const {
         if (path->parent) {
-            return Maybe<Group>(path->parent);
+            return Maybe<Group>(parent_path());
         }
-        return Maybe<Group>(std::make_shared<detail::Path>(detail::Path{"..", -1, true, path}));
+        return Maybe<Group>(child_path(detail::PathKind::group, "..", -1));
     }
 
     /// Looks up a user-defined type by name.
     Maybe<UserType> user_type(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path});
-        const auto ret = nc_inq_typeid(path->id, res->name.c_str(), &res->id);
+        int id = -1;
+        const auto ret = nc_inq_typeid(path->id, name.c_str(), &id);
         if (ret != NC_EBADTYPE) {
             check(ret);
         }
-        if (!detail::is_user_type(res->id)) {
-            res->id = -1;
-        }
-        return Maybe<UserType>(std::move(res));
+        return Maybe<UserType>(child_path(detail::PathKind::type, name.c_str(), detail::is_user_type(id) ? id : -1));
     }
 
     /// Returns all user-defined types in this group.
@@ -779,60 +1937,177 @@ class Group : public detail::Object {
 
     /// Looks up a variable by name.
     Maybe<Variable> variable(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path});
-        const auto ret = nc_inq_varid(path->id, res->name.c_str(), &res->id);
+        int id = -1;
+        const auto ret = nc_inq_varid(path->id, name.c_str(), &id);
         if (ret != NC_ENOTVAR) {
             check(ret);
         }
-        return Maybe<Variable>(std::move(res));
+        return Maybe<Variable>(child_path(detail::PathKind::variable, name.c_str(), id));
     }
 
     /// Returns all variables in this group.
     std::vector<Variable> variables() const;
 };
 
-/// NetCDF file handle and root group.
+/// Batch of schema changes, returned by File::define().
 ///
-/// File owns the NetCDF file id and closes it in the destructor.
-class File final : public Group {
-  public:
-    /// Creates a closed file handle.
-    File() : Group(std::make_shared<detail::Path>(detail::Path{"", -1, true, nullptr})) {}
+/// In classic formats, every schema change after reading or writing values
+/// switches the file back to define mode, and leaving define mode again may
+/// move all data in the file. A DefineScope switches to define mode once and
+/// leaves it, applying the padding options of the file, when it is ended or
+/// destroyed. Reading or writing values while a scope is active throws.
+class DefineScope final : public detail::Object {
+    friend class File;
 
-    /// Opens or creates a file.
-    ///
-    /// Modes are `'r'` for read-only, `'a'` for read-write append, and `'w'`
-    /// for creating a NetCDF4 file with clobber semantics.
-    File(std::string filename, char mode) : File() { open(std::move(filename), mode); }
+  private:
+    int file_id;
 
-    /// Opens or creates a file.
-    File(const char* filename, char mode) : File(std::string(filename), mode) {}
+    explicit DefineScope(std::shared_ptr<detail::Path> path_p) : detail::Object(std::move(path_p)), file_id(path->id) {
+        auto& state = path->root().state;
+        if (state.classic_model && !state.define_mode) {
+            check(nc_redef(path->id));
+            state.define_mode = true;
+        }
+        ++state.scopes;
+    }
+
+  public:
+    DefineScope(DefineScope&& other) noexcept : detail::Object(std::move(other.path)), file_id(other.file_id) {}
+    DefineScope(const DefineScope&) = delete;
+    DefineScope& operator=(const DefineScope&) = delete;
+    DefineScope& operator=(DefineScope&&) = delete;
+
+    /// Ends the scope without throwing, use end() to handle errors.
+    ~DefineScope() {
+        try {
+            end();
+        } catch (...) {
+        }
+    }
+
+    /// Ends the scope and, if it is the outermost one, leaves define mode.
+    void end() {
+        if (!path) {
+            return;
+        }
+        const auto file = std::move(path);
+        auto& state = file->root().state;
+        if (file->id != file_id || state.scopes == 0) {
+            return;  // file has been closed or reopened in the meantime
+        }
+        --state.scopes;
+        if (state.scopes == 0 && state.define_mode) {
+            check_file(file, nc__enddef(file->id, state.header_free, state.variable_align, state.variable_free, state.record_align));
+            state.define_mode = false;
+        }
+    }
+
+  private:
+    static void check_file(const std::shared_ptr<detail::Path>& file, int ret) {
+        if (ret != NC_NOERR) {
+            throw Exception(ret, get_error_message(ret) + ": " + file->get_full_path());
+        }
+    }
+};
+
+/// NetCDF file handle and root group.
+///
+/// File owns the NetCDF file id and closes it in the destructor.
+class File final : public Group {
+  public:
+    /// Creates a closed file handle.
+    File() : Group(new_path()) {}
+
+    /// Opens or creates a file.
+    ///
+    /// Modes are `'r'` for read-only, `'a'` for read-write append, and `'w'`
+    /// for creating a NetCDF4 file with clobber semantics.
+    File(std::string filename, char mode) : File() { open(std::move(filename), mode); }
+
+    /// Opens or creates a file.
+    File(const char* filename, char mode) : File(std::string(filename), mode) {}
+
+    /// Opens or creates a file with a format and flags from `options`.
+    File(std::string filename, char mode, const FileOptions& options) : File() { open(std::move(filename), mode, options); }
 
     /// Closes the file if it is open.
     ~File() { close(); }
 
     /// Opens or creates a file, closing any currently open file first.
-    void open(std::string filename, char mode) {
-        close();
-        path->name = std::move(filename);
+    void open(std::string filename, char mode) { open(std::move(filename), mode, FileOptions()); }
+
+    /// Opens or creates a file with a format and flags from `options`, closing any currently open file first.
+    ///
+    /// Classic formats are switched between define and data mode as needed.
+    /// The padding options are applied whenever define mode is left.
+    void open(std::string filename, char mode, const FileOptions& options) {
+        auto& state = reset(std::move(filename), options);
+        NETCDFPP_INSTRUMENT_IO(open, *path, 0);
+        const int flags = options.flags | (options.share ? NC_SHARE : 0);
+        auto buffer_size = options.buffer_size;
         switch (mode) {
-            case 'a':
-                check(nc_open(path->name.c_str(), NC_WRITE, &path->id));
+            case 'a': {
+                check(nc__open(path->name.c_str(), NC_WRITE | flags, &buffer_size, &path->id));
+                state.classic_model = format() != NC_FORMAT_NETCDF4;
+            } break;
+            case 'r':
+                check(nc__open(path->name.c_str(), NC_NOWRITE | flags, &buffer_size, &path->id));
+                break;
+            case 'w':
+                check(nc__create(path->name.c_str(), create_mode(options.format) | (options.clobber ? NC_CLOBBER : NC_NOCLOBBER) | flags, options.initial_size,
+                                 &buffer_size, &path->id));
+                state.classic_model = options.format != NC_FORMAT_NETCDF4;
+                state.define_mode = state.classic_model;
                 break;
+            default:
+                throw std::runtime_error("Unknown file mode");
+        }
+    }
+
+#ifdef NETCDFPP_WITH_MPI
+    /// Opens or creates a file for parallel I/O by all ranks of `comm`.
+    File(std::string filename, char mode, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL, const FileOptions& options = FileOptions()) : File() {
+        open_parallel(std::move(filename), mode, comm, info, options);
+    }
+
+    /// Opens or creates a file for parallel I/O by all ranks of `comm`, closing any currently open file first.
+    ///
+    /// This is a collective call, as are all schema changes and closing the
+    /// file afterwards. NetCDF-4 files use parallel HDF5, classic formats use
+    /// PnetCDF. The buffer and initial size options are ignored. See
+    /// Variable::set_parallel_access() for collective or independent access
+    /// to values and Variable::partition() for splitting the values between
+    /// ranks.
+    void open_parallel(std::string filename, char mode, MPI_Comm comm, MPI_Info info = MPI_INFO_NULL, const FileOptions& options = FileOptions()) {
+        auto& state = reset(std::move(filename), options);
+        NETCDFPP_INSTRUMENT_IO(open, *path, 0);
+        const int flags = options.flags | (options.share ? NC_SHARE : 0);
+        switch (mode) {
+            case 'a': {
+                check(nc_open_par(path->name.c_str(), NC_WRITE | flags, comm, info, &path->id));
+                state.classic_model = format() != NC_FORMAT_NETCDF4;
+            } break;
             case 'r':
-                check(nc_open(path->name.c_str(), NC_NOWRITE, &path->id));
+                check(nc_open_par(path->name.c_str(), NC_NOWRITE | flags, comm, info, &path->id));
                 break;
             case 'w':
-                check(nc_create(path->name.c_str(), NC_NETCDF4 | NC_CLOBBER, &path->id));
+                check(nc_create_par(path->name.c_str(), create_mode(options.format) | (options.clobber ? NC_CLOBBER : NC_NOCLOBBER) | flags, comm, info,
+                                    &path->id));
+                state.classic_model = options.format != NC_FORMAT_NETCDF4;
+                state.define_mode = state.classic_model;
                 break;
             default:
                 throw std::runtime_error("Unknown file mode");
         }
     }
+#endif
 
     /// Closes the file if it is open.
     void close() {
         if (is_open()) {
+            NETCDFPP_INSTRUMENT_IO(close, *path, 0);
+            static_cast<detail::FilePath&>(*path).state.scopes = 0;
+            data_mode();
             check(nc_close(path->id));
             path->id = -1;
         }
@@ -841,8 +2116,114 @@ class File final : public Group {
     /// Returns true when this object owns an open NetCDF file id.
     bool is_open() const { return path->id >= 0; }
 
+    /// Sets the fill mode, NC_FILL or NC_NOFILL, and returns the previous one.
+    ///
+    /// With NC_NOFILL, NetCDF-C does not write fill values to newly allocated
+    /// space before the actual values, which saves up to half of the I/O when
+    /// all values are written anyway. Values that are never written are
+    /// undefined then. Copying groups with values into classic files without
+    /// variables uses NC_NOFILL automatically. In NetCDF-4 files, the mode
+    /// only applies to variables defined afterwards.
+    int set_fill_mode(int mode) {
+        int res;
+        check(nc_set_fill(path->id, mode, &res));
+        return res;
+    }
+
+    /// Starts a batch of schema changes, see DefineScope.
+    DefineScope define() { return DefineScope(path); }
+
+    /// Returns how often schema changes after reading or writing values switched a classic file back to define mode.
+    std::size_t redefinitions() const { return static_cast<detail::FilePath&>(*path).state.redefinitions; }
+
+    /// Returns the file format, e.g. NC_FORMAT_NETCDF4 or NC_FORMAT_CDF5.
+    int format() const {
+        int res;
+        check(nc_inq_format(path->id, &res));
+        return res;
+    }
+
     /// Flushes buffered changes to disk.
-    void sync() const { check(nc_sync(path->id)); }
+    void sync() const {
+        NETCDFPP_INSTRUMENT_IO(sync, *path, 0);
+        data_mode();
+        check(nc_sync(path->id));
+    }
+
+    /// Syncs the file and returns the unlimited dimensions in all groups that grew since the last call, with their new records.
+    ///
+    /// The first call after opening reports all records. Readers of a
+    /// classic file opened with FileOptions::share see the records appended
+    /// by a writer in another process once the writer has synced. NetCDF-4
+    /// files have to be reopened for that.
+    std::vector<std::pair<Dimension, RecordRange>> poll() {
+        sync();
+        std::vector<std::pair<Dimension, RecordRange>> res;
+        poll(*this, res);
+        return res;
+    }
+
+  private:
+    void poll(const Group& g, std::vector<std::pair<Dimension, RecordRange>>& res) {
+        auto& polled = static_cast<detail::FilePath&>(*path).polled_lengths;
+        for (const auto& d : g.unlimited_dimensions()) {
+            const auto len = d.size();
+            auto& last = polled[d.id()];
+            if (len > last) {
+                res.emplace_back(d, RecordRange{last, len});
+                last = len;
+            }
+        }
+        for (const auto& child : g.groups()) {
+            poll(child, res);
+        }
+    }
+
+    detail::FileState& reset(std::string filename, const FileOptions& options) {
+        close();
+        path->name = std::move(filename);
+        auto& root = static_cast<detail::FilePath&>(*path);
+        root.polled_lengths.clear();
+        root.interned.clear();  // ids are only unique within one open file
+        if (path.use_count() == 1) {
+            root.paths.clear();  // no handles of the previous file left
+        }
+        auto& state = root.state;
+        state = detail::FileState{false,
+                                  false,
+                                  options.header_free,
+                                  options.variable_align,
+                                  options.variable_free,
+                                  options.record_align,
+                                  0,
+                                  options.max_redefinitions,
+                                  0};
+        return state;
+    }
+
+    static std::shared_ptr<detail::Path> new_path() {
+        auto res = std::make_shared<detail::FilePath>();
+        res->id = -1;
+        res->is_group = true;
+        return res;
+    }
+
+    int create_mode(int format_p) const {
+        switch (format_p) {
+            case NC_FORMAT_NETCDF4:
+                return NC_NETCDF4;
+            case NC_FORMAT_NETCDF4_CLASSIC:
+                return NC_NETCDF4 | NC_CLASSIC_MODEL;
+            case NC_FORMAT_CLASSIC:
+                return 0;
+            case NC_FORMAT_64BIT_OFFSET:
+                return NC_64BIT_OFFSET;
+            case NC_FORMAT_CDF5:
+                return NC_CDF5;
+            default:
+                throw Exception(NC_EINVAL, "Unknown file format: " + path->get_full_path());
+        }
+    }
 };
 
 /// NetCDF user-defined type.
@@ -850,6 +2231,9 @@ class UserType final : public detail::Object {
     friend class Group;
     friend class Maybe<UserType>;
     friend class testing::TestUserType;
+    friend class CompoundColumns;
+    template<typename T>
+    friend class CompoundPlan;
 
   public:
     /// Compound field metadata.
@@ -880,11 +2264,12 @@ class UserType final : public detail::Object {
 
   public:
     /// Returns the parent group.
-    Group parent() const { return Group(path->parent); }
+    Group parent() const { return Group(parent_path()); }
 
     template<typename T>
     /// Adds a scalar field to a compound type.
     UserType add_compound_field(const std::string& name, std::size_t offset) {
+        define_mode();
         check(nc_insert_compound(path->parent->id, path->id, name.c_str(), offset, Type<T>::id));
         return *this;
     }
@@ -892,14 +2277,29 @@ class UserType final : public detail::Object {
     template<typename T>
     /// Adds an array field to a compound type.
     UserType add_compound_field_array(const std::string& name, std::size_t offset, const std::vector<int>& dim_sizes) {
+        define_mode();
         check(nc_insert_array_compound(path->parent->id, path->id, name.c_str(), offset, Type<typename std::remove_all_extents<T>::type>::id, dim_sizes.size(),
                                        detail::data_or_null(dim_sizes)));
         return *this;
     }
 
+    /// Adds a scalar or array field described by compound field metadata.
+    UserType add_compound_field(const CompoundField& field) {
+        if (field.dimensions.empty()) {
+            define_mode();
+            check(nc_insert_compound(path->parent->id, path->id, field.name.c_str(), field.offset, field.type));
+        } else {
+            define_mode();
+            check(nc_insert_array_compound(path->parent->id, path->id, field.name.c_str(), field.offset, field.type, static_cast<int>(field.dimensions.size()),
+                                           detail::data_or_null(field.dimensions)));
+        }
+        return *this;
+    }
+
     template<typename T>
     /// Adds an enum member.
     UserType add_enum_member(const std::string& name, T v) {
+        define_mode();
         check(nc_insert_enum(path->parent->id, path->id, name.c_str(), &v));
         return *this;
     }
@@ -976,588 +2376,3821 @@ class UserType final : public detail::Object {
     }
 };
 
+namespace detail {
+
+struct SizeOf {
+    template<typename T>
+    std::size_t operator()(T /* v */) const {
+        return sizeof(T);
+    }
+};
+
 template<typename T>
-/// RAII wrapper for one NetCDF variable-length value returned by the C API.
-struct VLenElement {
-    /// Number of elements.
-    const std::size_t size;
-    /// Pointer to the allocated element data.
-    const T* data;
+struct ArrayDimensions {
+    static void append(std::vector<int>& /* dims */) {}
+};
 
-    VLenElement() : size(0), data(nullptr) {}
-    ~VLenElement() { std::free(const_cast<T*>(data)); }
+template<typename T, std::size_t N>
+struct ArrayDimensions<T[N]> {
+    static void append(std::vector<int>& dims) {
+        dims.push_back(static_cast<int>(N));
+        ArrayDimensions<T>::append(dims);
+    }
 };
 
-/// NetCDF variable.
-class Variable final : public detail::Object {
-    friend class Group;
-    friend class Maybe<Variable>;
+template<typename T>
+inline UserType::CompoundField compound_field(const char* name, std::size_t offset) {
+    using element_type = typename std::remove_all_extents<T>::type;
+    static_assert(Type<element_type>::is_atomic && !std::is_same<char*, element_type>::value, "Compound fields must be of a fixed-size atomic type");
+    UserType::CompoundField res{Type<element_type>::id, name, offset, {}};
+    ArrayDimensions<T>::append(res.dimensions);
+    return res;
+}
+
+}  // namespace detail
 
+template<typename T>
+/// Precomputed mapping between a bound C++ struct and a compound type.
+///
+/// The plan is validated once against the compound type found in the file.
+/// When the file layout equals the layout of `T`, reads and writes go straight
+/// through `T*`. Otherwise, e.g. for packed files, the stored memberwise copy
+/// steps convert between both layouts.
+class CompoundPlan final {
   private:
-    explicit Variable(std::shared_ptr<detail::Path> path_p) : detail::Object(std::move(path_p)) {}
+    struct Step {
+        std::size_t file_offset;
+        std::size_t memory_offset;
+        std::size_t bytes;
+    };
+    std::vector<Step> steps;
+    std::size_t file_size;
+    bool direct;
 
-    std::vector<int> dimension_ids() const {
-        const auto count = dimension_count();
-        if (count == 0) {
-            return {};
+  public:
+    /// Validates the binding of `T` against a compound type.
+    ///
+    /// @throws netCDF::Exception if the type is not a compound, or if a bound
+    /// field is missing or has a different type or shape.
+    explicit CompoundPlan(const UserType& type) : file_size(type.bytes_size()), direct(false) {
+        static_assert(CompoundBinding<T>::is_bound, "Bind the C++ type with NETCDFPP_COMPOUND_BEGIN first");
+        if (type.typeclass() != NC_COMPOUND) {
+            throw Exception(NC_EBADCLASS, "Type '" + type.name() + "' is not a compound: " + type.path->get_full_path());
         }
-        std::vector<int> ids(count);
-        check(nc_inq_vardimid(path->parent->id, path->id, detail::data_or_null(ids)));
-        return ids;
-    }
-
-    static std::string type_name(int ncid_p, nc_type type_p) {
-        char name[NC_MAX_NAME + 1];
-        if (nc_inq_type(ncid_p, type_p, name, nullptr) != NC_NOERR) {
-            return "";
+        const auto file_fields = type.compound_fields();
+        const auto fields = CompoundBinding<T>::fields();
+        direct = file_size == sizeof(T) && file_fields.size() == fields.size();
+        for (const auto& field : fields) {
+            const auto it = std::find_if(std::begin(file_fields), std::end(file_fields),
+                                         [&](const UserType::CompoundField& f) { return f.name == field.name; });
+            if (it == std::end(file_fields)) {
+                throw Exception(NC_EBADFIELD, "Compound field '" + field.name + "' not found: " + type.path->get_full_path());
+            }
+            if (it->type != field.type || it->dimensions != field.dimensions) {
+                throw Exception(NC_EBADFIELD, "Unexpected type for compound field '" + field.name + "': " + type.path->get_full_path());
+            }
+            std::size_t bytes = for_type<std::size_t>(field.type, detail::SizeOf());
+            for (const auto d : field.dimensions) {
+                bytes *= static_cast<std::size_t>(d);
+            }
+            direct = direct && it->offset == field.offset;
+            steps.push_back(Step{it->offset, field.offset, bytes});
         }
-        return name;
-    }
-
-    static bool same_type_for_copy(int this_ncid, nc_type this_type, int oth_ncid, nc_type oth_type) {
-        const auto this_is_user = detail::is_user_type(this_type);
-        const auto oth_is_user = detail::is_user_type(oth_type);
-        if (this_is_user != oth_is_user) {
-            return false;
+        if (direct) {
+            steps.clear();
+            return;
         }
-        if (!this_is_user) {
-            return this_type == oth_type;
+        for (const auto& f : file_fields) {
+            if (f.type == NC_STRING || detail::is_user_type(f.type)) {
+                throw Exception(NC_EBADFIELD, "Unsupported type for compound field '" + f.name + "': " + type.path->get_full_path());
+            }
         }
-        return type_name(this_ncid, this_type) == type_name(oth_ncid, oth_type);
-    }
-
-    std::size_t size(const std::size_t* /* start */, const std::size_t* count) const {
-        int dims_count;
-        check(nc_inq_varndims(path->parent->id, path->id, &dims_count));
-
-        std::size_t res = 1;
-        for (int i = 0; i < dims_count; ++i) {
-            res *= count[i];
+        std::sort(std::begin(steps), std::end(steps), [](const Step& a, const Step& b) { return a.file_offset < b.file_offset; });
+        std::vector<Step> merged;
+        for (const auto& step : steps) {
+            if (!merged.empty() && merged.back().file_offset + merged.back().bytes == step.file_offset
+                && merged.back().memory_offset + merged.back().bytes == step.memory_offset) {
+                merged.back().bytes += step.bytes;
+            } else {
+                merged.push_back(step);
+            }
         }
-        return res;
+        steps = std::move(merged);
     }
 
-  public:
-    /// Defines an attribute handle. The attribute is created when a value is written.
-    Attribute add_attribute(std::string name) { return Attribute(std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path})); }
+    /// Returns true when values can be read and written through `T*` without conversion.
+    bool is_direct() const { return direct; }
 
-    /// Copies an attribute onto this variable.
-    Attribute add_attribute(const Attribute& a) {
-        auto res = add_attribute(a.name());
-        res.copy_values(a);
-        return res;
-    }
+    /// Returns the byte size of one value in the file layout.
+    std::size_t file_bytes_size() const { return file_size; }
 
-    /// Looks up a variable attribute by name.
-    Maybe<Attribute> attribute(std::string name) const {
-        auto res = std::make_shared<detail::Path>(detail::Path{std::move(name), -1, false, path});
-        const auto ret = nc_inq_attid(path->parent->id, path->id, res->name.c_str(), &res->id);
-        if (ret != NC_ENOTATT) {
-            check(ret);
+    /// Converts `n` values from the file layout into `T` values.
+    void from_file(const char* src, T* dst, std::size_t n) const {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto* out = reinterpret_cast<char*>(dst + i);
+            const auto* in = src + i * file_size;
+            for (const auto& step : steps) {
+                std::memcpy(out + step.memory_offset, in + step.file_offset, step.bytes);
+            }
         }
-        return Maybe<Attribute>(std::move(res));
     }
 
-    /// Returns all variable attributes.
-    std::vector<Attribute> attributes() const {
-        int count;
-        check(nc_inq_varnatts(path->parent->id, path->id, &count));
-        std::vector<Attribute> res;
-        res.reserve(count);
-        char name[NC_MAX_NAME + 1];
-        for (int id = 0; id < count; ++id) {
-            check(nc_inq_attname(path->parent->id, path->id, id, name));
-            res.emplace_back(Attribute{std::make_shared<detail::Path>(detail::Path{std::string(name), id, false, path})});
+    /// Converts `n` `T` values into the file layout. Unbound file fields are zeroed.
+    void to_file(const T* src, char* dst, std::size_t n) const {
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto* in = reinterpret_cast<const char*>(src + i);
+            auto* out = dst + i * file_size;
+            std::memset(out, 0, file_size);
+            for (const auto& step : steps) {
+                std::memcpy(out + step.file_offset, in + step.memory_offset, step.bytes);
+            }
         }
-        return res;
     }
+};
 
-    /// Returns true when the variable dimensions match the supplied names exactly.
-    bool check_dimensions(const std::vector<std::string>& names) const {
-        const auto& dims = dimensions();
-        if (dims.size() != names.size()) {
-            return false;
-        }
-        for (std::size_t i = 0; i < names.size(); ++i) {
-            if (dims[i].name() != names[i]) {
-                return false;
+namespace detail {
+
+template<std::size_t Bytes>
+inline void strided_copy(char* dst, std::size_t dst_stride, const char* src, std::size_t src_stride, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::memcpy(dst + i * dst_stride, src + i * src_stride, Bytes);
+    }
+}
+
+inline void strided_copy(char* dst, std::size_t dst_stride, const char* src, std::size_t src_stride, std::size_t n, std::size_t bytes) {
+    // fixed sizes let the compiler replace memcpy by plain loads and stores
+    switch (bytes) {
+        case 1:
+            strided_copy<1>(dst, dst_stride, src, src_stride, n);
+            break;
+        case 2:
+            strided_copy<2>(dst, dst_stride, src, src_stride, n);
+            break;
+        case 4:
+            strided_copy<4>(dst, dst_stride, src, src_stride, n);
+            break;
+        case 8:
+            strided_copy<8>(dst, dst_stride, src, src_stride, n);
+            break;
+        default:
+            for (std::size_t i = 0; i < n; ++i) {
+                std::memcpy(dst + i * dst_stride, src + i * src_stride, bytes);
             }
-        }
-        return true;
     }
+}
 
-    /// Returns this variable or throws if its dimensions do not match.
-    Variable require_dimensions(const std::vector<std::string>& names) const {
-        if (!check_dimensions(names)) {
-            throw Exception(NC_EVARMETA, "Unexpected dimensions: " + path->get_full_path());
+}  // namespace detail
+
+/// Struct-of-arrays buffers for a compound type.
+///
+/// Each compound field gets its own contiguous column. Variable::read_columns()
+/// scatters a compound hyperslab into the columns and
+/// Variable::write_columns() gathers them back. The staging buffer holding the
+/// compound records is kept between calls and only grows.
+class CompoundColumns final {
+    friend class Variable;
+
+  private:
+    struct Column {
+        UserType::CompoundField field;
+        std::size_t bytes;
+        std::vector<char> data;
+    };
+    std::vector<Column> columns;
+    mutable std::vector<char> staging;
+    std::string type_path;
+    std::string type_name;
+    nc_type type_id;
+    std::size_t record_size;
+    std::size_t size_m = 0;
+
+    const Column& find(const std::string& name) const {
+        const auto it = std::find_if(std::begin(columns), std::end(columns), [&](const Column& c) { return c.field.name == name; });
+        if (it == std::end(columns)) {
+            throw Exception(NC_EBADFIELD, "Compound field '" + name + "' not found: " + type_path);
         }
-        return *this;
+        return *it;
     }
 
-    /// Copies all attributes from another variable.
-    void copy_attributes(const Variable& v) {
-        for (const auto& it : v.attributes()) {
-            add_attribute(it);
+    template<typename T>
+    const Column& checked(const Column& c) const {
+        if (Type<typename std::remove_all_extents<T>::type>::id != c.field.type) {
+            throw Exception(NC_EBADTYPE, "Unexpected type for compound field '" + c.field.name + "': " + type_path);
         }
+        return c;
     }
 
-    /// Copies raw values from another variable after checking shape and type size.
-    void copy_values(const Variable& v) {
-        const auto this_type = type();
-        const auto oth_type = v.type();
-        if (!same_type_for_copy(path->parent->id, this_type, v.path->parent->id, oth_type)) {
-            throw Exception(NC_EVARMETA, "Variable types do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+    char* prepare_staging(std::size_t n) const {
+        if (staging.size() < n * record_size) {
+            staging.resize(n * record_size);
         }
+        return detail::data_or_null(staging);
+    }
 
-        std::size_t this_type_len;
-        check(nc_inq_type(path->parent->id, this_type, nullptr, &this_type_len));
-        std::size_t oth_type_len;
-        check(nc_inq_type(v.path->parent->id, oth_type, nullptr, &oth_type_len));
+    void scatter(std::size_t n) {
+        for (auto& c : columns) {
+            detail::strided_copy(detail::data_or_null(c.data), c.bytes, detail::data_or_null(staging) + c.field.offset, record_size, n, c.bytes);
+        }
+    }
 
-        if (this_type_len != oth_type_len) {
-            throw Exception(NC_EVARMETA, "Variable type sizes do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+    void gather(std::size_t n) const {
+        auto* records = prepare_staging(n);
+        std::memset(records, 0, n * record_size);
+        for (const auto& c : columns) {
+            detail::strided_copy(records + c.field.offset, record_size, detail::data_or_null(c.data), c.bytes, n, c.bytes);
         }
+    }
 
-        const auto this_sizes = sizes();
-        const auto oth_sizes = v.sizes();
-        if (this_sizes.size() != oth_sizes.size()) {
-            throw Exception(NC_EVARMETA, "Variable dimension counts do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+  public:
+    /// Creates empty columns for all fields of a compound type.
+    ///
+    /// @throws netCDF::Exception if the type is not a compound or has fields
+    /// that are not of a fixed-size atomic type.
+    explicit CompoundColumns(const UserType& type)
+        : type_path(type.path->get_full_path()), type_name(type.name()), type_id(type.id()), record_size(type.bytes_size()) {
+        if (type.typeclass() != NC_COMPOUND) {
+            throw Exception(NC_EBADCLASS, "Type '" + type.name() + "' is not a compound: " + type_path);
         }
-        for (std::size_t i = 0; i < oth_sizes.size(); ++i) {
-            if (this_sizes[i] != 0  // not unlimited dimension or already written to
-                && this_sizes[i] != oth_sizes[i]) {
-                throw Exception(NC_EVARMETA, "Variable sizes do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+        for (auto& field : type.compound_fields()) {
+            if (field.type == NC_STRING || detail::is_user_type(field.type)) {
+                throw Exception(NC_EBADFIELD, "Unsupported type for compound field '" + field.name + "': " + type_path);
             }
+            std::size_t bytes = for_type<std::size_t>(field.type, detail::SizeOf());
+            for (const auto d : field.dimensions) {
+                bytes *= static_cast<std::size_t>(d);
+            }
+            columns.push_back(Column{std::move(field), bytes, {}});
         }
+    }
 
-        std::vector<std::size_t> index(this_sizes.size(), 0);
+    /// Returns the number of compound values currently held.
+    std::size_t size() const { return size_m; }
 
-        std::vector<char> buf(this_type_len * v.size());
-        if (this_sizes.empty()) {
-            check(nc_get_var(v.path->parent->id, v.path->id, detail::data_or_null(buf)));
-            check(nc_put_var(path->parent->id, path->id, detail::data_or_null(buf)));
-        } else {
-            check(nc_get_vara(v.path->parent->id, v.path->id, detail::data_or_null(index), detail::data_or_null(oth_sizes), detail::data_or_null(buf)));
-            check(nc_put_vara(path->parent->id, path->id, detail::data_or_null(index), detail::data_or_null(oth_sizes), detail::data_or_null(buf)));
+    /// Sets the number of compound values, e.g. before filling columns for writing.
+    void resize(std::size_t n) {
+        for (auto& c : columns) {
+            c.data.resize(n * c.bytes);
         }
+        size_m = n;
     }
 
-    /// Returns the number of dimensions.
-    std::size_t dimension_count() const {
-        int count;
-        check(nc_inq_varndims(path->parent->id, path->id, &count));
-        return count;
-    }
-
-    /// Returns the variable dimensions.
-    std::vector<Dimension> dimensions() const {
-        const auto ids = dimension_ids();
-        char name[NC_MAX_NAME + 1];
-        std::vector<Dimension> res;
-        res.reserve(ids.size());
-        std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
-            check(nc_inq_dimname(path->parent->id, id, name));
-            return Dimension(std::make_shared<detail::Path>(detail::Path{name, id, false, path->parent}));
-        });
+    /// Returns the field metadata of all columns in compound field order.
+    std::vector<UserType::CompoundField> fields() const {
+        std::vector<UserType::CompoundField> res;
+        res.reserve(columns.size());
+        std::transform(std::begin(columns), std::end(columns), std::back_inserter(res), [](const Column& c) { return c.field; });
         return res;
     }
 
-    /// Returns chunk sizes, or an empty vector for contiguous storage.
-    std::vector<std::size_t> get_chunking() const {
-        int mode;
-        std::vector<std::size_t> res(dimension_count());
-        check(nc_inq_var_chunking(path->parent->id, path->id, &mode, detail::data_or_null(res)));
-        if (mode == NC_CONTIGUOUS) {
-            res.clear();
-        }
-        return res;
+    template<typename T>
+    /// Returns the contiguous values of a field. Array fields are stored value by value.
+    ///
+    /// @throws netCDF::Exception if the field does not exist or is not of type T.
+    T* column(const std::string& name) {
+        return const_cast<T*>(static_cast<const CompoundColumns*>(this)->column<T>(name));
     }
 
-    /// Sets chunked storage, or contiguous storage when chunks is empty.
-    void set_chunking(const std::vector<std::size_t>& chunks) {
-        if (chunks.empty()) {
-            check(nc_def_var_chunking(path->parent->id, path->id, NC_CONTIGUOUS, nullptr));
-        } else {
-            check(nc_def_var_chunking(path->parent->id, path->id, NC_CHUNKED, detail::data_or_null(chunks)));
-        }
+    template<typename T>
+    /// Returns the contiguous values of a field. Array fields are stored value by value.
+    ///
+    /// @throws netCDF::Exception if the field does not exist or is not of type T.
+    const T* column(const std::string& name) const {
+        return reinterpret_cast<const T*>(detail::data_or_null(checked<T>(find(name)).data));
     }
+};
 
-    /// Lets NetCDF choose default chunk sizes.
-    void set_default_chunking() { check(nc_def_var_chunking(path->parent->id, path->id, NC_CHUNKED, nullptr)); }
+template<typename T>
+/// RAII wrapper for one NetCDF variable-length value returned by the C API.
+struct VLenElement {
+    /// Number of elements.
+    const std::size_t size;
+    /// Pointer to the allocated element data.
+    const T* data;
 
-    /// Returns shuffle status and deflate level, or -1 when deflate is disabled.
-    std::pair<bool, int> get_compression() const {
-        int shuffle_filter;
-        int deflate_filter;
-        int deflate_level;
-        check(nc_inq_var_deflate(path->parent->id, path->id, &shuffle_filter, &deflate_filter, &deflate_level));
-        return std::make_pair(shuffle_filter, deflate_filter ? deflate_level : -1);
-    }
+    VLenElement() : size(0), data(nullptr) {}
+    ~VLenElement() { std::free(const_cast<T*>(data)); }
+};
 
-    /// Sets shuffle and deflate compression.
-    void set_compression(bool shuffle_filter, int deflate_level) {
-        check(nc_def_var_deflate(path->parent->id, path->id, shuffle_filter, deflate_level < 0 ? 0 : 1, deflate_level));
-    }
+namespace detail {
 
-    /// Returns the NetCDF endianness setting.
-    int get_endianness() const {
-        int res;
-        check(nc_inq_var_endian(path->parent->id, path->id, &res));
-        return res;
-    }
+struct VLenBuffer {
+    std::vector<nc_vlen_t> data;
 
-    /// Sets NC_ENDIAN_NATIVE, NC_ENDIAN_LITTLE, or NC_ENDIAN_BIG.
-    void set_endianness(int endianness) { check(nc_def_var_endian(path->parent->id, path->id, endianness)); }
+    explicit VLenBuffer(std::size_t n) : data(n) {}
+    ~VLenBuffer() { nc_free_vlens(data.size(), data_or_null(data)); }
+};
 
-    /// Returns true when Fletcher32 checksums are enabled.
-    bool get_checksum_enabled() const {
-        int res;
-        check(nc_inq_var_fletcher32(path->parent->id, path->id, &res));
-        return res == NC_FLETCHER32;
-    }
+}  // namespace detail
 
-    /// Enables or disables Fletcher32 checksums.
-    void set_checksum_enabled(bool v) { check(nc_def_var_fletcher32(path->parent->id, path->id, v ? NC_FLETCHER32 : NC_NOCHECKSUM)); }
+template<typename T>
+/// Ragged array of variable-length values in one contiguous buffer.
+///
+/// Value `i` consists of the elements from `offsets()[i]` to
+/// `offsets()[i + 1]` in `values()`. Reading copies the data allocated by the
+/// NetCDF-C library once and releases those allocations right away.
+class VLenArray final {
+    friend class RaggedArray;
+    friend class Variable;
 
-    template<typename T>
-    /// Returns whether fill is enabled and the fill value.
-    std::pair<bool, T> get_fill() const {
-        int no_fill;
-        T res;
-        check(nc_inq_var_fill(path->parent->id, path->id, &no_fill, &res));
-        return std::make_pair(!no_fill, res);
-    }
+  private:
+    std::vector<T> values_m;
+    std::vector<std::size_t> offsets_m;
 
-    template<typename T>
-    /// Enables fill and sets the fill value.
-    void set_fill(T v) {
-        check(nc_def_var_fill(path->parent->id, path->id, 0, &v));
-    }
+  public:
+    VLenArray() : offsets_m(1, 0) {}
 
-    /// Disables fill for this variable.
-    void unset_fill() { check(nc_def_var_fill(path->parent->id, path->id, 1, nullptr)); }
+    /// Returns the number of variable-length values.
+    std::size_t size() const { return offsets_m.size() - 1; }
 
-    /// Returns the parent group.
-    Group parent() const { return Group(path->parent); }
+    /// Returns true when there are no variable-length values.
+    bool empty() const { return offsets_m.size() == 1; }
 
-    /// Renames the variable in place.
-    void rename(std::string name) {
-        check(nc_rename_var(path->parent->id, path->id, name.c_str()));
-        path->name = std::move(name);
+    /// Returns the number of elements of value `i`.
+    std::size_t length(std::size_t i) const { return offsets_m[i + 1] - offsets_m[i]; }
+
+    /// Returns a pointer to the first element of value `i`.
+    const T* begin(std::size_t i) const { return detail::data_or_null(values_m) + offsets_m[i]; }
+
+    /// Returns a pointer past the last element of value `i`.
+    const T* end(std::size_t i) const { return detail::data_or_null(values_m) + offsets_m[i + 1]; }
+
+    /// Returns the elements of all values.
+    const std::vector<T>& values() const { return values_m; }
+
+    /// Returns the `size() + 1` offsets of the values into values().
+    const std::vector<std::size_t>& offsets() const { return offsets_m; }
+
+    /// Appends a value with `len` elements.
+    void push_back(const T* v, std::size_t len) {
+        values_m.insert(std::end(values_m), v, v + len);
+        offsets_m.push_back(values_m.size());
     }
 
-    /// Returns the current size of each dimension.
-    std::vector<std::size_t> sizes() const {
-        std::vector<std::size_t> res;
-        const auto dims = dimension_ids();
-        res.reserve(dims.size());
-        std::transform(std::begin(dims), std::end(dims), std::back_inserter(res), [this](int id) {
-            std::size_t tmp;
-            check(nc_inq_dimlen(path->parent->id, id, &tmp));
-            return tmp;
-        });
-        return res;
+    /// Appends a value.
+    void push_back(const std::vector<T>& v) { push_back(detail::data_or_null(v), v.size()); }
+
+    /// Removes all values.
+    void clear() {
+        values_m.clear();
+        offsets_m.assign(1, 0);
     }
+};
 
-    /// Returns the total number of elements.
-    std::size_t size() const {
-        std::size_t res = 1;
-        std::size_t tmp;
-        for (const auto id : dimension_ids()) {
-            check(nc_inq_dimlen(path->parent->id, id, &tmp));
-            res *= tmp;
+/// Values of a NetCDF type known only at runtime, e.g. from Variable::read_any().
+///
+/// The array stores the type id, the element size, and the values in the
+/// memory layout of NetCDF-C, so reading needs no conversion and no code per
+/// type. Typed views share the memory. Strings and variable-length values
+/// allocated by NetCDF-C are released with the array, but not those nested
+/// in compound values.
+class AnyArray final {
+    friend class Variable;
+
+  private:
+    nc_type type_m = NC_NAT;
+    int type_class_m = NC_NAT;
+    std::size_t element_size_m = 0;
+    std::size_t size_m = 0;
+    std::vector<std::max_align_t> storage;
+    bool owns_allocations = false;  // holds strings or vlens allocated by NetCDF-C
+    int ncid_m = -1;                // group the values were read from, for comparing user-defined types
+
+    void release() {
+        if (owns_allocations && size_m > 0) {
+            if (type_class_m == NC_STRING) {
+                nc_free_string(size_m, static_cast<char**>(data()));
+            } else if (type_class_m == NC_VLEN) {
+                nc_free_vlens(size_m, static_cast<nc_vlen_t*>(data()));
+            }
         }
-        return res;
+        owns_allocations = false;
     }
 
-    template<int N>
-    /// Returns the number of elements selected by a hyperslab count.
-    std::size_t size(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
-        return size(&start[0], &count[0]);
-    }
+    template<typename Function, typename R>
+    struct Dispatch {
+        const AnyArray& array;
+        Function& f;
 
-    /// Returns this variable or throws if its total element count differs.
-    Variable require_size(std::size_t size_p) const {
-        if (size_p != size()) {
-            throw Exception(NC_EVARMETA, "Unexpected variable size: " + path->get_full_path());
+        template<typename T>
+        R operator()(const T&) const {
+            return f(array.view<T>());
+        }
+    };
+
+  public:
+    template<typename T>
+    /// Zero-copy typed view of the values of an AnyArray.
+    class View final {
+      private:
+        T* data_m;
+        std::size_t size_m;
+
+      public:
+        View(T* data, std::size_t size) : data_m(data), size_m(size) {}
+        T* data() const { return data_m; }
+        std::size_t size() const { return size_m; }
+        T* begin() const { return data_m; }
+        T* end() const { return data_m + size_m; }
+        T& operator[](std::size_t i) const { return data_m[i]; }
+    };
+
+    AnyArray() = default;
+
+    /// Creates zero-initialized storage for `size` values of type `type`,
+    /// with its size in bytes and its class, e.g. NC_COMPOUND, or the type
+    /// itself for atomic types.
+    AnyArray(nc_type type, std::size_t element_size, std::size_t size, int type_class)
+        : type_m(type),
+          type_class_m(type_class),
+          element_size_m(element_size),
+          size_m(size),
+          storage((element_size * size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t)) {}
+
+    AnyArray(const AnyArray&) = delete;
+    AnyArray& operator=(const AnyArray&) = delete;
+
+    AnyArray(AnyArray&& other) noexcept
+        : type_m(other.type_m),
+          type_class_m(other.type_class_m),
+          element_size_m(other.element_size_m),
+          size_m(other.size_m),
+          storage(std::move(other.storage)),
+          owns_allocations(other.owns_allocations),
+          ncid_m(other.ncid_m) {
+        other.size_m = 0;
+        other.owns_allocations = false;
+    }
+
+    AnyArray& operator=(AnyArray&& other) noexcept {
+        if (this != &other) {
+            release();
+            type_m = other.type_m;
+            type_class_m = other.type_class_m;
+            element_size_m = other.element_size_m;
+            size_m = other.size_m;
+            storage = std::move(other.storage);
+            owns_allocations = other.owns_allocations;
+            ncid_m = other.ncid_m;
+            other.size_m = 0;
+            other.owns_allocations = false;
         }
         return *this;
     }
 
+    ~AnyArray() { release(); }
+
+    /// Returns the NetCDF type id, only valid in the file the values were read from for user-defined types.
+    nc_type type() const { return type_m; }
+
+    /// Returns the NetCDF type class, e.g. NC_COMPOUND, or the type itself for atomic types.
+    int type_class() const { return type_class_m; }
+
+    /// Returns the size of one value in bytes.
+    std::size_t element_size() const { return element_size_m; }
+
+    /// Returns the number of values.
+    std::size_t size() const { return size_m; }
+
+    /// Returns the values as stored by NetCDF-C.
+    void* data() { return detail::data_or_null(storage); }
+
+    /// Returns the values as stored by NetCDF-C.
+    const void* data() const { return detail::data_or_null(storage); }
+
     template<typename T>
-    /// Reads the whole variable as a vector.
-    std::vector<T> get() const {
-        std::vector<T> res(size());
-        if (res.empty()) {
-            return res;
+    /// Returns true if the values can be viewed as `T`: the matching atomic
+    /// type, or any user-defined type of the same size.
+    bool is() const {
+        if (detail::is_user_type(type_m)) {
+            return !Type<T>::is_atomic && sizeof(T) == element_size_m;
         }
-        read(detail::data_or_null(res));
-        return res;
+        return Type<T>::is_atomic && detail::TypeId<T>::id == type_m;
     }
+
     template<typename T>
-    /// Reads one element by raw NetCDF index pointer.
-    T get(const std::size_t* index) const {
-        T res;
-        read(&res, index);
-        return res;
+    /// Returns a typed view of the values without copying them.
+    ///
+    /// @throws Exception if the values cannot be viewed as `T`, see is().
+    View<T> view() {
+        if (!is<T>()) {
+            throw Exception(NC_EBADTYPE, "Unexpected type");
+        }
+        return View<T>(static_cast<T*>(data()), size_m);
     }
+
     template<typename T>
-    /// Reads a hyperslab by raw NetCDF start/count pointers.
-    std::vector<T> get(const std::size_t* start, const std::size_t* count) const {
-        std::vector<T> res(size(start, count));
-        if (res.empty()) {
-            return res;
+    /// Returns a typed view of the values without copying them.
+    ///
+    /// @throws Exception if the values cannot be viewed as `T`, see is().
+    View<const T> view() const {
+        if (!is<T>()) {
+            throw Exception(NC_EBADTYPE, "Unexpected type");
         }
-        read(detail::data_or_null(res), start, count);
-        return res;
+        return View<const T>(static_cast<const T*>(data()), size_m);
+    }
+
+    template<typename R, typename Function>
+    /// Calls `f` once with a View<const T> of the values, with `T` the C++ type matching the atomic type.
+    ///
+    /// @throws std::runtime_error for user-defined types.
+    R visit(Function&& f) const {
+        return for_type<R>(type_m, Dispatch<Function, R>{*this, f});
     }
+};
+
+/// NetCDF variable.
+class Variable final : public detail::Object {
+    friend class ChunkAdvisor;
+    friend class DirectChunkIO;
+    friend class Group;
     template<typename T>
-    /// Reads a strided hyperslab by raw NetCDF pointers.
-    std::vector<T> get(const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) const {
-        std::vector<T> res(size(start, count));
-        if (res.empty()) {
-            return res;
+    friend class LazyVariable;
+    friend class Maybe<Variable>;
+    friend class ProcessReader;
+    friend class RaggedArray;
+    friend class Rechunker;
+
+  private:
+    explicit Variable(std::shared_ptr<detail::Path> path_p) : detail::Object(std::move(path_p)) {}
+
+    // conversions NetCDF-C would do element by element are done in bulk
+    // here, except for small reads and text or byte to unsigned byte, which
+    // NetCDF-C treats specially
+    // number of values in a hyperslab, 0 if the variable cannot be queried
+    // number of values of the variable, without checked calls as it is used for instrumentation
+    std::size_t value_count() const noexcept {
+        int ndims;
+        int dimids[NC_MAX_VAR_DIMS];
+        if (nc_inq_varndims(path->parent->id, path->id, &ndims) != NC_NOERR || nc_inq_vardimid(path->parent->id, path->id, dimids) != NC_NOERR) {
+            return 0;
+        }
+        std::size_t res = 1;
+        for (int d = 0; d < ndims; ++d) {
+            std::size_t len;
+            if (nc_inq_dimlen(path->parent->id, dimids[d], &len) != NC_NOERR) {
+                return 0;
+            }
+            res *= len;
         }
-        read(detail::data_or_null(res), start, count, stride);
         return res;
     }
 
-    template<typename T, int N>
-    /// Reads one element by fixed-rank index.
-    T get(const std::array<std::size_t, N>& index) const {
-        return get<T>(&index[0]);
+    std::size_t value_count(const std::size_t* count) const noexcept {
+        int ndims;
+        if (nc_inq_varndims(path->parent->id, path->id, &ndims) != NC_NOERR) {
+            return 0;
+        }
+        std::size_t res = 1;
+        for (int d = 0; d < ndims; ++d) {
+            res *= count[d];
+        }
+        return res;
     }
-    template<typename T, int N>
-    /// Reads a fixed-rank hyperslab.
-    std::vector<T> get(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
-        return get<T>(&start[0], &count[0]);
+
+    template<typename U, typename T>
+    bool convertible(const std::size_t* count, std::size_t& n) const {
+        const bool same = std::is_same<U, T>::value || (std::is_integral<T>::value && sizeof(T) == sizeof(U) && std::is_signed<T>::value == std::is_signed<U>::value);
+        if (same || std::is_same<T, char>::value || (sizeof(T) == 1 && sizeof(U) == 1)) {
+            return false;
+        }
+        n = count ? value_count(count) : size();
+        return n >= 64;
+    }
+
+    // calls `f(start, count, offset, n)` for blocks of the hyperslab (the whole
+    // variable if `count` is null) that are contiguous in memory; for
+    // contiguous storage they stay small enough for the cache, chunked
+    // variables are done in one block so that no chunk is decompressed twice
+    template<typename Function>
+    void for_conversion_blocks(const std::size_t* start_p, const std::size_t* count_p, Function&& f) const {
+        const auto ndims = dimension_count();
+        std::vector<std::size_t> start(ndims, 0);
+        std::vector<std::size_t> count;
+        if (count_p) {
+            start.assign(start_p, start_p + ndims);
+            count.assign(count_p, count_p + ndims);
+        } else {
+            count = sizes();
+        }
+        const std::size_t limit = get_chunking().empty() ? 1 << 16 : static_cast<std::size_t>(-1);
+        // dimensions from d on are done whole, dimension d - 1 in runs of `rows`
+        auto d = ndims;
+        std::size_t inner = 1;
+        while (d > 0 && inner * count[d - 1] <= limit) {
+            inner *= count[--d];
+        }
+        if (d == 0) {
+            f(start, count, 0, inner);
+            return;
+        }
+        const auto rows = std::max<std::size_t>(1, limit / inner);
+        auto block_start = start;
+        auto block_count = count;
+        std::fill(std::begin(block_count), std::begin(block_count) + static_cast<std::ptrdiff_t>(d - 1), 1);
+        std::size_t offset = 0;
+        while (true) {
+            block_count[d - 1] = std::min(rows, start[d - 1] + count[d - 1] - block_start[d - 1]);
+            const auto n = block_count[d - 1] * inner;
+            f(block_start, block_count, offset, n);
+            offset += n;
+            block_start[d - 1] += block_count[d - 1];
+            if (block_start[d - 1] < start[d - 1] + count[d - 1]) {
+                continue;
+            }
+            block_start[d - 1] = start[d - 1];
+            auto i = d - 1;
+            while (true) {
+                if (i == 0) {
+                    return;
+                }
+                --i;
+                if (++block_start[i] < start[i] + count[i]) {
+                    break;
+                }
+                block_start[i] = start[i];
+            }
+        }
     }
-    template<typename T, int N>
-    /// Reads a fixed-rank strided hyperslab.
-    std::vector<T> get(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) const {
-        return get<T>(&start[0], &count[0], &stride[0]);
+
+    template<typename U, typename T>
+    bool read_as(T* v, const std::size_t* start, const std::size_t* count) const {
+        std::size_t n;
+        if (!convertible<U, T>(count, n)) {
+            return false;
+        }
+        std::vector<U> buf;
+        bool in_range = true;
+        for_conversion_blocks(start, count, [&](const std::vector<std::size_t>& s, const std::vector<std::size_t>& c, std::size_t offset, std::size_t len) {
+            buf.resize(len);
+            check(nc_get_vara(path->parent->id, path->id, detail::data_or_null(s), detail::data_or_null(c), detail::data_or_null(buf)));
+            if (!detail::convert(detail::data_or_null(buf), v + offset, len)) {
+                // out-of-range values as NetCDF-C returns them for this file format, e.g. the fill value for classic formats
+                const auto ret = detail::get_vara(path->parent->id, path->id, detail::data_or_null(s), detail::data_or_null(c), v + offset);
+                // NetCDF-C does not report all of them, e.g. NaN converted to integers
+                if (ret == NC_ERANGE) {
+                    in_range = false;
+                } else {
+                    check(ret);
+                }
+            }
+        });
+        if (!in_range) {
+            raise_error(NC_ERANGE);  // like NetCDF-C, after converting the others
+        }
+        return true;
+    }
+
+    template<typename U, typename T>
+    bool write_as(const T* v, const std::size_t* start, const std::size_t* count) {
+        std::size_t n;
+        if (!convertible<U, T>(count, n)) {
+            return false;
+        }
+        std::vector<U> buf;
+        bool in_range = true;
+        for_conversion_blocks(start, count, [&](const std::vector<std::size_t>& s, const std::vector<std::size_t>& c, std::size_t offset, std::size_t len) {
+            buf.resize(len);
+            if (detail::convert(v + offset, detail::data_or_null(buf), len)) {
+                check(nc_put_vara(path->parent->id, path->id, detail::data_or_null(s), detail::data_or_null(c), detail::data_or_null(buf)));
+            } else {
+                // out-of-range values as NetCDF-C stores them for this file format, e.g. the fill value for classic formats
+                const auto ret = detail::put_vara(path->parent->id, path->id, detail::data_or_null(s), detail::data_or_null(c), v + offset);
+                // NetCDF-C does not report all of them, e.g. NaN converted to integers
+                if (ret == NC_ERANGE) {
+                    in_range = false;
+                } else {
+                    check(ret);
+                }
+            }
+        });
+        if (!in_range) {
+            raise_error(NC_ERANGE);  // like NetCDF-C, after writing the others
+        }
+        return true;
     }
 
+    // reads the whole variable if `count` is null, returns false if NetCDF-C should convert
     template<typename T>
-    /// Reads the whole variable into caller-provided storage.
-    void read(T* v) const {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_get_var(path->parent->id, path->id, v));
+    bool read_converted(T* v, const std::size_t* start, const std::size_t* count) const {
+        switch (type()) {
+            case NC_BYTE:
+                return read_as<std::int8_t>(v, start, count);
+            case NC_UBYTE:
+                return read_as<std::uint8_t>(v, start, count);
+            case NC_SHORT:
+                return read_as<std::int16_t>(v, start, count);
+            case NC_USHORT:
+                return read_as<std::uint16_t>(v, start, count);
+            case NC_INT:
+                return read_as<std::int32_t>(v, start, count);
+            case NC_UINT:
+                return read_as<std::uint32_t>(v, start, count);
+            case NC_INT64:
+                return read_as<std::int64_t>(v, start, count);
+            case NC_UINT64:
+                return read_as<std::uint64_t>(v, start, count);
+            case NC_FLOAT:
+                return read_as<float>(v, start, count);
+            case NC_DOUBLE:
+                return read_as<double>(v, start, count);
+            default:
+                return false;
+        }
+    }
+
+    // writes the whole variable if `count` is null, returns false if NetCDF-C should convert
+    template<typename T>
+    bool write_converted(const T* v, const std::size_t* start, const std::size_t* count) {
+        switch (type()) {
+            case NC_BYTE:
+                return write_as<std::int8_t>(v, start, count);
+            case NC_UBYTE:
+                return write_as<std::uint8_t>(v, start, count);
+            case NC_SHORT:
+                return write_as<std::int16_t>(v, start, count);
+            case NC_USHORT:
+                return write_as<std::uint16_t>(v, start, count);
+            case NC_INT:
+                return write_as<std::int32_t>(v, start, count);
+            case NC_UINT:
+                return write_as<std::uint32_t>(v, start, count);
+            case NC_INT64:
+                return write_as<std::int64_t>(v, start, count);
+            case NC_UINT64:
+                return write_as<std::uint64_t>(v, start, count);
+            case NC_FLOAT:
+                return write_as<float>(v, start, count);
+            case NC_DOUBLE:
+                return write_as<double>(v, start, count);
+            default:
+                return false;
+        }
+    }
+
+    std::vector<int> dimension_ids() const {
+        const auto count = dimension_count();
+        if (count == 0) {
+            return {};
+        }
+        std::vector<int> ids(count);
+        check(nc_inq_vardimid(path->parent->id, path->id, detail::data_or_null(ids)));
+        return ids;
+    }
+
+    static std::string type_name(int ncid_p, nc_type type_p) {
+        char name[NC_MAX_NAME + 1];
+        if (nc_inq_type(ncid_p, type_p, name, nullptr) != NC_NOERR) {
+            return "";
+        }
+        return name;
+    }
+
+    static bool same_type_for_copy(int this_ncid, nc_type this_type, int oth_ncid, nc_type oth_type) {
+        const auto this_is_user = detail::is_user_type(this_type);
+        const auto oth_is_user = detail::is_user_type(oth_type);
+        if (this_is_user != oth_is_user) {
+            return false;
+        }
+        if (!this_is_user) {
+            return this_type == oth_type;
+        }
+        return type_name(this_ncid, this_type) == type_name(oth_ncid, oth_type);
+    }
+
+    // true if values of both types, possibly in different files, have the same memory layout
+    static bool same_layout(int this_ncid, nc_type this_type, int oth_ncid, nc_type oth_type) {
+        if (!detail::is_user_type(this_type) || !detail::is_user_type(oth_type)) {
+            return this_type == oth_type;
+        }
+        std::size_t this_size, oth_size, this_count, oth_count;
+        nc_type this_base, oth_base;
+        int this_class, oth_class;
+        if (nc_inq_user_type(this_ncid, this_type, nullptr, &this_size, &this_base, &this_count, &this_class) != NC_NOERR
+            || nc_inq_user_type(oth_ncid, oth_type, nullptr, &oth_size, &oth_base, &oth_count, &oth_class) != NC_NOERR || this_class != oth_class
+            || this_size != oth_size || this_count != oth_count) {
+            return false;
+        }
+        switch (this_class) {
+            case NC_VLEN:
+                return same_layout(this_ncid, this_base, oth_ncid, oth_base);
+            case NC_ENUM:
+                return this_base == oth_base;
+            case NC_COMPOUND:
+                for (int i = 0; i < static_cast<int>(this_count); ++i) {
+                    char this_name[NC_MAX_NAME + 1];
+                    char oth_name[NC_MAX_NAME + 1];
+                    std::size_t this_offset, oth_offset;
+                    nc_type this_field, oth_field;
+                    int this_dims, oth_dims;
+                    if (nc_inq_compound_field(this_ncid, this_type, i, this_name, &this_offset, &this_field, &this_dims, nullptr) != NC_NOERR
+                        || nc_inq_compound_field(oth_ncid, oth_type, i, oth_name, &oth_offset, &oth_field, &oth_dims, nullptr) != NC_NOERR
+                        || std::strcmp(this_name, oth_name) != 0 || this_offset != oth_offset || this_dims != oth_dims
+                        || !same_layout(this_ncid, this_field, oth_ncid, oth_field)) {
+                        return false;
+                    }
+                    std::vector<int> this_sizes(this_dims);
+                    std::vector<int> oth_sizes(oth_dims);
+                    if (nc_inq_compound_fielddim_sizes(this_ncid, this_type, i, detail::data_or_null(this_sizes)) != NC_NOERR
+                        || nc_inq_compound_fielddim_sizes(oth_ncid, oth_type, i, detail::data_or_null(oth_sizes)) != NC_NOERR || this_sizes != oth_sizes) {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                return true;  // opaque types of the same size
+        }
+    }
+
+    // type ids are only unique within a file, so the name and size have to match as well
+    void check_columns(const CompoundColumns& columns) const {
+        std::size_t bytes;
+        char name[NC_MAX_NAME + 1];
+        check(nc_inq_type(path->parent->id, type(), name, &bytes));
+        if (type() != columns.type_id || name != columns.type_name || bytes != columns.record_size) {
+            throw Exception(NC_EBADTYPE, "Unexpected compound type for columns: " + path->get_full_path());
+        }
+    }
+
+    std::size_t size(const std::size_t* /* start */, const std::size_t* count) const {
+        int dims_count;
+        check(nc_inq_varndims(path->parent->id, path->id, &dims_count));
+
+        std::size_t res = 1;
+        for (int i = 0; i < dims_count; ++i) {
+            res *= count[i];
+        }
+        return res;
+    }
+
+  public:
+    /// Defines an attribute handle. The attribute is created when a value is written.
+    Attribute add_attribute(std::string name) { return Attribute(child_path(detail::PathKind::attribute, name.c_str(), -1)); }
+
+    /// Copies an attribute onto this variable.
+    Attribute add_attribute(const Attribute& a) {
+        auto res = add_attribute(a.name());
+        res.copy_values(a);
+        return res;
+    }
+
+    /// Looks up a variable attribute by name.
+    Maybe<Attribute> attribute(std::string name) const {
+        int id = -1;
+        const auto ret = nc_inq_attid(path->parent->id, path->id, name.c_str(), &id);
+        if (ret != NC_ENOTATT) {
+            check(ret);
+        }
+        return Maybe<Attribute>(child_path(detail::PathKind::attribute, name.c_str(), id));
+    }
+
+    /// Returns all variable attributes.
+    std::vector<Attribute> attributes() const {
+        int count;
+        check(nc_inq_varnatts(path->parent->id, path->id, &count));
+        std::vector<Attribute> res;
+        res.reserve(count);
+        char name[NC_MAX_NAME + 1];
+        for (int id = 0; id < count; ++id) {
+            check(nc_inq_attname(path->parent->id, path->id, id, name));
+            res.emplace_back(Attribute(child_path(detail::PathKind::attribute, name, id)));
+        }
+        return res;
+    }
+
+    /// Returns true when the variable dimensions match the supplied names exactly.
+    bool check_dimensions(const std::vector<std::string>& names) const {
+        const auto& dims = dimensions();
+        if (dims.size() != names.size()) {
+            return false;
+        }
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            if (dims[i].name() != names[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// Returns this variable or throws if its dimensions do not match.
+    Variable require_dimensions(const std::vector<std::string>& names) const {
+        if (!check_dimensions(names)) {
+            throw Exception(NC_EVARMETA, "Unexpected dimensions: " + path->get_full_path());
+        }
+        return *this;
+    }
+
+    /// Copies all attributes from another variable.
+    void copy_attributes(const Variable& v) {
+        for (const auto& it : v.attributes()) {
+            add_attribute(it);
+        }
+    }
+
+    /// Copies raw values from another variable after checking shape and type size.
+    void copy_values(const Variable& v) {
+        const auto this_type = type();
+        const auto oth_type = v.type();
+        if (!same_type_for_copy(path->parent->id, this_type, v.path->parent->id, oth_type)) {
+            throw Exception(NC_EVARMETA, "Variable types do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+        }
+
+        std::size_t this_type_len;
+        check(nc_inq_type(path->parent->id, this_type, nullptr, &this_type_len));
+        std::size_t oth_type_len;
+        check(nc_inq_type(v.path->parent->id, oth_type, nullptr, &oth_type_len));
+
+        if (this_type_len != oth_type_len) {
+            throw Exception(NC_EVARMETA, "Variable type sizes do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+        }
+
+        const auto this_sizes = sizes();
+        const auto oth_sizes = v.sizes();
+        if (this_sizes.size() != oth_sizes.size()) {
+            throw Exception(NC_EVARMETA, "Variable dimension counts do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+        }
+        for (std::size_t i = 0; i < oth_sizes.size(); ++i) {
+            if (this_sizes[i] != 0  // not unlimited dimension or already written to
+                && this_sizes[i] != oth_sizes[i]) {
+                throw Exception(NC_EVARMETA, "Variable sizes do not match: " + path->get_full_path() + " and " + v.path->get_full_path());
+            }
+        }
+
+        std::vector<std::size_t> index(this_sizes.size(), 0);
+
+        std::vector<char> buf(this_type_len * v.size());
+        NETCDFPP_INSTRUMENT_IO(copy, *path, buf.size());
+        v.data_mode();
+        data_mode();
+        if (this_sizes.empty()) {
+            check(nc_get_var(v.path->parent->id, v.path->id, detail::data_or_null(buf)));
+            check(nc_put_var(path->parent->id, path->id, detail::data_or_null(buf)));
+        } else {
+            check(nc_get_vara(v.path->parent->id, v.path->id, detail::data_or_null(index), detail::data_or_null(oth_sizes), detail::data_or_null(buf)));
+            check(nc_put_vara(path->parent->id, path->id, detail::data_or_null(index), detail::data_or_null(oth_sizes), detail::data_or_null(buf)));
+        }
+    }
+
+    /// Returns the number of dimensions.
+    std::size_t dimension_count() const {
+        int count;
+        check(nc_inq_varndims(path->parent->id, path->id, &count));
+        return count;
+    }
+
+    /// Returns the variable dimensions.
+    std::vector<Dimension> dimensions() const {
+        const auto ids = dimension_ids();
+        char name[NC_MAX_NAME + 1];
+        std::vector<Dimension> res;
+        res.reserve(ids.size());
+        std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
+            check(nc_inq_dimname(path->parent->id, id, name));
+            return Dimension(detail::make_path(path, path->parent, detail::PathKind::dimension, name, id));
+        });
+        return res;
+    }
+
+    /// Returns chunk sizes, or an empty vector for contiguous storage.
+    std::vector<std::size_t> get_chunking() const {
+        int mode;
+        std::vector<std::size_t> res(dimension_count());
+        check(nc_inq_var_chunking(path->parent->id, path->id, &mode, detail::data_or_null(res)));
+        if (mode == NC_CONTIGUOUS) {
+            res.clear();
+        }
+        return res;
+    }
+
+    /// Sets chunked storage, or contiguous storage when chunks is empty.
+    void set_chunking(const std::vector<std::size_t>& chunks) {
+        if (chunks.empty()) {
+            define_mode();
+            check(nc_def_var_chunking(path->parent->id, path->id, NC_CONTIGUOUS, nullptr));
+        } else {
+            define_mode();
+            check(nc_def_var_chunking(path->parent->id, path->id, NC_CHUNKED, detail::data_or_null(chunks)));
+        }
+    }
+
+    /// Returns part `part` of `parts` hyperslabs that split the values along
+    /// the first dimension, e.g. one part per MPI rank.
+    ///
+    /// Parts differ in size by at most one chunk and their boundaries are
+    /// aligned to chunks, so no chunk is written by two parts. Trailing parts
+    /// can be empty.
+    Hyperslab partition(std::size_t part, std::size_t parts) const {
+        if (part >= parts) {
+            throw Exception(NC_EINVAL, "Part out of range: " + path->get_full_path());
+        }
+        auto count = sizes();
+        if (count.empty()) {
+            throw Exception(NC_EINVAL, "Cannot partition scalar variable: " + path->get_full_path());
+        }
+        const auto chunks = get_chunking();
+        return detail::partition(std::move(count), chunks.empty() ? 1 : chunks[0], part, parts);
+    }
+
+#ifdef NETCDFPP_WITH_MPI
+    /// Returns the part of the values for the calling rank of `comm`, see partition(std::size_t, std::size_t) const.
+    Hyperslab partition(MPI_Comm comm) const {
+        int rank;
+        int size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+        return partition(static_cast<std::size_t>(rank), static_cast<std::size_t>(size));
+    }
+
+    /// Sets collective (NC_COLLECTIVE) or independent (NC_INDEPENDENT) access
+    /// to the values in a file opened with File::open_parallel().
+    ///
+    /// With collective access, all ranks must take part in every read and
+    /// write, possibly with empty hyperslabs. Writes to variables with
+    /// filters have to be collective.
+    void set_parallel_access(int access) { check(nc_var_par_access(path->parent->id, path->id, access)); }
+#endif
+
+    /// Lets NetCDF choose default chunk sizes.
+    void set_default_chunking() {
+        define_mode();
+        check(nc_def_var_chunking(path->parent->id, path->id, NC_CHUNKED, nullptr));
+    }
+
+    /// Returns shuffle status and deflate level, or -1 when deflate is disabled.
+    std::pair<bool, int> get_compression() const {
+        int shuffle_filter;
+        int deflate_filter;
+        int deflate_level;
+        check(nc_inq_var_deflate(path->parent->id, path->id, &shuffle_filter, &deflate_filter, &deflate_level));
+        return std::make_pair(shuffle_filter, deflate_filter ? deflate_level : -1);
+    }
+
+    /// Sets shuffle and deflate compression.
+    void set_compression(bool shuffle_filter, int deflate_level) {
+        define_mode();
+        check(nc_def_var_deflate(path->parent->id, path->id, shuffle_filter, deflate_level < 0 ? 0 : 1, deflate_level));
+    }
+
+    /// Returns the szip options mask and pixels per block, or zeros when szip is disabled.
+    std::pair<int, int> get_szip_compression() const {
+        int options_mask;
+        int pixels_per_block;
+        check(nc_inq_var_szip(path->parent->id, path->id, &options_mask, &pixels_per_block));
+        return std::make_pair(options_mask, pixels_per_block);
+    }
+
+    /// Sets szip compression, e.g. with NC_SZIP_NN and 32 pixels per block.
+    void set_szip_compression(int options_mask, int pixels_per_block) {
+        define_mode();
+        check(nc_def_var_szip(path->parent->id, path->id, options_mask, pixels_per_block));
+    }
+
+#ifdef NETCDFPP_HAS_FILTERS
+    /// Returns the zstd level, or -1 when zstd is disabled.
+    int get_zstd_compression() const {
+        int has_filter;
+        int level;
+        check(nc_inq_var_zstandard(path->parent->id, path->id, &has_filter, &level));
+        return has_filter ? level : -1;
+    }
+
+    /// Sets zstd compression. Fails with NC_ENOFILTER if the zstd plugin is not available.
+    void set_zstd_compression(int level) {
+        define_mode();
+        check(nc_def_var_zstandard(path->parent->id, path->id, level));
+    }
+
+    /// Returns the bzip2 level, or -1 when bzip2 is disabled.
+    int get_bzip2_compression() const {
+        int has_filter;
+        int level;
+        check(nc_inq_var_bzip2(path->parent->id, path->id, &has_filter, &level));
+        return has_filter ? level : -1;
+    }
+
+    /// Sets bzip2 compression. Fails with NC_ENOFILTER if the bzip2 plugin is not available.
+    void set_bzip2_compression(int level) {
+        define_mode();
+        check(nc_def_var_bzip2(path->parent->id, path->id, level));
+    }
+
+    /// Returns the quantization mode (e.g. NC_QUANTIZE_BITROUND) and number of significant digits or bits.
+    std::pair<int, int> get_quantization() const {
+        int mode;
+        int nsd;
+        check(nc_inq_var_quantize(path->parent->id, path->id, &mode, &nsd));
+        return std::make_pair(mode, nsd);
+    }
+
+    /// Sets lossy quantization of float and double values before compression.
+    ///
+    /// `nsd` is the number of significant decimal digits for
+    /// NC_QUANTIZE_BITGROOM and NC_QUANTIZE_GRANULARBR, and the number of
+    /// significant bits for NC_QUANTIZE_BITROUND.
+    void set_quantization(int mode, int nsd) {
+        define_mode();
+        check(nc_def_var_quantize(path->parent->id, path->id, mode, nsd));
+    }
+
+    /// Returns all filters in the order they are applied when writing.
+    std::vector<Filter> get_filters() const {
+        std::size_t len;
+        check(nc_inq_var_filter_ids(path->parent->id, path->id, &len, nullptr));
+        std::vector<unsigned int> ids(len);
+        check(nc_inq_var_filter_ids(path->parent->id, path->id, &len, detail::data_or_null(ids)));
+        std::vector<Filter> res;
+        res.reserve(len);
+        for (const auto id : ids) {
+            std::size_t nparams;
+            check(nc_inq_var_filter_info(path->parent->id, path->id, id, &nparams, nullptr));
+            Filter filter{id, std::vector<unsigned int>(nparams)};
+            check(nc_inq_var_filter_info(path->parent->id, path->id, id, &nparams, detail::data_or_null(filter.params)));
+            res.emplace_back(std::move(filter));
+        }
+        return res;
+    }
+
+    /// Appends a filter by HDF5 filter id, e.g. a plugin without a dedicated setter.
+    void add_filter(unsigned int id, const std::vector<unsigned int>& params) {
+        define_mode();
+        check(nc_def_var_filter(path->parent->id, path->id, id, params.size(), detail::data_or_null(params)));
+    }
+#endif
+
+    /// Returns the NetCDF endianness setting.
+    int get_endianness() const {
+        int res;
+        check(nc_inq_var_endian(path->parent->id, path->id, &res));
+        return res;
+    }
+
+    /// Sets NC_ENDIAN_NATIVE, NC_ENDIAN_LITTLE, or NC_ENDIAN_BIG.
+    void set_endianness(int endianness) {
+        define_mode();
+        check(nc_def_var_endian(path->parent->id, path->id, endianness));
+    }
+
+    /// Returns true when Fletcher32 checksums are enabled.
+    bool get_checksum_enabled() const {
+        int res;
+        check(nc_inq_var_fletcher32(path->parent->id, path->id, &res));
+        return res == NC_FLETCHER32;
+    }
+
+    /// Enables or disables Fletcher32 checksums.
+    void set_checksum_enabled(bool v) {
+        define_mode();
+        check(nc_def_var_fletcher32(path->parent->id, path->id, v ? NC_FLETCHER32 : NC_NOCHECKSUM));
+    }
+
+    template<typename T>
+    /// Returns whether fill is enabled and the fill value.
+    std::pair<bool, T> get_fill() const {
+        int no_fill;
+        T res;
+        check(nc_inq_var_fill(path->parent->id, path->id, &no_fill, &res));
+        return std::make_pair(!no_fill, res);
+    }
+
+    template<typename T>
+    /// Enables fill and sets the fill value.
+    void set_fill(T v) {
+        define_mode();
+        check(nc_def_var_fill(path->parent->id, path->id, 0, &v));
+    }
+
+    /// Disables fill for this variable.
+    void unset_fill() {
+        define_mode();
+        check(nc_def_var_fill(path->parent->id, path->id, 1, nullptr));
+    }
+
+    /// Returns the parent group.
+    Group parent() const { return Group(parent_path()); }
+
+    /// Renames the variable in place.
+    void rename(std::string name) {
+        define_mode();
+        check(nc_rename_var(path->parent->id, path->id, name.c_str()));
+        path->name = std::move(name);
+    }
+
+    /// Returns the current size of each dimension.
+    std::vector<std::size_t> sizes() const {
+        std::vector<std::size_t> res;
+        const auto dims = dimension_ids();
+        res.reserve(dims.size());
+        std::transform(std::begin(dims), std::end(dims), std::back_inserter(res), [this](int id) {
+            std::size_t tmp;
+            check(nc_inq_dimlen(path->parent->id, id, &tmp));
+            return tmp;
+        });
+        return res;
+    }
+
+    /// Returns the total number of elements.
+    std::size_t size() const {
+        std::size_t res = 1;
+        std::size_t tmp;
+        for (const auto id : dimension_ids()) {
+            check(nc_inq_dimlen(path->parent->id, id, &tmp));
+            res *= tmp;
+        }
+        return res;
+    }
+
+    template<int N>
+    /// Returns the number of elements selected by a hyperslab count.
+    std::size_t size(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        return size(&start[0], &count[0]);
+    }
+
+    /// Returns this variable or throws if its total element count differs.
+    Variable require_size(std::size_t size_p) const {
+        if (size_p != size()) {
+            throw Exception(NC_EVARMETA, "Unexpected variable size: " + path->get_full_path());
+        }
+        return *this;
+    }
+
+    template<typename T>
+    /// Reads the whole variable as a vector.
+    std::vector<T> get() const {
+        std::vector<T> res(size());
+        if (res.empty()) {
+            return res;
+        }
+        read(detail::data_or_null(res));
+        return res;
+    }
+    template<typename T>
+    /// Reads one element by raw NetCDF index pointer.
+    T get(const std::size_t* index) const {
+        T res;
+        read(&res, index);
+        return res;
+    }
+    template<typename T>
+    /// Reads a hyperslab by raw NetCDF start/count pointers.
+    std::vector<T> get(const std::size_t* start, const std::size_t* count) const {
+        std::vector<T> res(size(start, count));
+        if (res.empty()) {
+            return res;
+        }
+        read(detail::data_or_null(res), start, count);
+        return res;
+    }
+    template<typename T>
+    /// Reads a strided hyperslab by raw NetCDF pointers.
+    std::vector<T> get(const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) const {
+        std::vector<T> res(size(start, count));
+        if (res.empty()) {
+            return res;
+        }
+        read(detail::data_or_null(res), start, count, stride);
+        return res;
+    }
+
+    template<typename T, int N>
+    /// Reads one element by fixed-rank index.
+    T get(const std::array<std::size_t, N>& index) const {
+        return get<T>(&index[0]);
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank hyperslab.
+    std::vector<T> get(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        return get<T>(&start[0], &count[0]);
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank strided hyperslab.
+    std::vector<T> get(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) const {
+        return get<T>(&start[0], &count[0], &stride[0]);
+    }
+
+    template<typename T>
+    /// Reads many hyperslabs with as few underlying reads as possible.
+    ///
+    /// Overlapping or adjacent hyperslabs, and for chunked variables
+    /// hyperslabs whose bounding box touches no additional chunks, are merged
+    /// into one read of at most `max_memory` bytes. The values of hyperslab
+    /// `i` are returned in element `i`.
+    std::vector<std::vector<T>> get_batch(const std::vector<Hyperslab>& slabs, std::size_t max_memory = 1 << 24) const {
+        std::vector<std::vector<T>> res(slabs.size());
+        std::vector<T*> out(slabs.size());
+        for (std::size_t i = 0; i < slabs.size(); ++i) {
+            res[i].resize(detail::product(slabs[i].count));
+            out[i] = detail::data_or_null(res[i]);
+        }
+        read_batch(slabs, out, max_memory);
+        return res;
+    }
+
+    template<typename T>
+    /// Reads many hyperslabs into caller-provided storage, see get_batch().
+    ///
+    /// The values of hyperslab `i` are written to `out[i]`.
+    void read_batch(const std::vector<Hyperslab>& slabs, const std::vector<T*>& out, std::size_t max_memory = 1 << 24) const {
+        static_assert(Type<T>::is_atomic && !std::is_same<char*, T>::value, "Batched reads only support fixed-size atomic types");
+        if (out.size() != slabs.size()) {
+            throw Exception(NC_EINVAL, "Output count does not match hyperslab count: " + path->get_full_path());
+        }
+        const auto ndims = dimension_count();
+        for (const auto& slab : slabs) {
+            if (slab.start.size() != ndims || slab.count.size() != ndims) {
+                throw Exception(NC_EINVALCOORDS, "Unexpected hyperslab rank: " + path->get_full_path());
+            }
+        }
+        std::vector<T> buf;
+        const std::vector<std::size_t> zeros(ndims, 0);
+        std::vector<std::size_t> offset(ndims);
+        for (const auto& cluster : detail::coalesce(slabs, get_chunking(), max_memory / sizeof(T))) {
+            const auto count = cluster.count();
+            if (cluster.members.size() == 1) {
+                read(out[cluster.members[0]], detail::data_or_null(cluster.start), detail::data_or_null(count));
+                continue;
+            }
+            buf.resize(detail::product(count));
+            read(detail::data_or_null(buf), detail::data_or_null(cluster.start), detail::data_or_null(count));
+            for (const auto m : cluster.members) {
+                const auto& slab = slabs[m];
+                for (std::size_t d = 0; d < ndims; ++d) {
+                    offset[d] = slab.start[d] - cluster.start[d];
+                }
+                detail::copy_box(reinterpret_cast<const char*>(detail::data_or_null(buf)), detail::data_or_null(count), detail::data_or_null(offset),
+                                 reinterpret_cast<char*>(out[m]), detail::data_or_null(slab.count), detail::data_or_null(zeros),
+                                 detail::data_or_null(slab.count), ndims, sizeof(T));
+            }
+        }
+    }
+
+    template<typename T>
+    /// Reads single elements at many scattered positions.
+    ///
+    /// `indices` holds one index per dimension for each point, one point
+    /// after the other (one ignored index per point for scalar variables).
+    /// Points are grouped by chunk, or for contiguous variables by tiles of
+    /// 65536 elements along the innermost dimension at equal outer indices,
+    /// and each group is read once as its bounding hyperslab instead of one
+    /// library call per point.
+    std::vector<T> get_points(const std::vector<std::size_t>& indices) const {
+        const auto ndims = std::max<std::size_t>(dimension_count(), 1);
+        if (indices.size() % ndims != 0) {
+            throw Exception(NC_EINVALCOORDS, "Unexpected number of point indices: " + path->get_full_path());
+        }
+        std::vector<T> res(indices.size() / ndims);
+        read_points(detail::data_or_null(res), detail::data_or_null(indices), res.size());
+        return res;
+    }
+
+    template<typename T>
+    /// Reads `n` single elements at scattered positions into caller-provided storage, see get_points().
+    void read_points(T* v, const std::size_t* indices, std::size_t n) const {
+        static_assert(Type<T>::is_atomic && !std::is_same<char*, T>::value, "Point reads only support fixed-size atomic types");
+        if (n == 0) {
+            return;
+        }
+        const auto ndims = dimension_count();
+        if (ndims == 0) {
+            T value;
+            read(&value);
+            std::fill(v, v + n, value);
+            return;
+        }
+        auto tile = get_chunking();
+        if (tile.empty()) {
+            tile.assign(ndims, 1);
+            tile[ndims - 1] = 1 << 16;
+        }
+        std::vector<std::size_t> order(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            order[i] = i;
+        }
+        std::sort(std::begin(order), std::end(order), [&](std::size_t a, std::size_t b) {
+            for (std::size_t d = 0; d < ndims; ++d) {
+                const auto ta = indices[a * ndims + d] / tile[d];
+                const auto tb = indices[b * ndims + d] / tile[d];
+                if (ta != tb) {
+                    return ta < tb;
+                }
+            }
+            return false;
+        });
+        std::vector<T> buf;
+        std::vector<std::size_t> start(ndims);
+        std::vector<std::size_t> count(ndims);
+        for (std::size_t first = 0; first < n;) {
+            const auto* key = indices + order[first] * ndims;
+            std::size_t last = first + 1;
+            for (; last < n; ++last) {
+                const auto* p = indices + order[last] * ndims;
+                std::size_t d = 0;
+                while (d < ndims && p[d] / tile[d] == key[d] / tile[d]) {
+                    ++d;
+                }
+                if (d < ndims) {
+                    break;
+                }
+            }
+            std::copy(key, key + ndims, std::begin(start));
+            std::copy(key, key + ndims, std::begin(count));
+            for (std::size_t k = first + 1; k < last; ++k) {
+                const auto* p = indices + order[k] * ndims;
+                for (std::size_t d = 0; d < ndims; ++d) {
+                    start[d] = std::min(start[d], p[d]);
+                    count[d] = std::max(count[d], p[d]);
+                }
+            }
+            for (std::size_t d = 0; d < ndims; ++d) {
+                count[d] = count[d] - start[d] + 1;
+            }
+            buf.resize(detail::product(count));
+            read(detail::data_or_null(buf), detail::data_or_null(start), detail::data_or_null(count));
+            for (std::size_t k = first; k < last; ++k) {
+                const auto* p = indices + order[k] * ndims;
+                std::size_t pos = 0;
+                for (std::size_t d = 0; d < ndims; ++d) {
+                    pos = pos * count[d] + (p[d] - start[d]);
+                }
+                v[order[k]] = buf[pos];
+            }
+            first = last;
+        }
+    }
+
+    /// Reads all values in the variable's own type, see AnyArray.
+    AnyArray read_any() const {
+        const auto count = sizes();
+        return read_any(std::vector<std::size_t>(count.size(), 0), count);
+    }
+
+    /// Reads a hyperslab in the variable's own type with one NetCDF-C call and no conversion, see AnyArray.
+    AnyArray read_any(const std::vector<std::size_t>& start, const std::vector<std::size_t>& count) const {
+        if (start.size() != dimension_count() || count.size() != start.size()) {
+            throw Exception(NC_EINVALCOORDS, "Unexpected hyperslab rank: " + path->get_full_path());
+        }
+        const auto t = type();
+        int type_class = t;
+        std::size_t element_size;
+        if (detail::is_user_type(t)) {
+            check(nc_inq_user_type(path->parent->id, t, nullptr, &element_size, nullptr, nullptr, &type_class));
+        } else {
+            check(nc_inq_type(path->parent->id, t, nullptr, &element_size));
+        }
+        AnyArray res(t, element_size, detail::product(count), type_class);
+        res.ncid_m = path->parent->id;
+        if (res.size() == 0) {
+            return res;
+        }
+        data_mode();
+        check(nc_get_vara(path->parent->id, path->id, detail::data_or_null(start), detail::data_or_null(count), res.data()));
+        res.owns_allocations = true;
+        return res;
+    }
+
+    /// Writes all values from an AnyArray, e.g. read from a variable of the same type in another file.
+    void write_any(const AnyArray& values) { write_any(values, std::vector<std::size_t>(dimension_count(), 0), sizes()); }
+
+    /// Writes a hyperslab from an AnyArray with one NetCDF-C call and no conversion.
+    ///
+    /// Atomic types have to match exactly. User-defined types, whose ids
+    /// differ between files, have to match in their layout: the base types of
+    /// variable-length and enum types, and the names, offsets, shapes, and
+    /// types of compound fields. This is checked against the file the values
+    /// were read from with read_any(), which has to be still open. Values of
+    /// user-defined types created otherwise are rejected.
+    void write_any(const AnyArray& values, const std::vector<std::size_t>& start, const std::vector<std::size_t>& count) {
+        if (start.size() != dimension_count() || count.size() != start.size()) {
+            throw Exception(NC_EINVALCOORDS, "Unexpected hyperslab rank: " + path->get_full_path());
+        }
+        if (detail::product(count) != values.size()) {
+            throw Exception(NC_EINVAL, "Unexpected number of values: " + path->get_full_path());
+        }
+        const auto t = type();
+        bool matches = t == values.type();
+        if (detail::is_user_type(t) && detail::is_user_type(values.type())) {
+            matches = values.ncid_m >= 0 && same_layout(path->parent->id, t, values.ncid_m, values.type());
+        }
+        if (!matches) {
+            throw Exception(NC_EBADTYPE, "Unexpected type: " + path->get_full_path());
+        }
+        if (values.size() == 0) {
+            return;
+        }
+        data_mode();
+        check(nc_put_vara(path->parent->id, path->id, detail::data_or_null(start), detail::data_or_null(count), values.data()));
+    }
+
+    template<typename T>
+    /// Reads the whole variable into caller-provided storage.
+    void read(T* v) const {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_get_var(path->parent->id, path->id, v));
     }
     template<typename T>
     /// Reads one element into caller-provided storage.
     void read(T* v, const std::size_t* index) const {
         static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
         check(nc_get_var1(path->parent->id, path->id, index, v));
     }
-    template<typename T>
-    /// Reads a hyperslab into caller-provided storage.
-    void read(T* v, const std::size_t* start, const std::size_t* count) const {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_get_vara(path->parent->id, path->id, start, count, v));
+    template<typename T>
+    /// Reads a hyperslab into caller-provided storage.
+    void read(T* v, const std::size_t* start, const std::size_t* count) const {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_get_vara(path->parent->id, path->id, start, count, v));
+    }
+    template<typename T>
+    /// Reads a strided hyperslab into caller-provided storage.
+    void read(T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) const {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_get_vars(path->parent->id, path->id, start, count, stride, v));
+    }
+    template<typename T>
+    /// Reads mapped data into caller-provided storage.
+    void read(T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) const {
+        static_assert(std::is_same<void, T>::value, "NetCDF supports mapped access only for atomic types");
+        data_mode();
+        check(nc_get_varm(path->parent->id, path->id, start, count, stride, imap, v));
+    }
+
+    template<typename T, int N>
+    /// Reads one fixed-rank element into caller-provided storage.
+    void read(T* v, const std::array<std::size_t, N>& index) const {
+        read(v, &index[0]);
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank hyperslab into caller-provided storage.
+    void read(T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        read(v, &start[0], &count[0]);
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank strided hyperslab into caller-provided storage.
+    void read(T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) const {
+        read(v, &start[0], &count[0], &stride[0]);
+    }
+    template<typename T, int N>
+    /// Reads fixed-rank mapped data into caller-provided storage.
+    void read(T* v,
+              const std::array<std::size_t, N>& start,
+              const std::array<std::size_t, N>& count,
+              const std::array<std::ptrdiff_t, N>& stride,
+              const std::array<std::ptrdiff_t, N>& imap) const {
+        read(v, &start[0], &count[0], &stride[0], &imap[0]);
+    }
+
+    template<typename T>
+    /// Writes the whole variable from a vector.
+    void set(const std::vector<T>& v) {
+        write(detail::data_or_null(v));
+    }
+    template<typename T>
+    /// Writes one value by raw NetCDF index pointer.
+    typename std::enable_if<Type<T>::is_atomic || std::is_same<const char*, T>::value || std::is_same<char*, T>::value, void>::type set(
+        T v, const std::size_t* index) {
+        write(&v, index);
+    }
+    template<typename T>
+    /// Writes one non-atomic value by raw NetCDF index pointer.
+    typename std::enable_if<!Type<T>::is_atomic && !std::is_same<const char*, T>::value && !std::is_same<char*, T>::value, void>::type set(
+        const T& v, const std::size_t* index) {
+        write(&v, index);
+    }
+    template<typename T>
+    /// Writes a hyperslab from a vector.
+    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count) {
+        write(detail::data_or_null(v), start, count);
+    }
+    template<typename T>
+    /// Writes a strided hyperslab from a vector.
+    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {
+        write(detail::data_or_null(v), start, count, stride);
+    }
+    template<typename T>
+    /// Writes mapped data from a vector.
+    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) {
+        write(detail::data_or_null(v), start, count, stride, imap);
+    }
+
+    template<typename T, int N>
+    /// Writes one fixed-rank element.
+    void set(const T v, const std::array<std::size_t, N>& index) {
+        set(v, &index[0]);
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank hyperslab from a vector.
+    void set(const std::vector<T>& v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
+        set(v, &start[0], &count[0]);
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank strided hyperslab from a vector.
+    void set(const std::vector<T>& v,
+             const std::array<std::size_t, N>& start,
+             const std::array<std::size_t, N>& count,
+             const std::array<std::ptrdiff_t, N>& stride) {
+        set(v, &start[0], &count[0], &stride[0]);
+    }
+    template<typename T, int N>
+    /// Writes fixed-rank mapped data from a vector.
+    void set(const std::vector<T>& v,
+             const std::array<std::size_t, N>& start,
+             const std::array<std::size_t, N>& count,
+             const std::array<std::ptrdiff_t, N>& stride,
+             const std::array<std::ptrdiff_t, N>& imap) {
+        set(v, &start[0], &count[0], &stride[0], &imap[0]);
+    }
+
+    template<typename T>
+    /// Writes the whole variable from caller-provided storage.
+    void write(const T* v) {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_put_var(path->parent->id, path->id, v));
+    }
+    template<typename T>
+    /// Writes one element from caller-provided storage.
+    void write(const T* v, const std::size_t* index) {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_put_var1(path->parent->id, path->id, index, v));
+    }
+    template<typename T>
+    /// Writes a hyperslab from caller-provided storage.
+    void write(const T* v, const std::size_t* start, const std::size_t* count) {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_put_vara(path->parent->id, path->id, start, count, v));
+    }
+    template<typename T>
+    /// Writes a strided hyperslab from caller-provided storage.
+    void write(const T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        data_mode();
+        check(nc_put_vars(path->parent->id, path->id, start, count, stride, v));
+    }
+    template<typename T>
+    /// Writes mapped data from caller-provided storage.
+    void write(const T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) {
+        static_assert(std::is_same<void, T>::value, "NetCDF supports mapped access only for atomic types");
+        data_mode();
+        check(nc_put_varm(path->parent->id, path->id, start, count, stride, imap, v));
+    }
+
+    template<typename T>
+    /// Reads one element like read(), but returns the NetCDF-C return code instead of throwing.
+    int try_read(T* v, const std::size_t* index) const noexcept {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        auto ret = try_data_mode();
+        if (ret == NC_NOERR) {
+            ret = nc_get_var1(path->parent->id, path->id, index, v);
+        }
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);
+        return ret;
+    }
+    template<typename T>
+    /// Reads a hyperslab like read(), but returns the NetCDF-C return code instead of throwing.
+    ///
+    /// For callers handling errors inline, e.g. with nc_strerror(). Values of
+    /// another type than the stored one are converted by NetCDF-C.
+    int try_read(T* v, const std::size_t* start, const std::size_t* count) const noexcept {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        auto ret = try_data_mode();
+        if (ret == NC_NOERR) {
+            ret = nc_get_vara(path->parent->id, path->id, start, count, v);
+        }
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);
+        return ret;
+    }
+    template<typename T>
+    /// Writes one element like write(), but returns the NetCDF-C return code instead of throwing.
+    int try_write(const T* v, const std::size_t* index) noexcept {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        auto ret = try_data_mode();
+        if (ret == NC_NOERR) {
+            ret = nc_put_var1(path->parent->id, path->id, index, v);
+        }
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);
+        return ret;
+    }
+    template<typename T>
+    /// Writes a hyperslab like write(), but returns the NetCDF-C return code instead of throwing.
+    ///
+    /// Values of another type than the stored one are converted by NetCDF-C.
+    int try_write(const T* v, const std::size_t* start, const std::size_t* count) noexcept {
+        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
+        auto ret = try_data_mode();
+        if (ret == NC_NOERR) {
+            ret = nc_put_vara(path->parent->id, path->id, start, count, v);
+        }
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);
+        return ret;
+    }
+
+    template<typename T, int N>
+    /// Writes one fixed-rank element from caller-provided storage.
+    void write(const T* v, const std::array<std::size_t, N>& index) {
+        write(v, &index[0]);
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank hyperslab from caller-provided storage.
+    void write(const T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
+        write(v, &start[0], &count[0]);
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank strided hyperslab from caller-provided storage.
+    void write(const T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) {
+        write(v, &start[0], &count[0], &stride[0]);
+    }
+    template<typename T, int N>
+    /// Writes fixed-rank mapped data from caller-provided storage.
+    void write(const T* v,
+               const std::array<std::size_t, N>& start,
+               const std::array<std::size_t, N>& count,
+               const std::array<std::ptrdiff_t, N>& stride,
+               const std::array<std::ptrdiff_t, N>& imap) {
+        write(v, &start[0], &count[0], &stride[0], &imap[0]);
+    }
+
+    /// Returns the NetCDF type id of the variable.
+    nc_type type() const {
+        nc_type res;
+        check(nc_inq_vartype(path->parent->id, path->id, &res));
+        return res;
+    }
+
+    /// Returns the NetCDF type name of the variable.
+    std::string type_name() const {
+        char name[NC_MAX_NAME + 1];
+        check(nc_inq_type(path->parent->id, type(), name, nullptr));
+        return name;
+    }
+
+    /// Returns this variable or throws if its NetCDF type name differs.
+    Variable require_type(const std::string& name) const {
+        const auto name_l = type_name();
+        if (name_l != name) {
+            throw Exception(NC_EVARMETA, "Unexpected type '" + name_l + "': " + path->get_full_path());
+        }
+        return *this;
+    }
+
+    template<typename T>
+    /// Returns this variable or throws if its user-defined type is not a matching compound type.
+    Variable require_compound(std::size_t fieldscount) const {
+        const auto user_type_l = user_type().require();
+        if (user_type_l.typeclass() != NC_COMPOUND) {
+            throw Exception(NC_EVARMETA, "Type '" + user_type_l.name() + "' is not a compound: " + path->get_full_path());
+        }
+        if (user_type_l.bytes_size() != sizeof(T) || user_type_l.fieldscount() != fieldscount) {
+            throw Exception(NC_EVARMETA, "Unexpected size for type '" + user_type_l.name() + "': " + path->get_full_path());
+        }
+        return *this;
+    }
+
+    template<typename T>
+    /// Validates the compound type of this variable against the CompoundBinding of T.
+    CompoundPlan<T> compound_plan() const {
+        return CompoundPlan<T>(user_type().require());
+    }
+
+    template<typename T>
+    /// Reads the whole compound variable through a precomputed plan.
+    std::vector<T> get_compound(const CompoundPlan<T>& plan) const {
+        std::vector<T> res(size());
+        if (res.empty()) {
+            return res;
+        }
+        read_compound(detail::data_or_null(res), plan);
+        return res;
+    }
+    template<typename T>
+    /// Reads a compound hyperslab through a precomputed plan.
+    std::vector<T> get_compound(const CompoundPlan<T>& plan, const std::size_t* start, const std::size_t* count) const {
+        std::vector<T> res(size(start, count));
+        if (res.empty()) {
+            return res;
+        }
+        read_compound(detail::data_or_null(res), plan, start, count);
+        return res;
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank compound hyperslab through a precomputed plan.
+    std::vector<T> get_compound(const CompoundPlan<T>& plan, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        return get_compound(plan, &start[0], &count[0]);
+    }
+
+    template<typename T>
+    /// Reads the whole compound variable into caller-provided storage.
+    void read_compound(T* v, const CompoundPlan<T>& plan) const {
+        if (plan.is_direct()) {
+            data_mode();
+            check(nc_get_var(path->parent->id, path->id, v));
+            return;
+        }
+        const auto n = size();
+        std::vector<char> buf(n * plan.file_bytes_size());
+        data_mode();
+        check(nc_get_var(path->parent->id, path->id, detail::data_or_null(buf)));
+        plan.from_file(detail::data_or_null(buf), v, n);
+    }
+    template<typename T>
+    /// Reads a compound hyperslab into caller-provided storage.
+    void read_compound(T* v, const CompoundPlan<T>& plan, const std::size_t* start, const std::size_t* count) const {
+        if (plan.is_direct()) {
+            data_mode();
+            check(nc_get_vara(path->parent->id, path->id, start, count, v));
+            return;
+        }
+        const auto n = size(start, count);
+        std::vector<char> buf(n * plan.file_bytes_size());
+        data_mode();
+        check(nc_get_vara(path->parent->id, path->id, start, count, detail::data_or_null(buf)));
+        plan.from_file(detail::data_or_null(buf), v, n);
+    }
+
+    template<typename T>
+    /// Writes the whole compound variable through a precomputed plan.
+    void set_compound(const std::vector<T>& v, const CompoundPlan<T>& plan) {
+        write_compound(detail::data_or_null(v), plan);
+    }
+    template<typename T>
+    /// Writes a compound hyperslab through a precomputed plan.
+    void set_compound(const std::vector<T>& v, const CompoundPlan<T>& plan, const std::size_t* start, const std::size_t* count) {
+        write_compound(detail::data_or_null(v), plan, start, count);
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank compound hyperslab through a precomputed plan.
+    void set_compound(const std::vector<T>& v, const CompoundPlan<T>& plan, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
+        set_compound(v, plan, &start[0], &count[0]);
+    }
+
+    template<typename T>
+    /// Writes the whole compound variable from caller-provided storage.
+    void write_compound(const T* v, const CompoundPlan<T>& plan) {
+        if (plan.is_direct()) {
+            data_mode();
+            check(nc_put_var(path->parent->id, path->id, v));
+            return;
+        }
+        const auto n = size();
+        std::vector<char> buf(n * plan.file_bytes_size());
+        plan.to_file(v, detail::data_or_null(buf), n);
+        data_mode();
+        check(nc_put_var(path->parent->id, path->id, detail::data_or_null(buf)));
+    }
+    template<typename T>
+    /// Writes a compound hyperslab from caller-provided storage.
+    void write_compound(const T* v, const CompoundPlan<T>& plan, const std::size_t* start, const std::size_t* count) {
+        if (plan.is_direct()) {
+            data_mode();
+            check(nc_put_vara(path->parent->id, path->id, start, count, v));
+            return;
+        }
+        const auto n = size(start, count);
+        std::vector<char> buf(n * plan.file_bytes_size());
+        plan.to_file(v, detail::data_or_null(buf), n);
+        data_mode();
+        check(nc_put_vara(path->parent->id, path->id, start, count, detail::data_or_null(buf)));
+    }
+
+    /// Reads the whole compound variable into struct-of-arrays columns.
+    void read_columns(CompoundColumns& columns) const {
+        const auto sizes_l = sizes();
+        std::vector<std::size_t> start(sizes_l.size(), 0);
+        read_columns(columns, detail::data_or_null(start), detail::data_or_null(sizes_l));
+    }
+    /// Reads a compound hyperslab into struct-of-arrays columns.
+    void read_columns(CompoundColumns& columns, const std::size_t* start, const std::size_t* count) const {
+        check_columns(columns);
+        const auto n = size(start, count);
+        columns.resize(n);
+        if (n == 0) {
+            return;
+        }
+        data_mode();
+        check(nc_get_vara(path->parent->id, path->id, start, count, columns.prepare_staging(n)));
+        columns.scatter(n);
+    }
+    template<int N>
+    /// Reads a fixed-rank compound hyperslab into struct-of-arrays columns.
+    void read_columns(CompoundColumns& columns, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        read_columns(columns, &start[0], &count[0]);
+    }
+
+    /// Writes the whole compound variable from struct-of-arrays columns.
+    void write_columns(const CompoundColumns& columns) {
+        const auto sizes_l = sizes();
+        std::vector<std::size_t> start(sizes_l.size(), 0);
+        write_columns(columns, detail::data_or_null(start), detail::data_or_null(sizes_l));
+    }
+    /// Writes a compound hyperslab from struct-of-arrays columns.
+    void write_columns(const CompoundColumns& columns, const std::size_t* start, const std::size_t* count) {
+        check_columns(columns);
+        const auto n = size(start, count);
+        if (n != columns.size()) {
+            throw Exception(NC_EEDGE, "Column size does not match hyperslab: " + path->get_full_path());
+        }
+        if (n == 0) {
+            return;
+        }
+        columns.gather(n);
+        data_mode();
+        check(nc_put_vara(path->parent->id, path->id, start, count, detail::data_or_null(columns.staging)));
+    }
+    template<int N>
+    /// Writes a fixed-rank compound hyperslab from struct-of-arrays columns.
+    void write_columns(const CompoundColumns& columns, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
+        write_columns(columns, &start[0], &count[0]);
+    }
+
+    template<typename T>
+    /// Returns this variable or throws if its type is not a variable-length type of T.
+    Variable require_vlen() const {
+        const auto user_type_l = user_type().require();
+        if (user_type_l.typeclass() != NC_VLEN) {
+            throw Exception(NC_EVARMETA, "Type '" + user_type_l.name() + "' is not a vlen: " + path->get_full_path());
+        }
+        if (user_type_l.basetype() != Type<T>::id) {
+            throw Exception(NC_EVARMETA, "Unexpected base type for type '" + user_type_l.name() + "': " + path->get_full_path());
+        }
+        return *this;
+    }
+
+    template<typename T>
+    /// Reads the whole variable-length variable into a ragged array.
+    VLenArray<T> get_vlen() const {
+        VLenArray<T> res;
+        const auto sizes_l = sizes();
+        std::vector<std::size_t> start(sizes_l.size(), 0);
+        read_vlen(res, detail::data_or_null(start), detail::data_or_null(sizes_l));
+        return res;
+    }
+    template<typename T>
+    /// Reads a variable-length hyperslab into a ragged array.
+    VLenArray<T> get_vlen(const std::size_t* start, const std::size_t* count) const {
+        VLenArray<T> res;
+        read_vlen(res, start, count);
+        return res;
+    }
+    template<typename T, int N>
+    /// Reads a fixed-rank variable-length hyperslab into a ragged array.
+    VLenArray<T> get_vlen(const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
+        return get_vlen<T>(&start[0], &count[0]);
+    }
+
+    template<typename T>
+    /// Reads a variable-length hyperslab into a ragged array, reusing its storage.
+    void read_vlen(VLenArray<T>& v, const std::size_t* start, const std::size_t* count) const {
+        static_assert(Type<T>::is_atomic && !std::is_same<char*, T>::value, "Only variable-length types of fixed-size atomic types are supported");
+        require_vlen<T>();
+        v.clear();
+        const auto n = size(start, count);
+        if (n == 0) {
+            return;
+        }
+        detail::VLenBuffer buf(n);
+        data_mode();
+        check(nc_get_vara(path->parent->id, path->id, start, count, detail::data_or_null(buf.data)));
+        std::size_t total = 0;
+        for (const auto& it : buf.data) {
+            total += it.len;
+        }
+        v.offsets_m.reserve(n + 1);
+        v.values_m.resize(total);
+        std::size_t offset = 0;
+        for (const auto& it : buf.data) {
+            if (it.len > 0) {
+                std::memcpy(detail::data_or_null(v.values_m) + offset, it.p, it.len * sizeof(T));
+            }
+            offset += it.len;
+            v.offsets_m.push_back(offset);
+        }
+    }
+
+    template<typename T>
+    /// Writes the whole variable-length variable from a ragged array.
+    void set_vlen(const VLenArray<T>& v) {
+        const auto sizes_l = sizes();
+        std::vector<std::size_t> start(sizes_l.size(), 0);
+        set_vlen(v, detail::data_or_null(start), detail::data_or_null(sizes_l));
+    }
+    template<typename T>
+    /// Writes a variable-length hyperslab from a ragged array.
+    void set_vlen(const VLenArray<T>& v, const std::size_t* start, const std::size_t* count) {
+        static_assert(Type<T>::is_atomic && !std::is_same<char*, T>::value, "Only variable-length types of fixed-size atomic types are supported");
+        require_vlen<T>();
+        const auto n = size(start, count);
+        if (n != v.size()) {
+            throw Exception(NC_EEDGE, "Ragged array size does not match hyperslab: " + path->get_full_path());
+        }
+        if (n == 0) {
+            return;
+        }
+        std::vector<nc_vlen_t> buf(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            buf[i].len = v.length(i);
+            buf[i].p = const_cast<T*>(v.begin(i));
+        }
+        data_mode();
+        check(nc_put_vara(path->parent->id, path->id, start, count, detail::data_or_null(buf)));
+    }
+    template<typename T, int N>
+    /// Writes a fixed-rank variable-length hyperslab from a ragged array.
+    void set_vlen(const VLenArray<T>& v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
+        set_vlen(v, &start[0], &count[0]);
+    }
+
+    /// Returns the user-defined type for this variable, if it has one.
+    Maybe<UserType> user_type() const {
+        const auto id = type();
+        char name[NC_MAX_NAME + 1];
+        check(nc_inq_type(path->parent->id, id, name, nullptr));
+        if (!detail::is_user_type(id)) {
+            return Maybe<UserType>(detail::make_path(path, path->parent, detail::PathKind::type, (path->name + " not of user type").c_str(), -1));
+        }
+        return Maybe<UserType>(detail::make_path(path, path->parent, detail::PathKind::type, name, id));
+    }
+};
+
+/// Proposes chunk shapes for expected access patterns.
+///
+/// Each access pattern is the extent of a typical read, e.g. `{n_time, 1, 1}`
+/// for a full time series at one point or `{1, n_lat, n_lon}` for a full map
+/// at one time, with a weight for how often it occurs. An extent of 0 stands
+/// for the full dimension. The advisor searches for the chunk shape that
+/// minimizes the weighted expected number of chunks touched by a read at a
+/// random position while keeping chunks below a target size in bytes.
+class ChunkAdvisor final {
+  private:
+    struct Pattern {
+        std::vector<std::size_t> extent;
+        double weight;
+    };
+
+    std::vector<std::size_t> shape;
+    std::size_t element_size;
+    std::size_t target_bytes_m = 1 << 20;
+    std::vector<Pattern> patterns;
+
+  public:
+    /// Creates an advisor for a variable of the given shape and element size in bytes.
+    ChunkAdvisor(std::vector<std::size_t> shape_p, std::size_t element_size_p) : shape(std::move(shape_p)), element_size(element_size_p) {
+        for (auto& len : shape) {
+            len = std::max<std::size_t>(len, 1);  // e.g. empty unlimited dimensions
+        }
+    }
+
+    /// Creates an advisor for the current shape and element size of a variable.
+    explicit ChunkAdvisor(const Variable& v) : ChunkAdvisor(v.sizes(), 0) {
+        v.check(nc_inq_type(v.path->parent->id, v.type(), nullptr, &element_size));
+    }
+
+    /// Adds an expected access pattern, see ChunkAdvisor.
+    ChunkAdvisor& add_pattern(std::vector<std::size_t> extent, double weight = 1.0) {
+        if (extent.size() != shape.size()) {
+            throw Exception(NC_EINVALCOORDS, "Access pattern rank does not match");
+        }
+        for (std::size_t d = 0; d < shape.size(); ++d) {
+            extent[d] = extent[d] == 0 ? shape[d] : std::min(extent[d], shape[d]);
+        }
+        patterns.push_back(Pattern{std::move(extent), weight});
+        return *this;
+    }
+
+    /// Sets the maximal chunk size in bytes (default 1 MiB).
+    ChunkAdvisor& target_bytes(std::size_t bytes) {
+        target_bytes_m = bytes;
+        return *this;
+    }
+
+    /// Returns the weighted expected number of chunks touched by the access patterns.
+    double expected_chunks(const std::vector<std::size_t>& chunks) const {
+        double res = 0;
+        for (const auto& pattern : patterns) {
+            double touched = 1;
+            for (std::size_t d = 0; d < chunks.size(); ++d) {
+                // average over all positions of the read relative to the chunk grid, but at most all chunks
+                touched *= std::min(static_cast<double>(pattern.extent[d] + chunks[d] - 1) / static_cast<double>(chunks[d]),
+                                    static_cast<double>((shape[d] + chunks[d] - 1) / chunks[d]));
+            }
+            res += pattern.weight * touched;
+        }
+        return res;
+    }
+
+    /// Returns the proposed chunk shape.
+    std::vector<std::size_t> advise() const {
+        const auto max_elements = std::max<std::size_t>(target_bytes_m / std::max<std::size_t>(element_size, 1), 1);
+        std::vector<std::size_t> res(shape.size(), 1);
+        std::size_t elements = 1;
+        // greedily grow the dimension that reduces the expected chunk count
+        // most, preferring inner dimensions on ties for contiguous rows
+        while (true) {
+            auto best_cost = expected_chunks(res);
+            std::size_t best_dim = shape.size();
+            std::size_t best_len = 0;
+            for (std::size_t d = shape.size(); d-- > 0;) {
+                const auto others = elements / res[d];
+                const auto len = std::min(std::min(2 * res[d], shape[d]), max_elements / others);
+                if (len <= res[d]) {
+                    continue;
+                }
+                const auto old_len = res[d];
+                res[d] = len;
+                const auto cost = expected_chunks(res);
+                res[d] = old_len;
+                if (best_dim == shape.size() || cost < best_cost) {
+                    best_cost = cost;
+                    best_dim = d;
+                    best_len = len;
+                }
+            }
+            if (best_dim == shape.size()) {
+                break;
+            }
+            elements = elements / res[best_dim] * best_len;
+            res[best_dim] = best_len;
+        }
+        // spread the elements evenly over the same number of chunks to avoid a small last chunk
+        for (std::size_t d = 0; d < shape.size(); ++d) {
+            const auto n = (shape[d] + res[d] - 1) / res[d];
+            res[d] = (shape[d] + n - 1) / n;
+        }
+        return res;
+    }
+
+    /// Sets the proposed chunk shape on a variable.
+    void apply(Variable& v) const { v.set_chunking(advise()); }
+};
+
+/// Copies groups while changing the chunking, filters, or endianness of variables.
+///
+/// Values are copied in blocks that are multiples of both the source and
+/// the destination chunks, so every chunk is read and written as a whole.
+/// If such blocks do not fit into the memory limit, e.g. when converting
+/// time-major to space-major chunking, the values are first copied to a
+/// temporary file with intermediate chunks that are compatible with both.
+class Rechunker final {
+  private:
+    std::size_t max_memory_m;
+    std::string temporary_path_m;
+    VariableLayout default_layout_m;
+    std::map<std::string, VariableLayout> layouts;  // by variable path relative to the copied group, e.g. "group/variable"
+
+    static std::size_t gcd(std::size_t a, std::size_t b) { return b == 0 ? a : gcd(b, a % b); }
+
+    bool fits(const std::vector<std::size_t>& block, std::size_t element_size) const { return detail::product(block) * element_size <= max_memory_m; }
+
+    // lowest common multiples of both chunk shapes if they fit, otherwise as
+    // many whole `unit` chunks as fit, starting with the innermost dimension,
+    // otherwise parts of one
+    std::vector<std::size_t> block_shape(const std::vector<std::size_t>& shape,
+                                         const std::vector<std::size_t>& from,
+                                         const std::vector<std::size_t>& to,
+                                         const std::vector<std::size_t>& unit,
+                                         std::size_t element_size) const {
+        std::vector<std::size_t> res(shape.size());
+        for (std::size_t d = 0; d < shape.size(); ++d) {
+            res[d] = std::min(from[d] / gcd(from[d], to[d]) * to[d], shape[d]);
+        }
+        if (fits(res, element_size)) {
+            return res;
+        }
+        const auto max_elements = std::max<std::size_t>(max_memory_m / element_size, 1);
+        for (std::size_t d = 0; d < shape.size(); ++d) {
+            res[d] = std::min(unit[d], shape[d]);
+        }
+        if (fits(res, element_size)) {
+            for (std::size_t d = shape.size(); d-- > 0;) {
+                const auto units = max_elements / detail::product(res);
+                res[d] = std::min(res[d] * std::max<std::size_t>(units, 1), shape[d]);
+                if (res[d] < shape[d]) {
+                    break;
+                }
+            }
+            return res;
+        }
+        for (std::size_t d = 0; d < shape.size() && !fits(res, element_size); ++d) {
+            res[d] = std::max<std::size_t>(max_elements / (detail::product(res) / res[d]), 1);
+        }
+        return res;
+    }
+
+    static void copy_blocks(const Variable& in, const Variable& out, const std::vector<std::size_t>& block, std::size_t element_size) {
+        const auto shape = in.sizes();
+        std::vector<char> buf(element_size * detail::product(block));
+        in.data_mode();
+        out.data_mode();
+        if (shape.empty()) {
+            in.check(nc_get_var(in.path->parent->id, in.path->id, detail::data_or_null(buf)));
+            out.check(nc_put_var(out.path->parent->id, out.path->id, detail::data_or_null(buf)));
+            return;
+        }
+        if (detail::product(shape) == 0) {
+            return;
+        }
+        std::vector<std::size_t> start(shape.size(), 0);
+        std::vector<std::size_t> count(shape.size());
+        while (true) {
+            for (std::size_t d = 0; d < shape.size(); ++d) {
+                count[d] = std::min(block[d], shape[d] - start[d]);
+            }
+            in.check(nc_get_vara(in.path->parent->id, in.path->id, detail::data_or_null(start), detail::data_or_null(count), detail::data_or_null(buf)));
+            out.check(nc_put_vara(out.path->parent->id, out.path->id, detail::data_or_null(start), detail::data_or_null(count), detail::data_or_null(buf)));
+            std::size_t d = shape.size();
+            while (true) {
+                --d;
+                start[d] += block[d];
+                if (start[d] < shape[d]) {
+                    break;
+                }
+                start[d] = 0;
+                if (d == 0) {
+                    return;
+                }
+            }
+        }
+    }
+
+    void copy(const Group& in, Group& out, const std::string& prefix) const {
+        out.copy_attributes(in);
+        out.copy_dimensions(in);
+        out.copy_user_types(in);
+        int variables_before;
+        out.check(nc_inq_nvars(out.path->id, &variables_before));
+        // define all variables before writing values to avoid redefinitions in classic formats
+        std::vector<std::pair<Variable, Variable>> copies;
+        for (const auto& v : in.variables()) {
+            copies.emplace_back(v, out.add_variable(v, layout(prefix + v.name())));
+        }
+        const detail::NoFillScope no_fill(out.path->id, variables_before);
+        for (const auto& c : copies) {
+            copy_values(c.first, c.second);
+        }
+        for (const auto& g : in.groups()) {
+            auto res = out.add_group(g.name());
+            copy(g, res, prefix + g.name() + "/");
+        }
+    }
+
+  public:
+    /// Creates a rechunker that holds at most `max_memory` bytes of values at once.
+    explicit Rechunker(std::size_t max_memory = 256 << 20) : max_memory_m(max_memory) {}
+
+    /// Sets the layout for one variable, given by its path relative to the copied group, e.g. `"group/variable"`.
+    Rechunker& set_layout(std::string variable, VariableLayout layout) {
+        layouts[std::move(variable)] = std::move(layout);
+        return *this;
+    }
+
+    /// Sets the layout for all variables without their own layout (default: keep the source layout).
+    Rechunker& set_default_layout(VariableLayout layout) {
+        default_layout_m = std::move(layout);
+        return *this;
+    }
+
+    /// Sets the path of the temporary file (default: output file name with `.rechunk.tmp` appended).
+    Rechunker& set_temporary_path(std::string path) {
+        temporary_path_m = std::move(path);
+        return *this;
+    }
+
+    /// Returns the layout used for a variable path.
+    const VariableLayout& layout(const std::string& variable) const {
+        const auto it = layouts.find(variable);
+        return it == std::end(layouts) ? default_layout_m : it->second;
+    }
+
+    /// Copies attributes, dimensions, user types, variables with their new layouts, and child groups.
+    void copy(const Group& in, Group out) const { copy(in, out, ""); }
+
+    /// Copies the values of a variable to a variable of the same shape and type with bounded memory.
+    void copy_values(const Variable& in, const Variable& out) const {
+        const auto type = in.type();
+        int type_class = type;
+        std::size_t element_size;
+        if (detail::is_user_type(type)) {
+            in.check(nc_inq_user_type(in.path->parent->id, type, nullptr, &element_size, nullptr, nullptr, &type_class));
+        } else {
+            in.check(nc_inq_type(in.path->parent->id, type, nullptr, &element_size));
+        }
+        if (type_class == NC_STRING || type_class == NC_VLEN) {
+            Variable(out).copy_values(in);  // values are allocated by NetCDF-C, no bounded copy
+            return;
+        }
+        NETCDFPP_INSTRUMENT_IO(copy, *out.path, in.value_count() * element_size);
+        const auto shape = in.sizes();
+        // contiguous storage counts as one chunk of the full extent, it is read and written efficiently in slabs of any shape
+        auto from = in.get_chunking();
+        auto to = out.get_chunking();
+        const auto in_contiguous = from.empty();
+        const auto out_contiguous = to.empty();
+        if (in_contiguous) {
+            from = shape;
+        }
+        if (out_contiguous) {
+            to = shape;
+        }
+        const auto block = block_shape(shape, from, to, out_contiguous ? from : to, element_size);
+        std::vector<std::size_t> direct(shape.size());
+        for (std::size_t d = 0; d < shape.size(); ++d) {
+            direct[d] = std::min(from[d] / gcd(from[d], to[d]) * to[d], shape[d]);
+        }
+        if (block == direct || in_contiguous || out_contiguous || detail::is_user_type(type)) {
+            copy_blocks(in, out, block, element_size);
+            return;
+        }
+
+        std::string tmp_path = temporary_path_m;
+        if (tmp_path.empty()) {
+            std::size_t len;
+            out.check(nc_inq_path(out.path->parent->id, &len, nullptr));
+            std::vector<char> buf(len + 1);
+            out.check(nc_inq_path(out.path->parent->id, nullptr, detail::data_or_null(buf)));
+            tmp_path = std::string(detail::data_or_null(buf)) + ".rechunk.tmp";
+        }
+        std::vector<std::size_t> intermediate(shape.size());
+        std::vector<std::string> dims(shape.size());
+        const detail::RemoveFileScope remove_tmp(tmp_path);  // after closing it below
+        {
+            File tmp(tmp_path, 'w');
+            for (std::size_t d = 0; d < shape.size(); ++d) {
+                intermediate[d] = std::min(std::min(from[d], to[d]), shape[d]);
+                dims[d] = "d" + std::to_string(d);
+                tmp.add_dimension(dims[d], shape[d]);
+            }
+            auto v = tmp.add_variable("v", type, dims);
+            v.set_chunking(intermediate);
+            copy_blocks(in, v, block_shape(shape, from, intermediate, intermediate, element_size), element_size);
+            copy_blocks(v, out, block_shape(shape, intermediate, to, to, element_size), element_size);
+        }
+    }
+};
+
+/// Joins variables split over several files along one dimension, e.g. one file per month, like NcML `joinExisting`.
+///
+/// The files are given in the order of their records. The number of records
+/// of each file is read once on construction, or passed in from an earlier
+/// call to records() so that no file has to be opened up front. Files are
+/// opened read-only on first use and kept in a cache of at most
+/// `max_open_files` handles, which closes the least recently used file when
+/// it is full. Reads through AggregatedVariable only touch the files covering
+/// the requested records.
+///
+/// Copies of an aggregation and its AggregatedVariables share the record
+/// counts and the handle cache, which lives as long as any of them.
+class Aggregation final {
+  private:
+    struct State {
+        std::vector<std::string> filenames;
+        std::string dimension;
+        std::vector<std::size_t> offsets;  // first record of each file, plus the total number of records
+        std::size_t max_open_files;
+        std::list<std::pair<std::size_t, std::unique_ptr<File>>> open_files;  // most recently used first
+    };
+    std::shared_ptr<State> state;
+
+    void set_records(const std::vector<std::size_t>& records) {
+        state->offsets.assign(1, 0);
+        for (const auto n : records) {
+            state->offsets.push_back(state->offsets.back() + n);
+        }
+    }
+
+  public:
+    /// Creates an aggregation along `dimension`, opening each file once to read its number of records.
+    Aggregation(std::vector<std::string> filenames, std::string dimension, std::size_t max_open_files = 16)
+        : state(std::make_shared<State>(State{std::move(filenames), std::move(dimension), {}, std::max<std::size_t>(max_open_files, 1), {}})) {
+        std::vector<std::size_t> records(state->filenames.size());
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            records[i] = file(i).dimension(state->dimension).require().size();
+        }
+        set_records(records);
+    }
+
+    /// Creates an aggregation along `dimension` with known numbers of records per file, as returned by records().
+    Aggregation(std::vector<std::string> filenames, std::string dimension, const std::vector<std::size_t>& records, std::size_t max_open_files = 16)
+        : state(std::make_shared<State>(State{std::move(filenames), std::move(dimension), {}, std::max<std::size_t>(max_open_files, 1), {}})) {
+        if (records.size() != state->filenames.size()) {
+            throw Exception(NC_EINVAL, "Unexpected number of record counts: " + std::to_string(records.size()) + " for "
+                                           + std::to_string(state->filenames.size()) + " files");
+        }
+        set_records(records);
     }
-    template<typename T>
-    /// Reads a strided hyperslab into caller-provided storage.
-    void read(T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) const {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_get_vars(path->parent->id, path->id, start, count, stride, v));
+
+    /// Returns the name of the dimension the files are joined along.
+    const std::string& dimension() const { return state->dimension; }
+
+    /// Returns the total number of records.
+    std::size_t size() const { return state->offsets.back(); }
+
+    /// Returns the number of files.
+    std::size_t file_count() const { return state->filenames.size(); }
+
+    /// Returns the name of file `i`.
+    const std::string& filename(std::size_t i) const { return state->filenames[i]; }
+
+    /// Returns the number of records of each file.
+    std::vector<std::size_t> records() const {
+        std::vector<std::size_t> res(state->filenames.size());
+        for (std::size_t i = 0; i < res.size(); ++i) {
+            res[i] = state->offsets[i + 1] - state->offsets[i];
+        }
+        return res;
+    }
+
+    /// Returns the index of the first record of file `i`, or the total number of records for `i == file_count()`.
+    std::size_t offset(std::size_t i) const { return state->offsets[i]; }
+
+    /// Returns the index of the file containing a record.
+    std::size_t file_index(std::size_t record) const {
+        const auto& offsets = state->offsets;
+        return static_cast<std::size_t>(std::upper_bound(std::begin(offsets), std::end(offsets) - 1, record) - std::begin(offsets)) - 1;
+    }
+
+    /// Returns file `i`, opening it if it is not in the handle cache.
+    ///
+    /// Opening another file closes this one when the cache is full, through
+    /// this function or a read of an AggregatedVariable. That invalidates the
+    /// reference, and NetCDF-C calls through objects of the file, e.g. its
+    /// Variables, fail then or, as NetCDF-C reuses file ids, even reach
+    /// another file. Do not keep such objects across these calls.
+    File& file(std::size_t i) const {
+        auto& open_files = state->open_files;
+        for (auto it = std::begin(open_files); it != std::end(open_files); ++it) {
+            if (it->first == i) {
+                open_files.splice(std::begin(open_files), open_files, it);
+                return *it->second;
+            }
+        }
+        if (open_files.size() >= state->max_open_files) {
+            open_files.pop_back();
+        }
+        open_files.emplace_front(i, std::unique_ptr<File>(new File(state->filenames[i], 'r')));
+        return *open_files.front().second;
+    }
+
+    /// Returns the number of files currently open.
+    std::size_t open_file_count() const { return state->open_files.size(); }
+
+    /// Returns the joined variable at `path`, e.g. `group/var`, as found in the first file.
+    AggregatedVariable variable(const std::string& path) const;
+};
+
+/// Variable of an Aggregation, see Aggregation::variable().
+///
+/// Variables with the aggregation dimension are read from the files covering
+/// the requested records. Others, e.g. coordinates, are read from the first
+/// file.
+class AggregatedVariable final {
+    friend class Aggregation;
+#ifdef NETCDFPP_HAS_PROCESSES
+    friend class ProcessReader;
+#endif
+
+  private:
+    struct Piece {
+        std::size_t file;
+        std::size_t start;   // along the aggregation dimension within the file
+        std::size_t count;
+        std::size_t offset;  // along the aggregation dimension within the requested hyperslab
+    };
+
+    Aggregation aggregation;
+    std::vector<std::string> groups;
+    std::string name_m;
+    std::vector<std::size_t> sizes_m;
+    std::size_t split;  // index of the aggregation dimension, or the dimension count if the variable does not have it
+
+    AggregatedVariable(Aggregation aggregation_p, const std::string& path) : aggregation(std::move(aggregation_p)) {
+        std::size_t begin = 0;
+        for (auto end = path.find('/'); end != std::string::npos; end = path.find('/', begin)) {
+            groups.push_back(path.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        name_m = path.substr(begin);
+        if (aggregation.file_count() == 0) {
+            throw Exception(NC_ENOTFOUND, "Variable not found in empty aggregation: " + path);
+        }
+        const auto v = in_file(0);
+        sizes_m = v.sizes();
+        const auto dims = v.dimensions();
+        split = 0;
+        while (split < dims.size() && dims[split].name() != aggregation.dimension()) {
+            ++split;
+        }
+        if (aggregated()) {
+            sizes_m[split] = aggregation.size();
+        }
+    }
+
+    Variable in_file(std::size_t i) const {
+        Group group = aggregation.file(i);
+        for (const auto& g : groups) {
+            group = group.group(g).require();
+        }
+        return group.variable(name_m).require();
+    }
+
+    std::vector<Piece> pieces(const std::size_t* start, const std::size_t* count) const {
+        const auto end = start[split] + count[split];
+        if (end > aggregation.size()) {
+            throw Exception(NC_EEDGE, std::string(nc_strerror(NC_EEDGE)) + ": " + path());
+        }
+        std::vector<Piece> res;
+        if (count[split] == 0) {
+            return res;
+        }
+        for (auto i = aggregation.file_index(start[split]); i < aggregation.file_count() && aggregation.offset(i) < end; ++i) {
+            const auto first = std::max(start[split], aggregation.offset(i));
+            const auto last = std::min(end, aggregation.offset(i + 1));
+            if (first < last) {
+                res.push_back(Piece{i, first - aggregation.offset(i), last - first, first - start[split]});
+            }
+        }
+        return res;
+    }
+
+  public:
+    /// Returns the path of the variable relative to the root group.
+    std::string path() const {
+        std::string res;
+        for (const auto& g : groups) {
+            res += g + "/";
+        }
+        return res + name_m;
     }
+
+    /// Returns the name of the variable.
+    const std::string& name() const { return name_m; }
+
+    /// Returns whether the variable has the aggregation dimension.
+    bool aggregated() const { return split < sizes_m.size(); }
+
+    /// Returns the number of dimensions.
+    std::size_t dimension_count() const { return sizes_m.size(); }
+
+    /// Returns the dimension sizes, with the total number of records for the aggregation dimension.
+    std::vector<std::size_t> sizes() const { return sizes_m; }
+
     template<typename T>
-    /// Reads mapped data into caller-provided storage.
-    void read(T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) const {
-        static_assert(std::is_same<void, T>::value, "NetCDF supports mapped access only for atomic types");
-        check(nc_get_varm(path->parent->id, path->id, start, count, stride, imap, v));
+    /// Reads all values.
+    std::vector<T> get() const {
+        const std::vector<std::size_t> start(sizes_m.size(), 0);
+        std::vector<T> res(detail::product(sizes_m));
+        read(detail::data_or_null(res), detail::data_or_null(start), detail::data_or_null(sizes_m));
+        return res;
     }
 
-    template<typename T, int N>
-    /// Reads one fixed-rank element into caller-provided storage.
-    void read(T* v, const std::array<std::size_t, N>& index) const {
-        read(v, &index[0]);
+    template<typename T>
+    /// Reads a hyperslab like Variable::read(), reading the part covered by each file from that file.
+    void read(T* out, const std::size_t* start, const std::size_t* count) const {
+        if (!aggregated()) {
+            in_file(0).read(out, start, count);
+            return;
+        }
+        const auto ndims = sizes_m.size();
+        const std::vector<std::size_t> shape(count, count + ndims);
+        // parts are contiguous in the output if all outer dimensions have a count of one
+        const auto contiguous = std::all_of(std::begin(shape), std::begin(shape) + static_cast<std::ptrdiff_t>(split), [](std::size_t n) { return n == 1; });
+        const auto inner = detail::product(std::vector<std::size_t>(std::begin(shape) + static_cast<std::ptrdiff_t>(split) + 1, std::end(shape)));
+        std::vector<std::size_t> part_start(start, start + ndims);
+        std::vector<std::size_t> part_count(shape);
+        std::vector<std::size_t> offset(ndims, 0);
+        const std::vector<std::size_t> zero(ndims, 0);
+        std::vector<T> buf;
+        for (const auto& piece : pieces(start, count)) {
+            const auto v = in_file(piece.file);
+            auto file_sizes = v.sizes();
+            file_sizes[split] = sizes_m[split];
+            if (file_sizes != sizes_m) {
+                throw Exception(NC_EINVAL, "Unexpected shape: " + aggregation.filename(piece.file) + ":" + path());
+            }
+            part_start[split] = piece.start;
+            part_count[split] = piece.count;
+            if (contiguous) {
+                v.read(out + piece.offset * inner, detail::data_or_null(part_start), detail::data_or_null(part_count));
+                continue;
+            }
+            offset[split] = piece.offset;
+            buf.resize(detail::product(part_count));
+            v.read(detail::data_or_null(buf), detail::data_or_null(part_start), detail::data_or_null(part_count));
+            detail::copy_box(reinterpret_cast<const char*>(detail::data_or_null(buf)), detail::data_or_null(part_count), detail::data_or_null(zero),
+                             reinterpret_cast<char*>(out), detail::data_or_null(shape), detail::data_or_null(offset), detail::data_or_null(part_count), ndims,
+                             sizeof(T));
+        }
     }
-    template<typename T, int N>
-    /// Reads a fixed-rank hyperslab into caller-provided storage.
-    void read(T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) const {
-        read(v, &start[0], &count[0]);
+};
+
+inline AggregatedVariable Aggregation::variable(const std::string& path) const { return AggregatedVariable(*this, path); }
+
+#ifdef NETCDFPP_HAS_PROCESSES
+/// Reads variables with several worker processes at once.
+///
+/// NetCDF-C is not thread-safe, so decompressing chunks in one process uses
+/// a single core. ProcessReader instead forks worker processes for each read.
+/// Each of them opens the file read-only on its own and reads a part of the
+/// requested hyperslab, with part boundaries at chunk boundaries, into shared
+/// memory. Reads that cover only one chunk along every dimension are done in
+/// the calling process.
+///
+/// The file is opened again by its path, so pending writes have to be synced
+/// and in-memory files are not supported. Like every use of `fork`, this is
+/// not safe while other threads of the calling process hold locks, e.g. run
+/// NetCDF-C calls.
+class ProcessReader final {
+  private:
+    struct Status {
+        int ret;
+        char message[256];
+    };
+
+    class SharedMemory final {
+      private:
+        void* data_m;
+        std::size_t size_m;
+
+      public:
+        explicit SharedMemory(std::size_t size) : data_m(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)), size_m(size) {}
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+        ~SharedMemory() {
+            if (data_m != MAP_FAILED) {
+                munmap(data_m, size_m);
+            }
+        }
+        char* data() const { return data_m == MAP_FAILED ? nullptr : static_cast<char*>(data_m); }
+    };
+
+    std::size_t processes_m;
+
+    static std::string file_path(const Variable& v) {
+        std::size_t len;
+        v.check(nc_inq_path(v.path->parent->id, &len, nullptr));
+        std::vector<char> buf(len + 1);
+        v.check(nc_inq_path(v.path->parent->id, nullptr, detail::data_or_null(buf)));
+        return std::string(detail::data_or_null(buf));
     }
-    template<typename T, int N>
-    /// Reads a fixed-rank strided hyperslab into caller-provided storage.
-    void read(T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) const {
-        read(v, &start[0], &count[0], &stride[0]);
+
+    template<typename T>
+    static void read_part(const std::string& filename,
+                          const std::vector<std::string>& groups,
+                          const std::string& name,
+                          const std::vector<std::size_t>& start,
+                          const std::vector<std::size_t>& count,
+                          const std::vector<std::size_t>& offset,
+                          const std::vector<std::size_t>& shape,
+                          bool contiguous,
+                          T* out) {
+        File file(filename, 'r');
+        Group group = file;
+        for (const auto& g : groups) {
+            group = group.group(g).require();
+        }
+        const auto v = group.variable(name).require();
+        if (contiguous) {
+            std::size_t pos = 0;
+            for (std::size_t d = 0; d < shape.size(); ++d) {
+                pos = pos * shape[d] + offset[d];
+            }
+            v.read(out + pos, detail::data_or_null(start), detail::data_or_null(count));
+            return;
+        }
+        std::vector<T> buf(detail::product(count));
+        v.read(detail::data_or_null(buf), detail::data_or_null(start), detail::data_or_null(count));
+        const std::vector<std::size_t> zero(count.size(), 0);
+        detail::copy_box(reinterpret_cast<const char*>(detail::data_or_null(buf)), detail::data_or_null(count), detail::data_or_null(zero),
+                         reinterpret_cast<char*>(out), detail::data_or_null(shape), detail::data_or_null(offset), detail::data_or_null(count), count.size(),
+                         sizeof(T));
+    }
+
+    // calls `part(p)` in a new process for each worker `p` and rethrows the first error reported in `status`
+    template<typename Function>
+    static void run(std::size_t workers, Status* status, const std::string& path, Function&& part) {
+        std::vector<pid_t> pids;
+        for (std::size_t p = 0; p < workers; ++p) {
+            status[p].ret = NC_EINTERNAL;
+            const auto pid = fork();
+            if (pid < 0) {
+                break;
+            }
+            if (pid == 0) {
+                try {
+                    part(p);
+                    status[p].ret = NC_NOERR;
+                } catch (const Exception& e) {
+                    status[p].ret = e.return_code();
+                    std::strncpy(status[p].message, e.what(), sizeof(status[p].message) - 1);
+                } catch (const std::exception& e) {
+                    std::strncpy(status[p].message, e.what(), sizeof(status[p].message) - 1);
+                }
+                _exit(0);  // skip exit handlers, which would also act on the files opened by the parent
+            }
+            pids.push_back(pid);
+        }
+
+        for (const auto pid : pids) {
+            while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+            }
+        }
+        if (pids.size() < workers) {
+            throw Exception(NC_EIO, "Could not start reader process: " + path);
+        }
+        for (std::size_t p = 0; p < workers; ++p) {
+            if (status[p].ret != NC_NOERR) {
+                const auto message = std::string(status[p].message);
+                throw Exception(status[p].ret, message.empty() ? "Reader process failed: " + path : message);
+            }
+        }
     }
-    template<typename T, int N>
-    /// Reads fixed-rank mapped data into caller-provided storage.
-    void read(T* v,
-              const std::array<std::size_t, N>& start,
-              const std::array<std::size_t, N>& count,
-              const std::array<std::ptrdiff_t, N>& stride,
-              const std::array<std::ptrdiff_t, N>& imap) const {
-        read(v, &start[0], &count[0], &stride[0], &imap[0]);
+
+  public:
+    /// Creates a reader with `processes` worker processes, or one per online CPU if 0.
+    explicit ProcessReader(std::size_t processes = 0) : processes_m(processes) {
+        if (processes_m == 0) {
+            const auto cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            processes_m = cpus > 0 ? static_cast<std::size_t>(cpus) : 1;
+        }
     }
 
+    /// Returns the maximum number of worker processes.
+    std::size_t processes() const { return processes_m; }
+
     template<typename T>
-    /// Writes the whole variable from a vector.
-    void set(const std::vector<T>& v) {
-        write(detail::data_or_null(v));
+    /// Reads all values of a variable.
+    std::vector<T> get(const Variable& v) const {
+        const auto count = v.sizes();
+        const std::vector<std::size_t> start(count.size(), 0);
+        std::vector<T> res(detail::product(count));
+        read(v, detail::data_or_null(res), detail::data_or_null(start), detail::data_or_null(count));
+        return res;
     }
+
     template<typename T>
-    /// Writes one value by raw NetCDF index pointer.
-    typename std::enable_if<Type<T>::is_atomic || std::is_same<const char*, T>::value || std::is_same<char*, T>::value, void>::type set(
-        T v, const std::size_t* index) {
-        write(&v, index);
+    /// Reads a hyperslab like Variable::read(), with the work split between the worker processes.
+    void read(const Variable& v, T* out, const std::size_t* start, const std::size_t* count) const {
+        static_assert(std::is_arithmetic<T>::value, "Only numeric values can be read with several processes");
+        const auto ndims = v.dimension_count();
+        const std::vector<std::size_t> shape(count, count + ndims);
+        const auto chunks = v.get_chunking();
+
+        // split along the dimension covering the most chunks, preferring outer ones
+        std::size_t split = 0;
+        std::size_t blocks = 0;
+        for (std::size_t d = 0; d < ndims; ++d) {
+            const auto unit = chunks.empty() ? 1 : chunks[d];
+            const auto n = shape[d] == 0 ? 0 : (start[d] + shape[d] - 1) / unit - start[d] / unit + 1;
+            if (n > blocks) {
+                split = d;
+                blocks = n;
+            }
+            if (blocks >= processes_m) {
+                break;
+            }
+        }
+        const auto workers = std::min(blocks, processes_m);
+        if (workers <= 1 || detail::product(shape) == 0) {
+            v.read(out, start, count);
+            return;
+        }
+
+        const auto unit = chunks.empty() ? 1 : chunks[split];
+        // parts are contiguous in the output if all outer dimensions have a count of one
+        const auto contiguous = std::all_of(std::begin(shape), std::begin(shape) + static_cast<std::ptrdiff_t>(split), [](std::size_t n) { return n == 1; });
+        const auto status_bytes = (workers * sizeof(Status) + 63) / 64 * 64;
+        SharedMemory memory(status_bytes + detail::product(shape) * sizeof(T));
+        if (!memory.data()) {
+            throw Exception(NC_ENOMEM, "Could not allocate shared memory: " + v.path->get_full_path());
+        }
+        auto* status = reinterpret_cast<Status*>(memory.data());
+        auto* values = reinterpret_cast<T*>(memory.data() + status_bytes);
+
+        const auto filename = file_path(v);
+        std::vector<std::string> groups;
+        for (auto g = v.path->parent; g->parent; g = g->parent) {
+            groups.insert(std::begin(groups), g->name);
+        }
+
+        run(workers, status, v.path->get_full_path(), [&](std::size_t p) {
+            std::vector<std::size_t> part_start(start, start + ndims);
+            std::vector<std::size_t> part_count(shape);
+            const auto first = start[split] / unit;
+            part_start[split] = std::max(start[split], (first + detail::part_begin(blocks, p, workers)) * unit);
+            part_count[split] = std::min(start[split] + shape[split], (first + detail::part_begin(blocks, p + 1, workers)) * unit) - part_start[split];
+            std::vector<std::size_t> offset(ndims, 0);
+            offset[split] = part_start[split] - start[split];
+            read_part(filename, groups, v.path->name, part_start, part_count, offset, shape, contiguous, values);
+        });
+        std::memcpy(out, values, detail::product(shape) * sizeof(T));
     }
+
     template<typename T>
-    /// Writes one non-atomic value by raw NetCDF index pointer.
-    typename std::enable_if<!Type<T>::is_atomic && !std::is_same<const char*, T>::value && !std::is_same<char*, T>::value, void>::type set(
-        const T& v, const std::size_t* index) {
-        write(&v, index);
+    /// Reads all values of an aggregated variable.
+    std::vector<T> get(const AggregatedVariable& v) const {
+        const auto count = v.sizes();
+        const std::vector<std::size_t> start(count.size(), 0);
+        std::vector<T> res(detail::product(count));
+        read(v, detail::data_or_null(res), detail::data_or_null(start), detail::data_or_null(count));
+        return res;
     }
+
     template<typename T>
-    /// Writes a hyperslab from a vector.
-    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count) {
-        write(detail::data_or_null(v), start, count);
+    /// Reads a hyperslab of an aggregated variable like AggregatedVariable::read(), with the files covered split between the worker processes.
+    ///
+    /// Hyperslabs within one file are split as in read() for variables.
+    void read(const AggregatedVariable& v, T* out, const std::size_t* start, const std::size_t* count) const {
+        static_assert(std::is_arithmetic<T>::value, "Only numeric values can be read with several processes");
+        if (!v.aggregated()) {
+            read(v.in_file(0), out, start, count);
+            return;
+        }
+        const auto pieces = v.pieces(start, count);
+        const auto workers = std::min(pieces.size(), processes_m);
+        if (pieces.size() == 1) {
+            std::vector<std::size_t> part_start(start, start + v.dimension_count());
+            part_start[v.split] = pieces[0].start;
+            read(v.in_file(pieces[0].file), out, detail::data_or_null(part_start), count);
+            return;
+        }
+        if (workers <= 1) {
+            v.read(out, start, count);
+            return;
+        }
+
+        const auto ndims = v.dimension_count();
+        const std::vector<std::size_t> shape(count, count + ndims);
+        const auto contiguous = std::all_of(std::begin(shape), std::begin(shape) + static_cast<std::ptrdiff_t>(v.split), [](std::size_t n) { return n == 1; });
+        const auto status_bytes = (workers * sizeof(Status) + 63) / 64 * 64;
+        SharedMemory memory(status_bytes + detail::product(shape) * sizeof(T));
+        if (!memory.data()) {
+            throw Exception(NC_ENOMEM, "Could not allocate shared memory: " + v.path());
+        }
+        auto* status = reinterpret_cast<Status*>(memory.data());
+        auto* values = reinterpret_cast<T*>(memory.data() + status_bytes);
+
+        run(workers, status, v.path(), [&](std::size_t p) {
+            for (auto i = detail::part_begin(pieces.size(), p, workers); i < detail::part_begin(pieces.size(), p + 1, workers); ++i) {
+                std::vector<std::size_t> part_start(start, start + ndims);
+                std::vector<std::size_t> part_count(shape);
+                std::vector<std::size_t> offset(ndims, 0);
+                part_start[v.split] = pieces[i].start;
+                part_count[v.split] = pieces[i].count;
+                offset[v.split] = pieces[i].offset;
+                read_part(v.aggregation.filename(pieces[i].file), v.groups, v.name(), part_start, part_count, offset, shape, contiguous, values);
+            }
+        });
+        std::memcpy(out, values, detail::product(shape) * sizeof(T));
+    }
+};
+#endif
+
+#ifdef NETCDFPP_WITH_HDF5
+/// Reads and writes chunks of NetCDF-4 variables directly with HDF5 and
+/// (de)compresses them on several threads.
+///
+/// NetCDF-C decompresses one chunk at a time in the calling thread. For
+/// variables whose filters are all supported here, i.e. shuffle, deflate,
+/// and zstd if NETCDFPP_WITH_ZSTD is defined, DirectChunkIO reads the raw
+/// chunks with `H5Dread_chunk` under one lock, while a pool of threads
+/// decompresses them and copies the requested values. Writes compress the
+/// chunks on the threads and store them with `H5Dwrite_chunk`. Chunks that
+/// are only partly written are read and merged first.
+///
+/// Everything else falls back to Variable::read() and Variable::write(),
+/// e.g. other filters, contiguous storage, a file type or byte order
+/// different from `T`, or writes beyond the current size of an unlimited
+/// dimension.
+///
+/// Define NETCDFPP_WITH_HDF5 and link HDF5 (at least 1.10.3, the same library
+/// NetCDF-C uses) and zlib to use it. No other thread may call NetCDF-C or
+/// HDF5 during a read or write.
+class DirectChunkIO final {
+  private:
+    // closes an HDF5 id
+    class Handle final {
+      private:
+        hid_t id_m;
+        herr_t (*close_m)(hid_t);
+
+      public:
+        Handle(hid_t id, herr_t (*close)(hid_t)) : id_m(id), close_m(close) {}
+        Handle(const Handle&) = delete;
+        Handle& operator=(const Handle&) = delete;
+        ~Handle() {
+            if (id_m >= 0) {
+                close_m(id_m);
+            }
+        }
+        hid_t get() const { return id_m; }
+    };
+
+    // HDF5 errors only decide about the fallback, so do not print them
+    class SilentErrors final {
+      private:
+        H5E_auto2_t func;
+        void* data;
+
+      public:
+        SilentErrors() {
+            H5Eget_auto2(H5E_DEFAULT, &func, &data);
+            H5Eset_auto2(H5E_DEFAULT, nullptr, nullptr);
+        }
+        SilentErrors(const SilentErrors&) = delete;
+        SilentErrors& operator=(const SilentErrors&) = delete;
+        ~SilentErrors() { H5Eset_auto2(H5E_DEFAULT, func, data); }
+    };
+
+    // the HDF5 dataset of a variable and what is needed to (de)code its chunks
+    class Dataset final {
+      private:
+        static hid_t open_file(const Variable& v, bool write) {
+            std::size_t len;
+            v.check(nc_inq_path(v.path->parent->id, &len, nullptr));
+            std::vector<char> buf(len + 1);
+            v.check(nc_inq_path(v.path->parent->id, nullptr, detail::data_or_null(buf)));
+            return H5Fopen(detail::data_or_null(buf), write ? H5F_ACC_RDWR : H5F_ACC_RDONLY, H5P_DEFAULT);
+        }
+
+        static hid_t open_dataset(hid_t file_id, const Variable& v) {
+            if (file_id < 0) {
+                return -1;
+            }
+            std::string group = "/";
+            for (auto g = v.path->parent; g->parent; g = g->parent) {
+                group.insert(0, "/" + g->name);
+            }
+            const auto res = H5Dopen2(file_id, (group + v.path->name).c_str(), H5P_DEFAULT);
+            if (res >= 0) {
+                return res;
+            }
+            // variables named like a dimension they do not use
+            return H5Dopen2(file_id, (group + "_nc4_non_coord_" + v.path->name).c_str(), H5P_DEFAULT);
+        }
+
+        bool inspect(const Variable& v, nc_type type, std::size_t element_size) {
+            int format;
+            if (nc_inq_format(v.path->parent->id, &format) != NC_NOERR || (format != NC_FORMAT_NETCDF4 && format != NC_FORMAT_NETCDF4_CLASSIC)
+                || v.type() != type) {
+                return false;
+            }
+            const Handle data_type(H5Dget_type(dataset.get()), H5Tclose);
+            if (data_type.get() < 0 || H5Tget_size(data_type.get()) != element_size || H5Tget_order(data_type.get()) != H5Tget_order(H5T_NATIVE_INT)) {
+                return false;
+            }
+            const Handle space(H5Dget_space(dataset.get()), H5Sclose);
+            const Handle plist(H5Dget_create_plist(dataset.get()), H5Pclose);
+            if (space.get() < 0 || plist.get() < 0 || H5Pget_layout(plist.get()) != H5D_CHUNKED) {
+                return false;
+            }
+            const auto ndims = H5Sget_simple_extent_ndims(space.get());
+            if (ndims <= 0) {
+                return false;
+            }
+            std::vector<hsize_t> dims(static_cast<std::size_t>(ndims));
+            std::vector<hsize_t> chunk_dims(dims.size());
+            if (H5Sget_simple_extent_dims(space.get(), detail::data_or_null(dims), nullptr) != ndims
+                || H5Pget_chunk(plist.get(), ndims, detail::data_or_null(chunk_dims)) != ndims) {
+                return false;
+            }
+            shape.assign(std::begin(dims), std::end(dims));
+            chunks.assign(std::begin(chunk_dims), std::end(chunk_dims));
+            chunk_bytes = detail::product(chunks) * element_size;
+
+            const auto n = H5Pget_nfilters(plist.get());
+            for (int i = 0; i < n; ++i) {
+                unsigned int flags;
+                std::size_t count = 8;
+                std::vector<unsigned int> params(count);
+                char name[64];
+                const auto id = H5Pget_filter2(plist.get(), static_cast<unsigned int>(i), &flags, &count, detail::data_or_null(params), sizeof(name), name,
+                                               nullptr);
+                params.resize(std::min(count, params.size()));
+                if (id != H5Z_FILTER_DEFLATE && id != H5Z_FILTER_SHUFFLE
+#ifdef NETCDFPP_WITH_ZSTD
+                    && id != 32015  // H5Z_FILTER_ZSTD
+#endif
+                ) {
+                    return false;
+                }
+                if (id != H5Z_FILTER_SHUFFLE && params.empty()) {
+                    params.push_back(id == H5Z_FILTER_DEFLATE ? 6 : 3);  // default levels
+                }
+                filters.push_back(Filter{static_cast<unsigned int>(id), std::move(params)});
+            }
+            return true;
+        }
+
+      public:
+        Handle file;
+        Handle dataset;
+        std::vector<std::size_t> shape;
+        std::vector<std::size_t> chunks;
+        std::size_t chunk_bytes = 0;
+        std::vector<Filter> filters;  // in the order applied when writing
+        bool supported;
+
+        Dataset(const Variable& v, nc_type type, std::size_t element_size, bool write)
+            : file(open_file(v, write), H5Fclose), dataset(open_dataset(file.get(), v), H5Dclose) {
+            supported = dataset.get() >= 0 && inspect(v, type, element_size);
+        }
+    };
+
+    std::size_t threads_m;
+
+    static void shuffle(const char* src, char* dst, std::size_t bytes, std::size_t element_size, bool forward) {
+        const auto n = bytes / element_size;
+        for (std::size_t i = 0; i < n; ++i) {
+            for (std::size_t j = 0; j < element_size; ++j) {
+                if (forward) {
+                    dst[j * n + i] = src[i * element_size + j];
+                } else {
+                    dst[i * element_size + j] = src[j * n + i];
+                }
+            }
+        }
+        std::memcpy(dst + n * element_size, src + n * element_size, bytes - n * element_size);  // incomplete trailing element
+    }
+
+    // undoes the filters not skipped in `mask`, `buf` receives the chunk
+    static bool decode(const Dataset& d, std::vector<char>& raw, unsigned int mask, std::size_t element_size, std::vector<char>& buf) {
+        for (std::size_t i = d.filters.size(); i > 0; --i) {
+            const auto& filter = d.filters[i - 1];
+            if ((mask >> (i - 1)) & 1) {
+                continue;
+            }
+            buf.resize(d.chunk_bytes);
+            switch (filter.id) {
+                case H5Z_FILTER_SHUFFLE:
+                    if (raw.size() != d.chunk_bytes) {
+                        return false;
+                    }
+                    shuffle(detail::data_or_null(raw), detail::data_or_null(buf), raw.size(), element_size, false);
+                    break;
+                case H5Z_FILTER_DEFLATE: {
+                    uLongf len = static_cast<uLongf>(buf.size());
+                    if (uncompress(reinterpret_cast<Bytef*>(detail::data_or_null(buf)), &len, reinterpret_cast<const Bytef*>(detail::data_or_null(raw)),
+                                   static_cast<uLong>(raw.size()))
+                        != Z_OK) {
+                        return false;
+                    }
+                    buf.resize(len);
+                } break;
+#ifdef NETCDFPP_WITH_ZSTD
+                default: {
+                    const auto len = ZSTD_decompress(detail::data_or_null(buf), buf.size(), detail::data_or_null(raw), raw.size());
+                    if (ZSTD_isError(len)) {
+                        return false;
+                    }
+                    buf.resize(len);
+                } break;
+#endif
+            }
+            raw.swap(buf);
+        }
+        raw.swap(buf);
+        return buf.size() == d.chunk_bytes;
+    }
+
+    // applies all filters to the chunk in `buf`, `raw` receives the result
+    static bool encode(const Dataset& d, std::vector<char>& buf, std::size_t element_size, std::vector<char>& raw) {
+        for (const auto& filter : d.filters) {
+            switch (filter.id) {
+                case H5Z_FILTER_SHUFFLE:
+                    raw.resize(buf.size());
+                    shuffle(detail::data_or_null(buf), detail::data_or_null(raw), buf.size(), element_size, true);
+                    break;
+                case H5Z_FILTER_DEFLATE: {
+                    auto len = compressBound(static_cast<uLong>(buf.size()));
+                    raw.resize(len);
+                    if (compress2(reinterpret_cast<Bytef*>(detail::data_or_null(raw)), &len, reinterpret_cast<const Bytef*>(detail::data_or_null(buf)),
+                                  static_cast<uLong>(buf.size()), static_cast<int>(filter.params[0]))
+                        != Z_OK) {
+                        return false;
+                    }
+                    raw.resize(len);
+                } break;
+#ifdef NETCDFPP_WITH_ZSTD
+                default: {
+                    raw.resize(ZSTD_compressBound(buf.size()));
+                    const auto len = ZSTD_compress(detail::data_or_null(raw), raw.size(), detail::data_or_null(buf), buf.size(), static_cast<int>(filter.params[0]));
+                    if (ZSTD_isError(len)) {
+                        return false;
+                    }
+                    raw.resize(len);
+                } break;
+#endif
+            }
+            buf.swap(raw);
+        }
+        buf.swap(raw);
+        return true;
     }
+
+    // reads and decodes one chunk into `buf`, or fills it with the fill value if the chunk was never written
     template<typename T>
-    /// Writes a strided hyperslab from a vector.
-    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {
-        write(detail::data_or_null(v), start, count, stride);
+    static void load_chunk(
+        const Variable& v, const Dataset& d, const std::vector<hsize_t>& offset, T fill, std::mutex& hdf5, std::vector<char>& raw, std::vector<char>& buf) {
+        hsize_t size = 0;
+        unsigned int mask = 0;
+        bool ok = true;
+        {
+            std::lock_guard<std::mutex> lock(hdf5);
+            if (H5Dget_chunk_storage_size(d.dataset.get(), detail::data_or_null(offset), &size) < 0) {
+                size = 0;  // not allocated
+            }
+            if (size > 0) {
+                raw.resize(size);
+                ok = H5Dread_chunk(d.dataset.get(), H5P_DEFAULT, detail::data_or_null(offset), &mask, detail::data_or_null(raw)) >= 0;
+            }
+        }
+        if (size == 0) {
+            buf.resize(d.chunk_bytes);
+            std::fill_n(reinterpret_cast<T*>(detail::data_or_null(buf)), buf.size() / sizeof(T), fill);
+            return;
+        }
+        if (!ok || !decode(d, raw, mask, sizeof(T), buf)) {
+            throw Exception(NC_EHDFERR, "Could not read chunk: " + v.path->get_full_path());
+        }
     }
+
     template<typename T>
-    /// Writes mapped data from a vector.
-    void set(const std::vector<T>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) {
-        write(detail::data_or_null(v), start, count, stride, imap);
+    static T fill_value(const Variable& v) {
+        T res;
+        int no_fill;
+        v.check(nc_inq_var_fill(v.path->parent->id, v.path->id, &no_fill, &res));
+        return res;
+    }
+
+    // calls `f(chunk index)` for chunk indices 0, ..., n - 1 on the threads, rethrowing the first exception
+    template<typename Function>
+    void run(std::size_t n, Function f) const {
+        std::atomic<std::size_t> next(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto work = [&]() {
+            try {
+                for (auto i = next++; i < n; i = next++) {
+                    f(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next = n;
+            }
+        };
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < std::min(threads_m, n); ++i) {
+            threads.emplace_back(work);
+        }
+        work();
+        for (auto& t : threads) {
+            t.join();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // offsets of all chunks intersecting the hyperslab
+    static std::vector<std::vector<hsize_t>> chunk_offsets(const Dataset& d, const std::size_t* start, const std::size_t* count) {
+        const auto ndims = d.shape.size();
+        std::vector<std::vector<hsize_t>> res;
+        std::vector<hsize_t> offset(ndims);
+        for (std::size_t i = 0; i < ndims; ++i) {
+            if (count[i] == 0) {
+                return res;
+            }
+            offset[i] = start[i] / d.chunks[i] * d.chunks[i];
+        }
+        while (true) {
+            res.push_back(offset);
+            std::size_t i = ndims;
+            while (true) {
+                --i;
+                offset[i] += d.chunks[i];
+                if (offset[i] < start[i] + count[i]) {
+                    break;
+                }
+                offset[i] = start[i] / d.chunks[i] * d.chunks[i];
+                if (i == 0) {
+                    return res;
+                }
+            }
+        }
     }
 
-    template<typename T, int N>
-    /// Writes one fixed-rank element.
-    void set(const T v, const std::array<std::size_t, N>& index) {
-        set(v, &index[0]);
-    }
-    template<typename T, int N>
-    /// Writes a fixed-rank hyperslab from a vector.
-    void set(const std::vector<T>& v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
-        set(v, &start[0], &count[0]);
-    }
-    template<typename T, int N>
-    /// Writes a fixed-rank strided hyperslab from a vector.
-    void set(const std::vector<T>& v,
-             const std::array<std::size_t, N>& start,
-             const std::array<std::size_t, N>& count,
-             const std::array<std::ptrdiff_t, N>& stride) {
-        set(v, &start[0], &count[0], &stride[0]);
+    // box of the hyperslab inside the chunk at `offset`, relative to both
+    static void overlap(const std::vector<hsize_t>& offset,
+                        const std::vector<std::size_t>& chunks,
+                        const std::size_t* start,
+                        const std::size_t* count,
+                        std::vector<std::size_t>& in_chunk,
+                        std::vector<std::size_t>& in_slab,
+                        std::vector<std::size_t>& box) {
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            const auto begin = std::max<std::size_t>(start[i], offset[i]);
+            const auto end = std::min<std::size_t>(start[i] + count[i], offset[i] + chunks[i]);
+            in_chunk[i] = begin - offset[i];
+            in_slab[i] = begin - start[i];
+            box[i] = end - begin;
+        }
     }
-    template<typename T, int N>
-    /// Writes fixed-rank mapped data from a vector.
-    void set(const std::vector<T>& v,
-             const std::array<std::size_t, N>& start,
-             const std::array<std::size_t, N>& count,
-             const std::array<std::ptrdiff_t, N>& stride,
-             const std::array<std::ptrdiff_t, N>& imap) {
-        set(v, &start[0], &count[0], &stride[0], &imap[0]);
+
+  public:
+    /// Creates a reader and writer using `threads` threads, or one per hardware thread if 0.
+    explicit DirectChunkIO(std::size_t threads = 0) : threads_m(threads) {
+        if (threads_m == 0) {
+            threads_m = std::max(1u, std::thread::hardware_concurrency());
+        }
     }
 
+    /// Returns the number of threads.
+    std::size_t threads() const { return threads_m; }
+
     template<typename T>
-    /// Writes the whole variable from caller-provided storage.
-    void write(const T* v) {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_put_var(path->parent->id, path->id, v));
+    /// Returns true if reads and writes of `T` values take the direct path for this variable.
+    bool supported(const Variable& v) const {
+        const SilentErrors silent;
+        return Dataset(v, Type<T>::id, sizeof(T), false).supported;
     }
+
     template<typename T>
-    /// Writes one element from caller-provided storage.
-    void write(const T* v, const std::size_t* index) {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_put_var1(path->parent->id, path->id, index, v));
+    /// Reads all values of a variable.
+    std::vector<T> get(const Variable& v) const {
+        const auto count = v.sizes();
+        const std::vector<std::size_t> start(count.size(), 0);
+        std::vector<T> res(detail::product(count));
+        read(v, detail::data_or_null(res), detail::data_or_null(start), detail::data_or_null(count));
+        return res;
     }
+
     template<typename T>
-    /// Writes a hyperslab from caller-provided storage.
-    void write(const T* v, const std::size_t* start, const std::size_t* count) {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_put_vara(path->parent->id, path->id, start, count, v));
+    /// Reads a hyperslab like Variable::read().
+    void read(const Variable& v, T* out, const std::size_t* start, const std::size_t* count) const {
+        static_assert(Type<T>::is_atomic && !std::is_pointer<T>::value, "Only fixed-size atomic values can be read directly");
+        const SilentErrors silent;
+        const Dataset d(v, Type<T>::id, sizeof(T), false);
+        if (!d.supported) {
+            v.read(out, start, count);
+            return;
+        }
+        for (std::size_t i = 0; i < d.shape.size(); ++i) {
+            if (start[i] + count[i] > d.shape[i]) {
+                throw Exception(NC_EEDGE, "Start+count exceeds dimension bound: " + v.path->get_full_path());
+            }
+        }
+        const auto offsets = chunk_offsets(d, start, count);
+        const auto fill = fill_value<T>(v);
+        std::mutex hdf5;
+        run(offsets.size(), [&](std::size_t c) {
+            std::vector<char> raw;
+            std::vector<char> buf;
+            load_chunk<T>(v, d, offsets[c], fill, hdf5, raw, buf);
+            std::vector<std::size_t> in_chunk(d.shape.size());
+            std::vector<std::size_t> in_slab(d.shape.size());
+            std::vector<std::size_t> box(d.shape.size());
+            overlap(offsets[c], d.chunks, start, count, in_chunk, in_slab, box);
+            detail::copy_box(detail::data_or_null(buf), detail::data_or_null(d.chunks), detail::data_or_null(in_chunk), reinterpret_cast<char*>(out), count,
+                             detail::data_or_null(in_slab), detail::data_or_null(box), box.size(), sizeof(T));
+        });
     }
+
     template<typename T>
-    /// Writes a strided hyperslab from caller-provided storage.
-    void write(const T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {
-        static_assert(!Type<T>::is_atomic || std::is_same<void, T>::value, "Use void or one of the explicitly supported types");
-        check(nc_put_vars(path->parent->id, path->id, start, count, stride, v));
+    /// Writes a hyperslab like Variable::write().
+    void write(Variable& v, const T* in, const std::size_t* start, const std::size_t* count) const {
+        static_assert(Type<T>::is_atomic && !std::is_pointer<T>::value, "Only fixed-size atomic values can be written directly");
+        v.data_mode();  // nc_sync fails in define mode of classic model files
+        v.check(nc_sync(v.path->root().id));  // defines pending datasets and flushes NetCDF-C metadata
+        const SilentErrors silent;
+        const Dataset d(v, Type<T>::id, sizeof(T), true);
+        bool inside = d.supported;
+        for (std::size_t i = 0; inside && i < d.shape.size(); ++i) {
+            inside = start[i] + count[i] <= d.shape[i];
+        }
+        if (!inside) {
+            v.write(in, start, count);
+            return;
+        }
+        const auto offsets = chunk_offsets(d, start, count);
+        const auto fill = fill_value<T>(v);
+        std::mutex hdf5;
+        run(offsets.size(), [&](std::size_t c) {
+            const auto& offset = offsets[c];
+            std::vector<std::size_t> in_chunk(d.shape.size());
+            std::vector<std::size_t> in_slab(d.shape.size());
+            std::vector<std::size_t> box(d.shape.size());
+            overlap(offset, d.chunks, start, count, in_chunk, in_slab, box);
+            bool complete = true;  // all values of the chunk inside the variable are written
+            for (std::size_t i = 0; i < box.size(); ++i) {
+                complete = complete && box[i] == std::min<std::size_t>(d.chunks[i], d.shape[i] - offset[i]);
+            }
+            std::vector<char> raw;
+            std::vector<char> buf;
+            if (complete) {
+                buf.resize(d.chunk_bytes);
+            } else {
+                load_chunk<T>(v, d, offset, fill, hdf5, raw, buf);
+            }
+            detail::copy_box(reinterpret_cast<const char*>(in), count, detail::data_or_null(in_slab), detail::data_or_null(buf), detail::data_or_null(d.chunks),
+                             detail::data_or_null(in_chunk), detail::data_or_null(box), box.size(), sizeof(T));
+            if (!encode(d, buf, sizeof(T), raw)) {
+                throw Exception(NC_EHDFERR, "Could not compress chunk: " + v.path->get_full_path());
+            }
+            std::lock_guard<std::mutex> lock(hdf5);
+            if (H5Dwrite_chunk(d.dataset.get(), H5P_DEFAULT, 0, detail::data_or_null(offset), raw.size(), detail::data_or_null(raw)) < 0) {
+                throw Exception(NC_EHDFERR, "Could not write chunk: " + v.path->get_full_path());
+            }
+        });
     }
-    template<typename T>
-    /// Writes mapped data from caller-provided storage.
-    void write(const T* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) {
-        static_assert(std::is_same<void, T>::value, "NetCDF supports mapped access only for atomic types");
-        check(nc_put_varm(path->parent->id, path->id, start, count, stride, imap, v));
+};
+#endif
+
+namespace detail {
+
+struct LazyBase {};
+
+template<typename T>
+struct is_lazy : std::is_base_of<LazyBase, T> {};
+
+// shape of the variables of an expression and a block shape following the chunks of the first one
+struct LazyShape {
+    std::vector<std::size_t> sizes;
+    std::vector<std::size_t> chunks;
+    std::string path;
+    bool known = false;
+};
+
+template<typename T>
+class LazyScalar final : public LazyBase {
+  private:
+    T value;
+
+  public:
+    using value_type = T;
+    explicit LazyScalar(T v) : value(v) {}
+    void collect(LazyShape&) const {}
+    void load(std::size_t, const std::vector<std::size_t>&, const std::vector<std::size_t>&) {}
+    T operator[](std::size_t) const { return value; }
+};
+
+template<typename T, bool = is_lazy<T>::value>
+struct as_lazy {
+    using type = T;
+    static const T& get(const T& v) { return v; }
+};
+
+template<typename T>
+struct as_lazy<T, false> {
+    using type = LazyScalar<T>;
+    static LazyScalar<T> get(T v) { return LazyScalar<T>(v); }
+};
+
+template<typename L, typename R>
+struct lazy_operands : std::integral_constant<bool,
+                                              (is_lazy<L>::value && (is_lazy<R>::value || std::is_arithmetic<R>::value))
+                                                  || (std::is_arithmetic<L>::value && is_lazy<R>::value)> {};
+
+template<typename Op, typename L, typename R>
+class LazyBinary final : public LazyBase {
+  private:
+    L l;
+    R r;
+
+  public:
+    using value_type = decltype(Op()(std::declval<typename L::value_type>(), std::declval<typename R::value_type>()));
+    LazyBinary(L l_p, R r_p) : l(std::move(l_p)), r(std::move(r_p)) {}
+    void collect(LazyShape& shape) const {
+        l.collect(shape);
+        r.collect(shape);
+    }
+    void load(std::size_t block, const std::vector<std::size_t>& start, const std::vector<std::size_t>& count) {
+        l.load(block, start, count);
+        r.load(block, start, count);
     }
+    value_type operator[](std::size_t i) const { return Op()(l[i], r[i]); }
+};
 
-    template<typename T, int N>
-    /// Writes one fixed-rank element from caller-provided storage.
-    void write(const T* v, const std::array<std::size_t, N>& index) {
-        write(v, &index[0]);
+template<typename Op, typename E>
+class LazyUnary final : public LazyBase {
+  private:
+    E e;
+
+  public:
+    using value_type = decltype(Op()(std::declval<typename E::value_type>()));
+    explicit LazyUnary(E e_p) : e(std::move(e_p)) {}
+    void collect(LazyShape& shape) const { e.collect(shape); }
+    void load(std::size_t block, const std::vector<std::size_t>& start, const std::vector<std::size_t>& count) { e.load(block, start, count); }
+    value_type operator[](std::size_t i) const { return Op()(e[i]); }
+};
+
+// results are decayed, `b < a ? b : a` would otherwise return a reference to a parameter for operands of one type
+#define NETCDFPP_IMPL_LAZY_BINARY(name, expr)                                          \
+    struct name {                                                                      \
+        template<typename A, typename B>                                               \
+        auto operator()(A a, B b) const -> typename std::decay<decltype(expr)>::type { \
+            return expr;                                                               \
+        }                                                                              \
+    };
+NETCDFPP_IMPL_LAZY_BINARY(LazyPlus, a + b)
+NETCDFPP_IMPL_LAZY_BINARY(LazyMinus, a - b)
+NETCDFPP_IMPL_LAZY_BINARY(LazyMultiplies, a * b)
+NETCDFPP_IMPL_LAZY_BINARY(LazyDivides, a / b)
+NETCDFPP_IMPL_LAZY_BINARY(LazyMin, b < a ? b : a)
+NETCDFPP_IMPL_LAZY_BINARY(LazyMax, a < b ? b : a)
+NETCDFPP_IMPL_LAZY_BINARY(LazyPow, std::pow(a, b))
+#undef NETCDFPP_IMPL_LAZY_BINARY
+
+#define NETCDFPP_IMPL_LAZY_UNARY(name, expr)              \
+    struct name {                                         \
+        template<typename A>                              \
+        auto operator()(A a) const -> decltype(expr) {    \
+            return expr;                                  \
+        }                                                 \
+    };
+NETCDFPP_IMPL_LAZY_UNARY(LazyNegate, -a)
+NETCDFPP_IMPL_LAZY_UNARY(LazyAbs, std::abs(a))
+NETCDFPP_IMPL_LAZY_UNARY(LazySqrt, std::sqrt(a))
+NETCDFPP_IMPL_LAZY_UNARY(LazyExp, std::exp(a))
+NETCDFPP_IMPL_LAZY_UNARY(LazyLog, std::log(a))
+#undef NETCDFPP_IMPL_LAZY_UNARY
+
+// calls `f(start, count, n)` after loading each block of an expression, at most `limit` values per block
+template<typename E, typename Function>
+void for_each_lazy_block(E& expr, std::size_t limit, Function&& f) {
+    LazyShape shape;
+    expr.collect(shape);
+    if (!shape.known) {
+        throw Exception(NC_EINVAL, "Expression without variables");
+    }
+    const auto ndims = shape.sizes.size();
+    if (product(shape.sizes) == 0) {
+        return;
+    }
+    // grow the chunk shape from the innermost dimension on, in multiples of the chunks
+    auto block = shape.chunks.empty() ? std::vector<std::size_t>(ndims, 1) : shape.chunks;
+    for (std::size_t d = ndims; d > 0; --d) {
+        const auto others = product(block) / block[d - 1];
+        const auto fit = std::max(limit / others, block[d - 1]);
+        block[d - 1] = std::min(shape.sizes[d - 1], fit / block[d - 1] * block[d - 1]);
+    }
+    std::vector<std::size_t> start(ndims, 0);
+    std::vector<std::size_t> count(ndims);
+    for (std::size_t index = 0;; ++index) {
+        for (std::size_t d = 0; d < ndims; ++d) {
+            count[d] = std::min(block[d], shape.sizes[d] - start[d]);
+        }
+        expr.load(index, start, count);
+        f(start, count, product(count));
+        std::size_t d = ndims;
+        while (true) {
+            if (d == 0) {
+                return;
+            }
+            --d;
+            start[d] += block[d];
+            if (start[d] < shape.sizes[d]) {
+                break;
+            }
+            start[d] = 0;
+        }
     }
-    template<typename T, int N>
-    /// Writes a fixed-rank hyperslab from caller-provided storage.
-    void write(const T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count) {
-        write(v, &start[0], &count[0]);
+}
+
+}  // namespace detail
+
+template<typename T>
+/// Leaf of a lazy expression that reads the values of a variable as `T`, see lazy().
+///
+/// Copies share the values read for the current block, so a variable used
+/// several times in an expression is read once per block.
+class LazyVariable final : public detail::LazyBase {
+  private:
+    struct State {
+        Variable variable;
+        std::vector<T> values;
+        std::size_t block;
+    };
+    std::shared_ptr<State> state;
+    const T* data = nullptr;
+
+  public:
+    using value_type = T;
+
+    explicit LazyVariable(Variable v) : state(std::make_shared<State>(State{std::move(v), {}, static_cast<std::size_t>(-1)})) {}
+
+    void collect(detail::LazyShape& shape) const {
+        state->block = static_cast<std::size_t>(-1);  // new evaluation, values or blocks may have changed since the last one
+        const auto sizes = state->variable.sizes();
+        if (!shape.known) {
+            shape.sizes = sizes;
+            shape.chunks = state->variable.get_chunking();
+            shape.path = state->variable.path->get_full_path();
+            shape.known = true;
+        } else if (sizes != shape.sizes) {
+            throw Exception(NC_EINVAL, "Unexpected shape: " + state->variable.path->get_full_path() + " differs from " + shape.path);
+        }
     }
-    template<typename T, int N>
-    /// Writes a fixed-rank strided hyperslab from caller-provided storage.
-    void write(const T* v, const std::array<std::size_t, N>& start, const std::array<std::size_t, N>& count, const std::array<std::ptrdiff_t, N>& stride) {
-        write(v, &start[0], &count[0], &stride[0]);
+
+    // for assign(), the variable written has to have the shape of the expression
+    void check_output(const detail::LazyShape& shape) const {
+        if (shape.known && state->variable.sizes() != shape.sizes) {
+            throw Exception(NC_EEDGE, "Unexpected shape: " + state->variable.path->get_full_path() + " differs from " + shape.path);
+        }
     }
-    template<typename T, int N>
-    /// Writes fixed-rank mapped data from caller-provided storage.
-    void write(const T* v,
-               const std::array<std::size_t, N>& start,
-               const std::array<std::size_t, N>& count,
-               const std::array<std::ptrdiff_t, N>& stride,
-               const std::array<std::ptrdiff_t, N>& imap) {
-        write(v, &start[0], &count[0], &stride[0], &imap[0]);
+
+    void load(std::size_t block, const std::vector<std::size_t>& start, const std::vector<std::size_t>& count) {
+        if (state->block != block) {
+            state->values.resize(detail::product(count));
+            state->variable.read(detail::data_or_null(state->values), detail::data_or_null(start), detail::data_or_null(count));
+            state->block = block;
+        }
+        data = detail::data_or_null(state->values);
     }
 
-    /// Returns the NetCDF type id of the variable.
-    nc_type type() const {
-        nc_type res;
-        check(nc_inq_vartype(path->parent->id, path->id, &res));
-        return res;
+    T operator[](std::size_t i) const { return data[i]; }
+};
+
+template<typename T>
+/// Starts a lazy expression over the values of a variable read as `T`.
+///
+/// Expressions combine variables of the same shape and numbers with `+`,
+/// `-`, `*`, `/`, and the functions in this namespace, e.g.
+/// `sqrt(u * u + v * v)`. Nothing is read until they are evaluated with
+/// assign(), sum(), or reduce(). These go through the variables block by
+/// block, with block boundaries at the chunks of the first variable, and
+/// evaluate the whole expression in one loop per block, so memory use is
+/// bounded by the block size instead of the variable sizes.
+LazyVariable<T> lazy(const Variable& v) {
+    return LazyVariable<T>(v);
+}
+
+#define NETCDFPP_IMPL_LAZY_OPERATOR(op, name)                                                                                                             \
+    template<typename L, typename R>                                                                                                                      \
+    typename std::enable_if<detail::lazy_operands<L, R>::value,                                                                                           \
+                            detail::LazyBinary<detail::name, typename detail::as_lazy<L>::type, typename detail::as_lazy<R>::type>>::type                 \
+    op(const L& l, const R& r) {                                                                                                                          \
+        return detail::LazyBinary<detail::name, typename detail::as_lazy<L>::type, typename detail::as_lazy<R>::type>(detail::as_lazy<L>::get(l),         \
+                                                                                                                    detail::as_lazy<R>::get(r));          \
+    }
+/// Adds lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(operator+, LazyPlus)
+/// Subtracts lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(operator-, LazyMinus)
+/// Multiplies lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(operator*, LazyMultiplies)
+/// Divides lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(operator/, LazyDivides)
+/// Element-wise minimum of lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(min, LazyMin)
+/// Element-wise maximum of lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(max, LazyMax)
+/// Element-wise power of lazy expressions or numbers.
+NETCDFPP_IMPL_LAZY_OPERATOR(pow, LazyPow)
+#undef NETCDFPP_IMPL_LAZY_OPERATOR
+
+#define NETCDFPP_IMPL_LAZY_FUNCTION(op, name)                                                                                    \
+    template<typename E>                                                                                                         \
+    typename std::enable_if<detail::is_lazy<E>::value, detail::LazyUnary<detail::name, E>>::type op(const E& e) {                \
+        return detail::LazyUnary<detail::name, E>(e);                                                                            \
+    }
+/// Negates a lazy expression.
+NETCDFPP_IMPL_LAZY_FUNCTION(operator-, LazyNegate)
+/// Element-wise absolute value of a lazy expression.
+NETCDFPP_IMPL_LAZY_FUNCTION(abs, LazyAbs)
+/// Element-wise square root of a lazy expression.
+NETCDFPP_IMPL_LAZY_FUNCTION(sqrt, LazySqrt)
+/// Element-wise exponential of a lazy expression.
+NETCDFPP_IMPL_LAZY_FUNCTION(exp, LazyExp)
+/// Element-wise natural logarithm of a lazy expression.
+NETCDFPP_IMPL_LAZY_FUNCTION(log, LazyLog)
+#undef NETCDFPP_IMPL_LAZY_FUNCTION
+
+template<typename E>
+/// Evaluates a lazy expression block by block and writes the values to a variable of the same shape.
+///
+/// @throws netCDF::Exception with NC_EEDGE if `out` has another shape.
+void assign(Variable& out, E expr, std::size_t block_size = 1 << 20) {
+    static_assert(detail::is_lazy<E>::value, "Expected a lazy expression");
+    using T = typename E::value_type;
+    detail::LazyShape shape;
+    expr.collect(shape);
+    LazyVariable<T>(out).check_output(shape);
+    std::vector<T> buf;
+    detail::for_each_lazy_block(expr, block_size, [&](const std::vector<std::size_t>& start, const std::vector<std::size_t>& count, std::size_t n) {
+        buf.resize(n);
+        T* p = detail::data_or_null(buf);
+        for (std::size_t i = 0; i < n; ++i) {
+            p[i] = expr[i];
+        }
+        out.write(p, detail::data_or_null(start), detail::data_or_null(count));
+    });
+}
+
+template<typename E, typename R, typename Function>
+/// Folds all values of a lazy expression into `init` with `f(accumulated, value)`, block by block.
+R reduce(E expr, R init, Function f, std::size_t block_size = 1 << 20) {
+    static_assert(detail::is_lazy<E>::value, "Expected a lazy expression");
+    detail::for_each_lazy_block(expr, block_size, [&](const std::vector<std::size_t>&, const std::vector<std::size_t>&, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) {
+            init = f(init, expr[i]);
+        }
+    });
+    return init;
+}
+
+template<typename E>
+/// Sums all values of a lazy expression, block by block.
+typename E::value_type sum(E expr, std::size_t block_size = 1 << 20) {
+    static_assert(detail::is_lazy<E>::value, "Expected a lazy expression");
+    using T = typename E::value_type;
+    T res = T();
+    detail::for_each_lazy_block(expr, block_size, [&](const std::vector<std::size_t>&, const std::vector<std::size_t>&, std::size_t n) {
+        T block = T();
+        for (std::size_t i = 0; i < n; ++i) {
+            block += expr[i];
+        }
+        res += block;
+    });
+    return res;
+}
+
+/// Accessor for CF discrete sampling geometry ragged arrays.
+///
+/// Construct it from the count variable of a contiguous ragged array (the one
+/// with a `sample_dimension` attribute) or from the index variable of an
+/// indexed ragged array (the one with an `instance_dimension` attribute). The
+/// counts or indices are read once. Features are then read from observation
+/// variables with one hyperslab per contiguous run of observations; runs of
+/// features requested together are coalesced.
+class RaggedArray final {
+  private:
+    std::string index_path;
+    std::string sample_dimension_m;
+    std::vector<std::size_t> offsets;       // per feature into observations, or directly into the sample dimension if contiguous
+    std::vector<std::size_t> observations;  // observation indices ordered by feature, only for indexed ragged arrays
+    bool contiguous;
+
+    void check_feature(std::size_t feature) const {
+        if (feature >= feature_count()) {
+            throw Exception(NC_EINVALCOORDS, "Feature index out of range: " + index_path);
+        }
     }
 
-    /// Returns the NetCDF type name of the variable.
-    std::string type_name() const {
-        char name[NC_MAX_NAME + 1];
-        check(nc_inq_type(path->parent->id, type(), name, nullptr));
-        return name;
+    void append_runs(std::size_t feature, std::vector<std::pair<std::size_t, std::size_t>>& runs) const {
+        check_feature(feature);
+        if (contiguous) {
+            const auto begin = offsets[feature];
+            const auto len = offsets[feature + 1] - begin;
+            if (len == 0) {
+                return;
+            }
+            if (!runs.empty() && runs.back().first + runs.back().second == begin) {
+                runs.back().second += len;
+            } else {
+                runs.emplace_back(begin, len);
+            }
+            return;
+        }
+        for (auto i = offsets[feature]; i < offsets[feature + 1]; ++i) {
+            const auto obs = observations[i];
+            if (!runs.empty() && runs.back().first + runs.back().second == obs) {
+                ++runs.back().second;
+            } else {
+                runs.emplace_back(obs, 1);
+            }
+        }
     }
 
-    /// Returns this variable or throws if its NetCDF type name differs.
-    Variable require_type(const std::string& name) const {
-        const auto name_l = type_name();
-        if (name_l != name) {
-            throw Exception(NC_EVARMETA, "Unexpected type '" + name_l + "': " + path->get_full_path());
+    static std::size_t values_per_observation(const Variable& v) {
+        const auto sizes = v.sizes();
+        std::size_t res = 1;
+        for (std::size_t i = 1; i < sizes.size(); ++i) {
+            res *= sizes[i];
         }
-        return *this;
+        return res;
     }
 
     template<typename T>
-    /// Returns this variable or throws if its user-defined type is not a matching compound type.
-    Variable require_compound(std::size_t fieldscount) const {
-        const auto user_type_l = user_type().require();
-        if (user_type_l.typeclass() != NC_COMPOUND) {
-            throw Exception(NC_EVARMETA, "Type '" + user_type_l.name() + "' is not a compound: " + path->get_full_path());
+    void read_runs(const Variable& v, const std::vector<std::pair<std::size_t, std::size_t>>& runs, T* out) const {
+        const auto dims = v.dimensions();
+        if (dims.empty() || dims[0].name() != sample_dimension_m) {
+            throw Exception(NC_EVARMETA, "Unexpected dimensions: " + v.path->get_full_path());
         }
-        if (user_type_l.bytes_size() != sizeof(T) || user_type_l.fieldscount() != fieldscount) {
-            throw Exception(NC_EVARMETA, "Unexpected size for type '" + user_type_l.name() + "': " + path->get_full_path());
+        auto count = v.sizes();
+        std::vector<std::size_t> start(count.size(), 0);
+        const auto inner = values_per_observation(v);
+        for (const auto& run : runs) {
+            start[0] = run.first;
+            count[0] = run.second;
+            v.read(out, detail::data_or_null(start), detail::data_or_null(count));
+            out += run.second * inner;
         }
-        return *this;
     }
 
-    /// Returns the user-defined type for this variable, if it has one.
-    Maybe<UserType> user_type() const {
-        const auto id = type();
-        char name[NC_MAX_NAME + 1];
-        check(nc_inq_type(path->parent->id, id, name, nullptr));
-        auto res = std::make_shared<detail::Path>(detail::Path{name, id, false, path->parent});
-        if (!detail::is_user_type(res->id)) {
-            res->id = -1;
-            res->name = path->name + " not of user type";
+  public:
+    /// Reads the counts or indices of a CF ragged array.
+    ///
+    /// @throws netCDF::Exception if neither a `sample_dimension` nor an
+    /// `instance_dimension` attribute is present or the values are invalid.
+    explicit RaggedArray(const Variable& index) : index_path(index.path->get_full_path()), contiguous(true) {
+        if (const auto att = index.attribute("sample_dimension")) {
+            sample_dimension_m = att.require().get_string();
+            const auto counts = index.get<long long>();
+            offsets.reserve(counts.size() + 1);
+            offsets.push_back(0);
+            for (const auto c : counts) {
+                if (c < 0) {
+                    throw Exception(NC_ERANGE, "Negative count in ragged array: " + index_path);
+                }
+                offsets.push_back(offsets.back() + static_cast<std::size_t>(c));
+            }
+            if (offsets.back() != index.parent().dimension(sample_dimension_m).require().size()) {
+                throw Exception(NC_EEDGE, "Counts do not add up to the sample dimension: " + index_path);
+            }
+        } else if (const auto att = index.attribute("instance_dimension")) {
+            contiguous = false;
+            const auto dims = index.dimensions();
+            if (dims.size() != 1) {
+                throw Exception(NC_EVARMETA, "Unexpected dimensions: " + index_path);
+            }
+            sample_dimension_m = dims[0].name();
+            const auto features = index.parent().dimension(att.require().get_string()).require().size();
+            const auto parents = index.get<long long>();
+            // counting sort of the observations by feature, keeping their order within each feature
+            offsets.assign(features + 1, 0);
+            for (const auto p : parents) {
+                if (p >= 0 && static_cast<std::size_t>(p) < features) {
+                    ++offsets[static_cast<std::size_t>(p) + 1];
+                }
+            }
+            for (std::size_t f = 0; f < features; ++f) {
+                offsets[f + 1] += offsets[f];
+            }
+            observations.resize(offsets.back());
+            auto next = offsets;
+            for (std::size_t i = 0; i < parents.size(); ++i) {
+                const auto p = parents[i];
+                if (p >= 0 && static_cast<std::size_t>(p) < features) {
+                    observations[next[static_cast<std::size_t>(p)]++] = i;
+                }
+            }
+        } else {
+            throw Exception(NC_EVARMETA, "Neither sample_dimension nor instance_dimension attribute found: " + index_path);
+        }
+    }
+
+    /// Returns the name of the observation dimension.
+    const std::string& sample_dimension() const { return sample_dimension_m; }
+
+    /// Returns true for contiguous and false for indexed ragged arrays.
+    bool is_contiguous() const { return contiguous; }
+
+    /// Returns the number of features.
+    std::size_t feature_count() const { return offsets.size() - 1; }
+
+    /// Returns the number of observations of a feature.
+    std::size_t feature_size(std::size_t feature) const {
+        check_feature(feature);
+        return offsets[feature + 1] - offsets[feature];
+    }
+
+    template<typename T>
+    /// Reads the observations of one feature from an observation variable.
+    ///
+    /// The observation dimension has to be the first dimension of `v`; the
+    /// remaining dimensions are read completely.
+    std::vector<T> get(const Variable& v, std::size_t feature) const {
+        std::vector<std::pair<std::size_t, std::size_t>> runs;
+        append_runs(feature, runs);
+        const auto inner = values_per_observation(v);
+        std::vector<T> res(feature_size(feature) * inner);
+        if (!res.empty()) {
+            read_runs(v, runs, detail::data_or_null(res));
+        }
+        return res;
+    }
+
+    template<typename T>
+    /// Reads the observations of several features, coalescing adjacent runs.
+    ///
+    /// Value `i` of the result holds the observations of `features[i]`.
+    VLenArray<T> get(const Variable& v, const std::vector<std::size_t>& features) const {
+        std::vector<std::pair<std::size_t, std::size_t>> runs;
+        VLenArray<T> res;
+        const auto inner = values_per_observation(v);
+        res.offsets_m.reserve(features.size() + 1);
+        for (const auto f : features) {
+            append_runs(f, runs);
+            res.offsets_m.push_back(res.offsets_m.back() + feature_size(f) * inner);
+        }
+        res.values_m.resize(res.offsets_m.back());
+        if (!res.values_m.empty()) {
+            read_runs(v, runs, detail::data_or_null(res.values_m));
         }
-        return Maybe<UserType>(std::move(res));
+        return res;
     }
 };
 
@@ -1585,6 +6218,7 @@ inline void Attribute::copy_values(const Attribute& a) {
     if (!buf.empty()) {
         check(nc_get_att(a.ncid(), a.othid(), a.name().c_str(), detail::data_or_null(buf)));
     }
+    define_mode();
     check(nc_put_att(ncid(), othid(), path->name.c_str(), type_l, oth_size, detail::data_or_null(buf)));
 }
 
@@ -1603,27 +6237,32 @@ inline std::vector<std::string> Attribute::get() const {
 template<>
 inline void Attribute::set(const std::vector<std::string>& v) {
     auto buf = detail::process_string_vector(v);
+    define_mode();
     check(nc_put_att_string(ncid(), othid(), path->name.c_str(), buf.size(), detail::data_or_null(buf)));
 }
 
 template<>
 inline void Attribute::set(const std::vector<const char*>& v) {
+    define_mode();
     check(nc_put_att_string(ncid(), othid(), path->name.c_str(), v.size(), const_cast<const char**>(detail::data_or_null(v))));
 }
 
 template<>
 inline void Attribute::set(const std::vector<char*>& v) {
+    define_mode();
     check(nc_put_att_string(ncid(), othid(), path->name.c_str(), v.size(), const_cast<const char**>(detail::data_or_null(v))));
 }
 
 template<typename T>
 inline void Attribute::set(const std::vector<T>& v, const UserType& type) {
     static_assert(!Type<T>::is_atomic, "Should be of user type");
+    define_mode();
     check(nc_put_att(ncid(), othid(), path->name.c_str(), type.id(), v.size(), detail::data_or_null(v)));
 }
 template<typename T>
 inline void Attribute::set(const T& v, const UserType& type) {
     static_assert(!Type<T>::is_atomic, "Should be of user type");
+    define_mode();
     check(nc_put_att(ncid(), othid(), path->name.c_str(), type.id(), 1, &v));
 }
 
@@ -1631,25 +6270,33 @@ inline Maybe<UserType> Attribute::user_type() const {
     const auto id = type();
     char name[NC_MAX_NAME + 1];
     check(nc_inq_type(path->parent->id, id, name, nullptr));
-    auto res = std::make_shared<detail::Path>(detail::Path{name, id, false, path->parent});
-    if (!detail::is_user_type(res->id)) {
-        res->id = -1;
-        res->name = path->name + " not of user type";
+    if (!detail::is_user_type(id)) {
+        return Maybe<UserType>(detail::make_path(path, path->parent, detail::PathKind::type, (path->name + " not of user type").c_str(), -1));
     }
-    return Maybe<UserType>(std::move(res));
+    return Maybe<UserType>(detail::make_path(path, path->parent, detail::PathKind::type, name, id));
 }
 
-inline Group Dimension::parent() const { return Group(path->parent); }
+inline Group Dimension::parent() const { return Group(parent_path()); }
 
 inline UserType Group::add_type_compound(std::string name, std::size_t bytes_size) {
     int id;
+    define_mode();
     check(nc_def_compound(path->id, bytes_size, name.c_str(), &id));
-    return UserType(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+    return UserType(child_path(detail::PathKind::type, name.c_str(), id));
 }
 template<typename T>
 inline UserType Group::add_type_compound(std::string name) {
     return add_type_compound(std::move(name), sizeof(T));
 }
+template<typename T>
+inline UserType Group::add_type_compound_bound(std::string name) {
+    static_assert(CompoundBinding<T>::is_bound, "Bind the C++ type with NETCDFPP_COMPOUND_BEGIN first");
+    auto res = add_type_compound(std::move(name), sizeof(T));
+    for (const auto& field : CompoundBinding<T>::fields()) {
+        res.add_compound_field(field);
+    }
+    return res;
+}
 
 template<typename T>
 inline UserType Group::add_type_enum(std::string name) {
@@ -1658,14 +6305,16 @@ inline UserType Group::add_type_enum(std::string name) {
 }
 inline UserType Group::add_type_enum(std::string name, nc_type basetype) {
     int id;
+    define_mode();
     check(nc_def_enum(path->id, basetype, name.c_str(), &id));
-    return UserType(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+    return UserType(child_path(detail::PathKind::type, name.c_str(), id));
 }
 
 inline UserType Group::add_type_opaque(std::string name, std::size_t bytes_size) {
     int id;
+    define_mode();
     check(nc_def_opaque(path->id, bytes_size, name.c_str(), &id));
-    return UserType(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+    return UserType(child_path(detail::PathKind::type, name.c_str(), id));
 }
 
 template<typename T>
@@ -1674,8 +6323,9 @@ inline UserType Group::add_type_vlen(std::string name) {
 }
 inline UserType Group::add_type_vlen(std::string name, nc_type basetype) {
     int id;
+    define_mode();
     check(nc_def_vlen(path->id, name.c_str(), basetype, &id));
-    return UserType(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+    return UserType(child_path(detail::PathKind::type, name.c_str(), id));
 }
 
 inline UserType Group::add_user_type(const UserType& t) {
@@ -1690,6 +6340,7 @@ inline UserType Group::add_user_type(const UserType& t) {
             char name[NC_MAX_NAME + 1];
             for (int i = 0; i < static_cast<int>(t.fieldscount()); ++i) {
                 check(nc_inq_enum_member(t.path->parent->id, t.id(), i, name, &buf[0]));
+                define_mode();
                 check(nc_insert_enum(path->id, res.id(), name, &buf[0]));
             }
             return res;
@@ -1697,12 +6348,7 @@ inline UserType Group::add_user_type(const UserType& t) {
         case NC_COMPOUND: {
             auto res = add_type_compound(t.name(), t.bytes_size());
             for (const auto& field : t.compound_fields()) {
-                if (field.dimensions.empty()) {
-                    check(nc_insert_compound(path->id, res.id(), field.name.c_str(), field.offset, field.type));
-                } else {
-                    check(nc_insert_array_compound(path->id, res.id(), field.name.c_str(), field.offset, field.type, static_cast<int>(field.dimensions.size()),
-                                                   detail::data_or_null(field.dimensions)));
-                }
+                res.add_compound_field(field);
             }
             return res;
         }
@@ -1718,8 +6364,18 @@ inline void Group::copy_user_types(const Group& g) {
 }
 
 inline void Group::copy_variables(const Group& g, bool variable_values) {
+    int variables_before;
+    check(nc_inq_nvars(path->id, &variables_before));
+    // define all variables before writing values to avoid redefinitions in classic formats
+    std::vector<std::pair<Variable, Variable>> copies;
     for (const auto& it : g.variables()) {
-        add_variable(it, variable_values);
+        copies.emplace_back(it, add_variable(it, false));
+    }
+    if (variable_values) {
+        const detail::NoFillScope no_fill(path->id, variables_before);
+        for (auto& it : copies) {
+            it.second.copy_values(it.first);
+        }
     }
 }
 
@@ -1748,8 +6404,9 @@ inline Variable Group::add_dimension_variable(const Dimension& d) {
 
 inline Variable Group::add_variable(std::string name, nc_type type, const std::vector<int>& dims) {
     int id;
+    define_mode();
     check(nc_def_var(path->id, name.c_str(), type, static_cast<int>(dims.size()), detail::data_or_null(dims), &id));
-    return Variable(std::make_shared<detail::Path>(detail::Path{std::move(name), id, false, path}));
+    return Variable(child_path(detail::PathKind::variable, name.c_str(), id));
 }
 inline Variable Group::add_variable(std::string name, nc_type type, const std::vector<Dimension>& dims) {
     std::vector<int> dimids(dims.size());
@@ -1785,7 +6442,8 @@ template<>
 inline Variable Group::add_variable<std::string>(std::string name, const std::vector<std::string>& dims) {
     return add_variable(std::move(name), Type<char*>::id, dims);
 }
-inline Variable Group::add_variable(const Variable& v, bool with_values) {
+inline Variable Group::add_variable(const Variable& v, bool with_values) { return add_variable(v, VariableLayout(), with_values); }
+inline Variable Group::add_variable(const Variable& v, const VariableLayout& layout, bool with_values) {
     const auto orig_dims = v.dimensions();
     std::vector<std::string> dims;
     dims.reserve(orig_dims.size());
@@ -1797,13 +6455,46 @@ inline Variable Group::add_variable(const Variable& v, bool with_values) {
     auto res = add_variable(v.name(), type, dims);
     res.copy_attributes(v);
 
-    const auto comp = v.get_compression();
-    res.set_compression(comp.first, comp.second);
+    int format;
+    check(nc_inq_format(path->id, &format));
+    if (format == NC_FORMAT_NETCDF4 || format == NC_FORMAT_NETCDF4_CLASSIC) {
+        // storage settings only exist in NetCDF-4 files
+        int in_format;
+        check(nc_inq_format(v.path->parent->id, &in_format));
+#ifdef NETCDFPP_HAS_FILTERS
+        for (const auto& filter : layout.replace_filters ? layout.filters : v.get_filters()) {
+            if (filter.id != H5Z_FILTER_FLETCHER32) {  // set below
+                res.add_filter(filter.id, filter.params);
+            }
+        }
+        if (in_format == NC_FORMAT_NETCDF4 || in_format == NC_FORMAT_NETCDF4_CLASSIC) {
+            const auto quantization = v.get_quantization();
+            if (quantization.first != NC_NOQUANTIZE) {
+                res.set_quantization(quantization.first, quantization.second);
+            }
+        }
+#else
+        if (layout.replace_filters) {
+            throw Exception(NC_ENOTBUILT, "Replacing filters needs NetCDF-C 4.9: " + res.path->get_full_path());
+        }
+        const auto comp = v.get_compression();
+        res.set_compression(comp.first, comp.second);
+#endif
 
-    res.set_chunking(v.get_chunking());
-    if (v.get_checksum_enabled()) {
-        res.set_checksum_enabled(true);
-    }  // otherwise chunking might get reset
+        if (layout.endianness >= 0) {
+            res.set_endianness(layout.endianness);
+        }
+        if (layout.contiguous) {
+            res.set_chunking({});
+        } else if (!layout.chunks.empty()) {
+            res.set_chunking(layout.chunks);
+        } else {
+            res.set_chunking(v.get_chunking());
+        }
+        if (v.get_checksum_enabled()) {
+            res.set_checksum_enabled(true);
+        }  // otherwise chunking might get reset
+    }
 
     if (!detail::is_user_type(type)) {
         // fill values are handled weirdly by NetCDF
@@ -1812,6 +6503,7 @@ inline Variable Group::add_variable(const Variable& v, bool with_values) {
         int no_fill;
         check(nc_inq_var_fill(v.path->parent->id, v.path->id, &no_fill, nullptr));
         if (no_fill) {
+            define_mode();
             check(nc_def_var_fill(res.path->parent->id, res.path->id, 1, nullptr));
         }
     }
@@ -1837,7 +6529,7 @@ inline std::vector<UserType> Group::user_types() const {
     for (const auto id : ids) {
         if (detail::is_user_type(id)) {
             check(nc_inq_type(path->id, id, name, nullptr));
-            res.emplace_back(UserType(std::make_shared<detail::Path>(detail::Path{name, id, false, path})));
+            res.emplace_back(UserType(child_path(detail::PathKind::type, name, id)));
         }
     }
     return res;
@@ -1858,7 +6550,7 @@ inline std::vector<Variable> Group::variables() const {
     res.reserve(count);
     std::transform(std::begin(ids), std::end(ids), std::back_inserter(res), [&](int id) {
         check(nc_inq_varname(path->id, id, name));
-        return Variable(std::make_shared<detail::Path>(detail::Path{name, id, false, path}));
+        return Variable(child_path(detail::PathKind::variable, name, id));
     });
     return res;
 }
@@ -1869,12 +6561,14 @@ inline std::vector<std::string> Variable::get() const {
     if (buf.empty()) {
         return {};
     }
+    data_mode();
     check(nc_get_var_string(path->parent->id, path->id, detail::data_or_null(buf)));
     return detail::process_char_vector(buf);
 }
 template<>
 inline std::string Variable::get(const std::size_t* index) const {
     char* buf;
+    data_mode();
     check(nc_get_var1_string(path->parent->id, path->id, index, &buf));
     std::string res(buf);
     nc_free_string(1, &buf);
@@ -1886,6 +6580,7 @@ inline std::vector<std::string> Variable::get(const std::size_t* start, const st
     if (buf.empty()) {
         return {};
     }
+    data_mode();
     check(nc_get_vara_string(path->parent->id, path->id, start, count, detail::data_or_null(buf)));
     return detail::process_char_vector(buf);
 }
@@ -1895,6 +6590,7 @@ inline std::vector<std::string> Variable::get(const std::size_t* start, const st
     if (buf.empty()) {
         return {};
     }
+    data_mode();
     check(nc_get_vars_string(path->parent->id, path->id, start, count, stride, detail::data_or_null(buf)));
     return detail::process_char_vector(buf);
 }
@@ -1902,31 +6598,37 @@ inline std::vector<std::string> Variable::get(const std::size_t* start, const st
 template<>
 inline void Variable::set(const std::vector<std::string>& v) {
     auto buf = detail::process_string_vector(v);
+    data_mode();
     check(nc_put_var_string(path->parent->id, path->id, detail::data_or_null(buf)));
 }
 template<>
 inline void Variable::set(const std::string& v, const std::size_t* index) {
     const char* t = v.c_str();
+    data_mode();
     check(nc_put_var1_string(path->parent->id, path->id, index, &t));
 }
 template<>
 inline void Variable::set(const char* v, const std::size_t* index) {
+    data_mode();
     check(nc_put_var1_string(path->parent->id, path->id, index, &v));
 }
 template<>
 inline void Variable::set(const std::vector<std::string>& v, const std::size_t* start, const std::size_t* count) {
     auto buf = detail::process_string_vector(v);
+    data_mode();
     check(nc_put_vara_string(path->parent->id, path->id, start, count, detail::data_or_null(buf)));
 }
 template<>
 inline void Variable::set(const std::vector<std::string>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {
     auto buf = detail::process_string_vector(v);
+    data_mode();
     check(nc_put_vars_string(path->parent->id, path->id, start, count, stride, detail::data_or_null(buf)));
 }
 template<>
 inline void Variable::set(
     const std::vector<std::string>& v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) {
     auto buf = detail::process_string_vector(v);
+    data_mode();
     check(nc_put_varm_string(path->parent->id, path->id, start, count, stride, imap, detail::data_or_null(buf)));
 }
 
@@ -1945,45 +6647,117 @@ inline void Variable::set(
 #define NETCDFPP_IMPL_VARIABLE_READ(type, name)                                                                                                               \
     template<>                                                                                                                                                \
     inline void Variable::read(type* v) const {                                                                                                               \
-        check(nc_get_var##name(path->parent->id, path->id, v));                                                                                               \
+        NETCDFPP_INSTRUMENT_IO(read, *path, value_count() * sizeof(type));                                                                                    \
+        data_mode();                                                                                                                                          \
+        if (!read_converted(v, nullptr, nullptr)) {                                                                                                           \
+            check(nc_get_var##name(path->parent->id, path->id, v));                                                                                           \
+        }                                                                                                                                                     \
     }                                                                                                                                                         \
     template<>                                                                                                                                                \
     inline void Variable::read(type* v, const std::size_t* index) const {                                                                                     \
+        NETCDFPP_INSTRUMENT_IO(read, *path, sizeof(type));                                                                                                    \
+        data_mode();                                                                                                                                          \
         check(nc_get_var1##name(path->parent->id, path->id, index, v));                                                                                       \
     }                                                                                                                                                         \
     template<>                                                                                                                                                \
     inline void Variable::read(type* v, const std::size_t* start, const std::size_t* count) const {                                                           \
-        check(nc_get_vara##name(path->parent->id, path->id, start, count, v));                                                                                \
+        NETCDFPP_INSTRUMENT_IO(read, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                          \
+        if (!read_converted(v, start, count)) {                                                                                                               \
+            check(nc_get_vara##name(path->parent->id, path->id, start, count, v));                                                                            \
+        }                                                                                                                                                     \
     }                                                                                                                                                         \
     template<>                                                                                                                                                \
     inline void Variable::read(type* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) const {                             \
+        NETCDFPP_INSTRUMENT_IO(read, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                          \
         check(nc_get_vars##name(path->parent->id, path->id, start, count, stride, v));                                                                        \
     }                                                                                                                                                         \
     template<>                                                                                                                                                \
     inline void Variable::read(type* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) const { \
+        NETCDFPP_INSTRUMENT_IO(read, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                          \
         check(nc_get_varm##name(path->parent->id, path->id, start, count, stride, imap, v));                                                                  \
+    }                                                                                                                                                         \
+    template<>                                                                                                                                                \
+    inline int Variable::try_read(type* v, const std::size_t* index) const noexcept {                                                                         \
+        NETCDFPP_INSTRUMENT_IO(read, *path, sizeof(type));                                                                                                    \
+        auto ret = try_data_mode();                                                                                                                           \
+        if (ret == NC_NOERR) {                                                                                                                                \
+            ret = nc_get_var1##name(path->parent->id, path->id, index, v);                                                                                    \
+        }                                                                                                                                                     \
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);                                                                                                                 \
+        NETCDFPP_INSTRUMENT_RESULT(ret);                                                                                                                      \
+        return ret;                                                                                                                                           \
+    }                                                                                                                                                         \
+    template<>                                                                                                                                                \
+    inline int Variable::try_read(type* v, const std::size_t* start, const std::size_t* count) const noexcept {                                               \
+        NETCDFPP_INSTRUMENT_IO(read, *path, value_count(count) * sizeof(type));                                                                               \
+        auto ret = try_data_mode();                                                                                                                           \
+        if (ret == NC_NOERR) {                                                                                                                                \
+            ret = nc_get_vara##name(path->parent->id, path->id, start, count, v);                                                                             \
+        }                                                                                                                                                     \
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);                                                                                                                 \
+        NETCDFPP_INSTRUMENT_RESULT(ret);                                                                                                                      \
+        return ret;                                                                                                                                           \
     }
 
 #define NETCDFPP_IMPL_VARIABLE_WRITE(type, name)                                                                                                               \
     template<>                                                                                                                                                 \
     inline void Variable::write(const type* v) {                                                                                                               \
-        check(nc_put_var##name(path->parent->id, path->id, v));                                                                                                \
+        NETCDFPP_INSTRUMENT_IO(write, *path, value_count() * sizeof(type));                                                                                    \
+        data_mode();                                                                                                                                           \
+        if (!write_converted(v, nullptr, nullptr)) {                                                                                                           \
+            check(nc_put_var##name(path->parent->id, path->id, v));                                                                                            \
+        }                                                                                                                                                      \
     }                                                                                                                                                          \
     template<>                                                                                                                                                 \
     inline void Variable::write(const type* v, const std::size_t* index) {                                                                                     \
+        NETCDFPP_INSTRUMENT_IO(write, *path, sizeof(type));                                                                                                    \
+        data_mode();                                                                                                                                           \
         check(nc_put_var1##name(path->parent->id, path->id, index, v));                                                                                        \
     }                                                                                                                                                          \
     template<>                                                                                                                                                 \
     inline void Variable::write(const type* v, const std::size_t* start, const std::size_t* count) {                                                           \
-        check(nc_put_vara##name(path->parent->id, path->id, start, count, v));                                                                                 \
+        NETCDFPP_INSTRUMENT_IO(write, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                           \
+        if (!write_converted(v, start, count)) {                                                                                                               \
+            check(nc_put_vara##name(path->parent->id, path->id, start, count, v));                                                                             \
+        }                                                                                                                                                      \
     }                                                                                                                                                          \
     template<>                                                                                                                                                 \
     inline void Variable::write(const type* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride) {                             \
+        NETCDFPP_INSTRUMENT_IO(write, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                           \
         check(nc_put_vars##name(path->parent->id, path->id, start, count, stride, v));                                                                         \
     }                                                                                                                                                          \
     template<>                                                                                                                                                 \
     inline void Variable::write(const type* v, const std::size_t* start, const std::size_t* count, const std::ptrdiff_t* stride, const std::ptrdiff_t* imap) { \
+        NETCDFPP_INSTRUMENT_IO(write, *path, value_count(count) * sizeof(type));                                                                               \
+        data_mode();                                                                                                                                           \
         check(nc_put_varm##name(path->parent->id, path->id, start, count, stride, imap, v));                                                                   \
+    }                                                                                                                                                          \
+    template<>                                                                                                                                                 \
+    inline int Variable::try_write(const type* v, const std::size_t* index) noexcept {                                                                         \
+        NETCDFPP_INSTRUMENT_IO(write, *path, sizeof(type));                                                                                                    \
+        auto ret = try_data_mode();                                                                                                                            \
+        if (ret == NC_NOERR) {                                                                                                                                 \
+            ret = nc_put_var1##name(path->parent->id, path->id, index, v);                                                                                     \
+        }                                                                                                                                                      \
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);                                                                                                                  \
+        NETCDFPP_INSTRUMENT_RESULT(ret);                                                                                                                       \
+        return ret;                                                                                                                                            \
+    }                                                                                                                                                          \
+    template<>                                                                                                                                                 \
+    inline int Variable::try_write(const type* v, const std::size_t* start, const std::size_t* count) noexcept {                                               \
+        NETCDFPP_INSTRUMENT_IO(write, *path, value_count(count) * sizeof(type));                                                                               \
+        auto ret = try_data_mode();                                                                                                                            \
+        if (ret == NC_NOERR) {                                                                                                                                 \
+            ret = nc_put_vara##name(path->parent->id, path->id, start, count, v);                                                                              \
+        }                                                                                                                                                      \
+        NETCDFPP_INSTRUMENT_CALL(*path, ret);                                                                                                                  \
+        NETCDFPP_INSTRUMENT_RESULT(ret);                                                                                                                       \
+        return ret;                                                                                                                                            \
     }
 
 #define NETCDFPP_IMPL_ALL(type, name)       \
@@ -4,6 +4,9 @@
 
 #include "netcdfpp.h"
 
+#include <fstream>
+#include <sstream>
+
 struct TypeCompound {
     char c;
     int i[3][2];
@@ -19,6 +22,19 @@ struct TypeOpaque {
     bool operator==(const TypeOpaque& rhs) const { return c == rhs.c; }
 };
 
+struct BoundCompound {
+    double d;
+    short s[2];
+    char c;
+    bool operator==(const BoundCompound& rhs) const { return d == rhs.d && s[0] == rhs.s[0] && s[1] == rhs.s[1] && c == rhs.c; }
+};
+
+NETCDFPP_COMPOUND_BEGIN(BoundCompound)
+NETCDFPP_COMPOUND_FIELD(d)
+NETCDFPP_COMPOUND_FIELD(s)
+NETCDFPP_COMPOUND_FIELD(c)
+NETCDFPP_COMPOUND_END()
+
 enum class Enum : int {
     E1 = 1,
     E2 = 2,
@@ -29,7 +45,10 @@ namespace netCDF {
 namespace testing {
 struct TestUserType {
     static netCDF::UserType create() {
-        netCDF::UserType res(std::make_shared<netCDF::detail::Path>(netCDF::detail::Path{"fake_user_type", 0, true, nullptr}));
+        // like all paths but those of files, the path has a parent, as Path::root() relies on
+        const auto file = std::make_shared<netCDF::detail::FilePath>();
+        file->name = "fake.nc";
+        netCDF::UserType res(netCDF::detail::make_path(file, file.get(), netCDF::detail::PathKind::type, "fake_user_type", 0));
         res.fields_read = true;
         res.typeclass_m = NC_INT;
         return res;
@@ -225,7 +244,7 @@ TEST_CASE("appending") {
     file.variable("var_non_existent").require().rename("var_long_renamed");
     file.attribute("att_non_existent").require().rename("att_renamed");
 
-    REQUIRE_THROWS_WITH_AS(file.add_user_type(netCDF::testing::TestUserType::create()), "Invalid user type class: fake_user_type", netCDF::Exception);
+    REQUIRE_THROWS_WITH_AS(file.add_user_type(netCDF::testing::TestUserType::create()), "Invalid user type class: fake.nc:fake_user_type", netCDF::Exception);
 }
 
 TEST_CASE("empty and scalar objects") {
@@ -298,6 +317,1381 @@ TEST_CASE("dimension variables") {
     }
 }
 
+TEST_CASE("compound binding") {
+    {
+        netCDF::File file("test_compound_binding.nc", 'w');
+        file.add_dimension("n", 2);
+
+        auto type_bound = file.add_type_compound_bound<BoundCompound>("type_bound");
+        REQUIRE(type_bound.bytes_size() == sizeof(BoundCompound));
+        REQUIRE(type_bound.fieldscount() == 3);
+        auto var_bound = file.add_variable("var_bound", type_bound, {"n"});
+        const auto plan = var_bound.compound_plan<BoundCompound>();
+        REQUIRE(plan.is_direct());
+        var_bound.set_compound<BoundCompound>({{1.5, {1, 2}, 'a'}, {2.5, {3, 4}, 'b'}}, plan);
+
+        // packed layout with different field order and an additional field
+        auto type_packed = file.add_type_compound("type_packed", 17);
+        type_packed.add_compound_field<char>("c", 0);
+        type_packed.add_compound_field_array<short[2]>("s", 1, {2});
+        type_packed.add_compound_field<double>("d", 5);
+        type_packed.add_compound_field<int>("extra", 13);
+        auto var_packed = file.add_variable("var_packed", type_packed, {"n"});
+        const auto packed_plan = var_packed.compound_plan<BoundCompound>();
+        REQUIRE(!packed_plan.is_direct());
+        REQUIRE(packed_plan.file_bytes_size() == 17);
+        var_packed.set_compound<BoundCompound, 1>({{4.5, {7, 8}, 'd'}}, packed_plan, {1}, {1});
+        var_packed.set_compound<BoundCompound, 1>({{3.5, {5, 6}, 'c'}}, packed_plan, {0}, {1});
+
+        auto type_wrong = file.add_type_compound("type_wrong", sizeof(BoundCompound));
+        type_wrong.add_compound_field<float>("d", 0);
+        REQUIRE_THROWS_WITH_AS(netCDF::CompoundPlan<BoundCompound>{type_wrong}, "Unexpected type for compound field 'd': test_compound_binding.nc:type_wrong",
+                               netCDF::Exception);
+        auto type_missing = file.add_type_compound("type_missing", sizeof(double));
+        type_missing.add_compound_field<double>("d", 0);
+        REQUIRE_THROWS_WITH_AS(netCDF::CompoundPlan<BoundCompound>{type_missing}, "Compound field 's' not found: test_compound_binding.nc:type_missing",
+                               netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(file.add_variable<int>("var_int", {"n"}).compound_plan<BoundCompound>(),
+                               "UserType not found: test_compound_binding.nc:var_int not of user type", netCDF::Exception);
+    }
+
+    {
+        netCDF::File file("test_compound_binding.nc", 'r');
+        const auto var_bound = file.variable("var_bound").require();
+        REQUIRE(var_bound.get_compound(var_bound.compound_plan<BoundCompound>()) == std::vector<BoundCompound>{{1.5, {1, 2}, 'a'}, {2.5, {3, 4}, 'b'}});
+        REQUIRE(var_bound.get<BoundCompound>() == std::vector<BoundCompound>{{1.5, {1, 2}, 'a'}, {2.5, {3, 4}, 'b'}});
+
+        const auto var_packed = file.variable("var_packed").require();
+        const auto packed_plan = var_packed.compound_plan<BoundCompound>();
+        REQUIRE(var_packed.get_compound(packed_plan) == std::vector<BoundCompound>{{3.5, {5, 6}, 'c'}, {4.5, {7, 8}, 'd'}});
+        REQUIRE(var_packed.get_compound<BoundCompound, 1>(packed_plan, {1}, {1}) == std::vector<BoundCompound>{{4.5, {7, 8}, 'd'}});
+    }
+}
+
+TEST_CASE("compound columns") {
+    {
+        netCDF::File file("test_compound_columns.nc", 'w');
+        file.add_dimension("n", 3);
+        auto type_compound = file.add_type_compound<TypeCompound>("type_compound");
+        type_compound.add_compound_field<decltype(TypeCompound::c)>("c", offsetof(TypeCompound, c));
+        type_compound.add_compound_field_array<decltype(TypeCompound::i)>("i", offsetof(TypeCompound, i), {3, 2});
+        type_compound.add_compound_field<decltype(TypeCompound::d)>("d", offsetof(TypeCompound, d));
+        auto var_compound = file.add_variable("var_compound", type_compound, {"n"});
+
+        netCDF::CompoundColumns columns(type_compound);
+        columns.resize(3);
+        for (std::size_t k = 0; k < 3; ++k) {
+            columns.column<char>("c")[k] = static_cast<char>('a' + k);
+            columns.column<double>("d")[k] = 0.5 * k;
+            for (int j = 0; j < 6; ++j) {
+                columns.column<int>("i")[6 * k + j] = static_cast<int>(10 * k) + j;
+            }
+        }
+        var_compound.write_columns(columns);
+        REQUIRE_THROWS_WITH_AS(columns.column<float>("d"), "Unexpected type for compound field 'd': test_compound_columns.nc:type_compound", netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(columns.column<float>("x"), "Compound field 'x' not found: test_compound_columns.nc:type_compound", netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(var_compound.write_columns<1>(columns, {0}, {2}), "Column size does not match hyperslab: test_compound_columns.nc:var_compound",
+                               netCDF::Exception);
+
+        // type ids are only unique within a file
+        netCDF::File other_file("test_compound_columns_other.nc", 'w');
+        auto type_other = other_file.add_type_compound("type_other", sizeof(double));
+        type_other.add_compound_field<double>("d", 0);
+        REQUIRE(type_other.id() == type_compound.id());
+        netCDF::CompoundColumns other_columns(type_other);
+        other_columns.resize(3);
+        REQUIRE_THROWS_WITH_AS(var_compound.write_columns(other_columns), "Unexpected compound type for columns: test_compound_columns.nc:var_compound",
+                               netCDF::Exception);
+    }
+
+    {
+        netCDF::File file("test_compound_columns.nc", 'r');
+        const auto var_compound = file.variable("var_compound").require();
+        REQUIRE(var_compound.get<TypeCompound>()
+                == std::vector<TypeCompound>{{'a', {{0, 1}, {2, 3}, {4, 5}}, 0.0}, {'b', {{10, 11}, {12, 13}, {14, 15}}, 0.5}, {'c', {{20, 21}, {22, 23}, {24, 25}}, 1.0}});
+
+        netCDF::CompoundColumns columns(file.user_type("type_compound").require());
+        REQUIRE(columns.fields().size() == 3);
+        var_compound.read_columns<1>(columns, {1}, {2});
+        REQUIRE(columns.size() == 2);
+        const auto& const_columns = columns;
+        REQUIRE(std::vector<double>(const_columns.column<double>("d"), const_columns.column<double>("d") + 2) == std::vector<double>{0.5, 1.0});
+        REQUIRE(std::vector<char>(columns.column<char>("c"), columns.column<char>("c") + 2) == std::vector<char>{'b', 'c'});
+        REQUIRE(columns.column<int>("i")[11] == 25);
+    }
+}
+
+TEST_CASE("vlen arrays") {
+    {
+        netCDF::File file("test_vlen_arrays.nc", 'w');
+        file.add_dimension("n", 3);
+        auto type_vlen = file.add_type_vlen<int>("type_vlen");
+        auto var_vlen = file.add_variable("var_vlen", type_vlen, {"n"});
+
+        netCDF::VLenArray<int> values;
+        values.push_back({1, 2, 3});
+        values.push_back({});
+        values.push_back({4, 5});
+        var_vlen.set_vlen(values);
+        REQUIRE_THROWS_WITH_AS((var_vlen.set_vlen<int, 1>(values, {0}, {2})), "Ragged array size does not match hyperslab: test_vlen_arrays.nc:var_vlen",
+                               netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(var_vlen.get_vlen<double>(), "Unexpected base type for type 'type_vlen': test_vlen_arrays.nc:var_vlen", netCDF::Exception);
+    }
+
+    {
+        netCDF::File file("test_vlen_arrays.nc", 'r');
+        const auto var_vlen = file.variable("var_vlen").require().require_vlen<int>();
+        const auto values = var_vlen.get_vlen<int>();
+        REQUIRE(values.size() == 3);
+        REQUIRE(values.values() == std::vector<int>{1, 2, 3, 4, 5});
+        REQUIRE(values.offsets() == std::vector<std::size_t>{0, 3, 3, 5});
+        REQUIRE(values.length(1) == 0);
+        REQUIRE(std::vector<int>(values.begin(2), values.end(2)) == std::vector<int>{4, 5});
+
+        auto part = var_vlen.get_vlen<int, 1>({1}, {2});
+        REQUIRE(part.values() == std::vector<int>{4, 5});
+        REQUIRE(part.offsets() == std::vector<std::size_t>{0, 0, 2});
+        part.clear();
+        REQUIRE(part.empty());
+    }
+}
+
+TEST_CASE("ragged arrays") {
+    {
+        netCDF::File file("test_ragged_arrays.nc", 'w');
+        file.add_dimension("station", 3);
+        file.add_dimension("obs", 6);
+        file.add_dimension("two", 2);
+
+        auto row_size = file.add_variable<int>("row_size", {"station"});
+        row_size.add_attribute("sample_dimension").set<std::string>("obs");
+        row_size.set<int>({2, 3, 1});
+        auto wrong_row_size = file.add_variable<int>("wrong_row_size", {"station"});
+        wrong_row_size.add_attribute("sample_dimension").set<std::string>("obs");
+        wrong_row_size.set<int>({2, 3, 2});
+
+        auto parent_index = file.add_variable<int>("parent_index", {"obs"});
+        parent_index.add_attribute("instance_dimension").set<std::string>("station");
+        parent_index.set<int>({1, 0, 1, 2, 0, 1});
+
+        file.add_variable<double>("temperature", {"obs"}).set<double>({0.0, 1.0, 2.0, 3.0, 4.0, 5.0});
+        file.add_variable<int>("profile", std::vector<std::string>{"obs", "two"}).set<int>({0, 1, 10, 11, 20, 21, 30, 31, 40, 41, 50, 51});
+        file.add_variable<int>("station_id", {"station"}).set<int>({7, 8, 9});
+    }
+
+    {
+        netCDF::File file("test_ragged_arrays.nc", 'r');
+        const auto temperature = file.variable("temperature").require();
+        const auto profile = file.variable("profile").require();
+
+        const netCDF::RaggedArray contiguous(file.variable("row_size").require());
+        REQUIRE(contiguous.is_contiguous());
+        REQUIRE(contiguous.sample_dimension() == "obs");
+        REQUIRE(contiguous.feature_count() == 3);
+        REQUIRE(contiguous.feature_size(1) == 3);
+        REQUIRE(contiguous.get<double>(temperature, 1) == std::vector<double>{2.0, 3.0, 4.0});
+        REQUIRE(contiguous.get<int>(profile, 2) == std::vector<int>{50, 51});
+        {
+            const auto batch = contiguous.get<double>(temperature, {2, 0, 1});
+            REQUIRE(batch.offsets() == std::vector<std::size_t>{0, 1, 3, 6});
+            REQUIRE(batch.values() == std::vector<double>{5.0, 0.0, 1.0, 2.0, 3.0, 4.0});
+        }
+        REQUIRE_THROWS_WITH_AS(contiguous.feature_size(3), "Feature index out of range: test_ragged_arrays.nc:row_size", netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(contiguous.get<int>(file.variable("station_id").require(), 0), "Unexpected dimensions: test_ragged_arrays.nc:station_id",
+                               netCDF::Exception);
+
+        const netCDF::RaggedArray indexed(file.variable("parent_index").require());
+        REQUIRE(!indexed.is_contiguous());
+        REQUIRE(indexed.sample_dimension() == "obs");
+        REQUIRE(indexed.feature_count() == 3);
+        REQUIRE(indexed.get<double>(temperature, 1) == std::vector<double>{0.0, 2.0, 5.0});
+        REQUIRE(indexed.get<int>(profile, 0) == std::vector<int>{10, 11, 40, 41});
+        {
+            const auto batch = indexed.get<double>(temperature, {0, 2});
+            REQUIRE(batch.offsets() == std::vector<std::size_t>{0, 2, 3});
+            REQUIRE(batch.values() == std::vector<double>{1.0, 4.0, 3.0});
+        }
+
+        REQUIRE_THROWS_WITH_AS(netCDF::RaggedArray{file.variable("wrong_row_size").require()},
+                               "Counts do not add up to the sample dimension: test_ragged_arrays.nc:wrong_row_size", netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(netCDF::RaggedArray{temperature}, "Neither sample_dimension nor instance_dimension attribute found: test_ragged_arrays.nc:temperature",
+                               netCDF::Exception);
+    }
+}
+
+TEST_CASE("file options") {
+    const auto file_size = [](const char* filename) { return static_cast<std::size_t>(std::ifstream(filename, std::ios::binary | std::ios::ate).tellg()); };
+
+    for (const auto format : {NC_FORMAT_CLASSIC, NC_FORMAT_64BIT_OFFSET, NC_FORMAT_CDF5, NC_FORMAT_NETCDF4_CLASSIC}) {
+        {
+            netCDF::FileOptions options;
+            options.format = format;
+            options.header_free = 4096;
+            netCDF::File file("test_file_options.nc", 'w', options);
+            REQUIRE(file.format() == format);
+            file.add_dimension("x", 3);
+            auto v = file.add_variable<int>("v", {"x"});
+            v.set<int>({1, 2, 3});
+            v.add_attribute("units").set<std::string>("m");  // back to define mode
+            file.add_variable<double>("w", {"x"}).set<double>({0.5, 1.5, 2.5});
+        }
+        const auto size = file_size("test_file_options.nc");
+
+        {
+            netCDF::File file("test_file_options.nc", 'a');
+            file.add_attribute("title").set<std::string>("file options");
+            REQUIRE(file.variable("v").require().get<int>() == std::vector<int>{1, 2, 3});
+        }
+        if (format != NC_FORMAT_NETCDF4_CLASSIC) {
+            REQUIRE(file_size("test_file_options.nc") == size);  // header had enough free space
+        }
+
+        {
+            netCDF::File file("test_file_options.nc", 'r');
+            REQUIRE(file.format() == format);
+            REQUIRE(file.attribute("title").require().get_string() == "file options");
+            REQUIRE(file.variable("v").require().attribute("units").require().get_string() == "m");
+            REQUIRE(file.variable("w").require().get<double>() == std::vector<double>{0.5, 1.5, 2.5});
+        }
+    }
+
+    netCDF::FileOptions options;
+    options.clobber = false;
+    REQUIRE_THROWS_AS(netCDF::File("test_file_options.nc", 'w', options), netCDF::Exception);
+    options.format = -1;
+    REQUIRE_THROWS_WITH_AS(netCDF::File("test_file_options_unknown.nc", 'w', options), "Unknown file format: test_file_options_unknown.nc", netCDF::Exception);
+}
+
+TEST_CASE("define scopes") {
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_CLASSIC;
+    options.max_redefinitions = 1;
+    {
+        netCDF::File file("test_define_scopes.nc", 'w', options);
+        file.add_dimension("x", 2);
+        file.add_variable<int>("a", {"x"}).set<int>({1, 2});
+        {
+            auto scope = file.define();
+            for (const auto name : {"b", "c", "d"}) {
+                file.add_variable<int>(name, {"x"}).add_attribute("units").set<std::string>("m");
+            }
+            REQUIRE_THROWS_WITH_AS(file.variable("a").require().get<int>(), "Values accessed in define scope: test_define_scopes.nc:a", netCDF::Exception);
+            scope.end();
+        }
+        REQUIRE(file.redefinitions() == 0);
+        file.variable("b").require().set<int>({3, 4});
+
+        file.add_attribute("first").set<std::string>("implicit");
+        REQUIRE(file.redefinitions() == 1);
+        file.variable("c").require().set<int>({5, 6});
+        REQUIRE_THROWS_WITH_AS(file.add_attribute("second").set<std::string>("implicit"), "Too many implicit redefinitions: test_define_scopes.nc:second",
+                               netCDF::Exception);
+        {
+            auto outer = file.define();
+            auto inner = file.define();
+            file.add_attribute("third").set<std::string>("scoped");
+        }
+        file.variable("d").require().set<int>({7, 8});
+    }
+
+    {
+        netCDF::File file("test_define_scopes.nc", 'r');
+        REQUIRE(file.variable("d").require().get<int>() == std::vector<int>{7, 8});
+        REQUIRE(file.variable("b").require().attribute("units").require().get_string() == "m");
+        REQUIRE(file.attribute("third").require().get_string() == "scoped");
+        REQUIRE(!file.attribute("second"));
+    }
+}
+
+TEST_CASE("fill mode") {
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_64BIT_OFFSET;
+    {
+        netCDF::File file("test_fill_mode.nc", 'w', options);
+        REQUIRE(file.set_fill_mode(NC_NOFILL) == NC_FILL);
+        REQUIRE(file.set_fill_mode(NC_FILL) == NC_NOFILL);
+        file.add_dimension("time");
+        file.add_dimension("x", 3);
+        file.add_variable<int>("fixed", {"x"}).set<int>({1, 2, 3});
+        file.add_variable<double>("record", std::vector<std::string>{"time", "x"}).set<double, 2>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}, {0, 0}, {2, 3});
+        file.add_variable<short>("other_record", {"time"}).set<short>({7, 8});
+    }
+
+    {
+        netCDF::File infile("test_fill_mode.nc", 'r');
+        netCDF::File outfile("test_fill_mode_copy.nc", 'w', options);
+        outfile.copy_from(infile, true);
+        REQUIRE(outfile.set_fill_mode(NC_FILL) == NC_FILL);  // restored after copying
+    }
+
+    {
+        netCDF::File file("test_fill_mode_copy.nc", 'r');
+        REQUIRE(file.variable("fixed").require().get<int>() == std::vector<int>{1, 2, 3});
+        REQUIRE(file.variable("record").require().get<double>() == std::vector<double>{1.0, 2.0, 3.0, 4.0, 5.0, 6.0});
+        REQUIRE(file.variable("other_record").require().get<short>() == std::vector<short>{7, 8});
+    }
+
+    // copying into a file with other record variables keeps prefilling their new records
+    {
+        netCDF::File infile("test_fill_mode.nc", 'r');
+        netCDF::File outfile("test_fill_mode_partial.nc", 'w', options);
+        outfile.add_dimension("time");
+        outfile.add_dimension("x", 3);
+        outfile.add_variable<int>("existing", {"time"});
+        outfile.copy_variables(infile, true);
+        REQUIRE(outfile.variable("record").require().get<double>() == std::vector<double>{1.0, 2.0, 3.0, 4.0, 5.0, 6.0});
+        REQUIRE(outfile.variable("existing").require().get<int>() == std::vector<int>(2, NC_FILL_INT));
+    }
+}
+
+TEST_CASE("batched reads") {
+    std::vector<int> values(6 * 8);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i);
+    }
+    {
+        netCDF::File file("test_batched_reads.nc", 'w');
+        file.add_dimension("y", 6);
+        file.add_dimension("x", 8);
+        file.add_variable<int>("contiguous", std::vector<std::string>{"y", "x"}).set<int>(values);
+        auto chunked = file.add_variable<int>("chunked", std::vector<std::string>{"y", "x"});
+        chunked.set_chunking({3, 4});
+        chunked.set<int>(values);
+    }
+
+    {
+        netCDF::File file("test_batched_reads.nc", 'r');
+        const std::vector<netCDF::Hyperslab> slabs = {
+            {{4, 6}, {2, 2}},  // alone
+            {{0, 0}, {2, 3}},  // overlaps the next one
+            {{1, 2}, {1, 3}},  //
+            {{2, 0}, {1, 1}},  // adjacent to the first cluster
+            {{3, 3}, {0, 2}},  // empty
+        };
+        const std::vector<std::vector<int>> expected = {{38, 39, 46, 47}, {0, 1, 2, 8, 9, 10}, {10, 11, 12}, {16}, {}};
+        REQUIRE(file.variable("contiguous").require().get_batch<int>(slabs) == expected);
+        REQUIRE(file.variable("chunked").require().get_batch<int>(slabs) == expected);
+
+        std::vector<int> a(2);
+        std::vector<int> b(2);
+        file.variable("chunked").require().read_batch<int>({{{0, 0}, {1, 2}}, {{2, 6}, {1, 2}}}, {a.data(), b.data()});
+        REQUIRE(a == std::vector<int>{0, 1});
+        REQUIRE(b == std::vector<int>{22, 23});
+
+        REQUIRE_THROWS_WITH_AS(file.variable("contiguous").require().get_batch<int>({{{0}, {1}}}), "Unexpected hyperslab rank: test_batched_reads.nc:contiguous",
+                               netCDF::Exception);
+
+#ifdef NETCDFPP_WITH_INSTRUMENTATION
+        // a row of points through two chunks is merged up to the memory limit only
+        std::vector<netCDF::Hyperslab> row;
+        std::vector<std::vector<int>> row_expected;
+        for (std::size_t x = 8; x > 0; --x) {
+            row.push_back({{0, x - 1}, {1, 1}});
+            row_expected.push_back({static_cast<int>(x - 1)});
+        }
+        const auto reads = [&](std::size_t max_memory) {
+            netCDF::IOStatistics statistics;
+            netCDF::set_instrumentation_sink(&statistics);
+            REQUIRE(file.variable("chunked").require().get_batch<int>(row, max_memory) == row_expected);
+            netCDF::set_instrumentation_sink(nullptr);
+            return statistics.file_counters().at(0).reads;
+        };
+        REQUIRE(reads(1 << 24) == 1);
+        REQUIRE(reads(4 * sizeof(int)) == 2);
+        REQUIRE(reads(3 * sizeof(int)) == 3);
+#endif
+    }
+}
+
+TEST_CASE("point reads") {
+    std::vector<double> values(5 * 7);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<double>(i);
+    }
+    {
+        netCDF::File file("test_point_reads.nc", 'w');
+        file.add_dimension("y", 5);
+        file.add_dimension("x", 7);
+        file.add_variable<double>("contiguous", std::vector<std::string>{"y", "x"}).set<double>(values);
+        auto chunked = file.add_variable<double>("chunked", std::vector<std::string>{"y", "x"});
+        chunked.set_chunking({2, 3});
+        chunked.set<double>(values);
+        file.add_variable<int>("scalar", std::vector<std::string>{}).set<int>({42});
+    }
+
+    {
+        netCDF::File file("test_point_reads.nc", 'r');
+        const std::vector<std::size_t> indices = {4, 6, 0, 0, 1, 2, 0, 1, 4, 6, 3, 0};
+        const std::vector<double> expected = {34.0, 0.0, 9.0, 1.0, 34.0, 21.0};
+        REQUIRE(file.variable("contiguous").require().get_points<double>(indices) == expected);
+        REQUIRE(file.variable("chunked").require().get_points<double>(indices) == expected);
+        REQUIRE(file.variable("chunked").require().get_points<double>({}).empty());
+        REQUIRE(file.variable("scalar").require().get_points<int>({0, 0}) == std::vector<int>{42, 42});
+
+        REQUIRE_THROWS_WITH_AS(file.variable("chunked").require().get_points<double>({1, 2, 3}),
+                               "Unexpected number of point indices: test_point_reads.nc:chunked", netCDF::Exception);
+        REQUIRE_THROWS_AS(file.variable("chunked").require().get_points<double>({5, 0}), netCDF::Exception);
+    }
+}
+
+TEST_CASE("partitions") {
+    netCDF::File file("test_partitions.nc", 'w');
+    file.add_dimension("x", 10);
+    file.add_dimension("y", 2);
+    auto contiguous = file.add_variable<int>("contiguous", std::vector<std::string>{"x", "y"});
+    auto chunked = file.add_variable<int>("chunked", std::vector<std::string>{"x", "y"});
+    chunked.set_chunking({3, 2});
+
+    std::vector<std::size_t> starts;
+    std::vector<std::size_t> counts;
+    for (std::size_t part = 0; part < 4; ++part) {
+        const auto slab = chunked.partition(part, 4);
+        REQUIRE(slab.start.size() == 2);
+        REQUIRE(slab.count[1] == 2);
+        starts.push_back(slab.start[0]);
+        counts.push_back(slab.count[0]);
+    }
+    REQUIRE(starts == std::vector<std::size_t>{0, 3, 6, 9});
+    REQUIRE(counts == std::vector<std::size_t>{3, 3, 3, 1});
+
+    REQUIRE(contiguous.partition(1, 3).start[0] == 4);
+    REQUIRE(contiguous.partition(1, 3).count[0] == 3);
+    REQUIRE(contiguous.partition(2, 3).count[0] == 3);
+    REQUIRE(contiguous.partition(0, 3).count[0] == 4);
+    REQUIRE(chunked.partition(3, 6).count[0] == 1);
+    REQUIRE(chunked.partition(4, 6).count[0] == 0);
+
+    REQUIRE_THROWS_WITH_AS(chunked.partition(4, 4), "Part out of range: test_partitions.nc:chunked", netCDF::Exception);
+    REQUIRE_THROWS_WITH_AS(file.add_variable<int>("scalar", std::vector<std::string>{}).partition(0, 1),
+                           "Cannot partition scalar variable: test_partitions.nc:scalar", netCDF::Exception);
+}
+
+#ifdef NETCDFPP_HAS_PROCESSES
+TEST_CASE("process reads") {
+    std::vector<int> values(3 * 40 * 50);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i);
+    }
+    {
+        netCDF::File file("test_process_reads.nc", 'w');
+        file.add_dimension("z", 3);
+        file.add_dimension("y", 40);
+        file.add_dimension("x", 50);
+        auto chunked = file.add_group("group").add_variable<int>("chunked", std::vector<std::string>{"z", "y", "x"});
+        chunked.set_chunking({1, 7, 50});
+        chunked.set_compression(true, 1);
+        chunked.set<int>(values);
+        file.add_variable<int>("contiguous", std::vector<std::string>{"z", "y", "x"}).set<int>(values);
+        file.add_variable<double>("large", std::vector<std::string>{"z"}).set<double>({1.0, 1e20, 2.0});
+    }
+
+    {
+        netCDF::File file("test_process_reads.nc", 'r');
+        const netCDF::ProcessReader reader(4);
+        REQUIRE(reader.processes() == 4);
+        const auto chunked = file.group("group").require().variable("chunked").require();
+        const auto contiguous = file.variable("contiguous").require();
+        REQUIRE(reader.get<int>(chunked) == values);
+        REQUIRE(reader.get<int>(contiguous) == values);
+
+        // split along y as only one z is read
+        const std::array<std::size_t, 3> start = {1, 3, 5};
+        const std::array<std::size_t, 3> count = {1, 30, 40};
+        std::vector<int> expected(30 * 40);
+        chunked.read(expected.data(), start.data(), count.data());
+        std::vector<int> res(expected.size());
+        reader.read(chunked, res.data(), start.data(), count.data());
+        REQUIRE(res == expected);
+
+        // split along y with full z, not contiguous in the output
+        const std::array<std::size_t, 3> start2 = {0, 3, 5};
+        const std::array<std::size_t, 3> count2 = {3, 30, 40};
+        expected.resize(3 * 30 * 40);
+        res.resize(expected.size());
+        chunked.read(expected.data(), start2.data(), count2.data());
+        reader.read(chunked, res.data(), start2.data(), count2.data());
+        REQUIRE(res == expected);
+
+        REQUIRE(netCDF::ProcessReader(1).get<int>(chunked) == values);
+
+        try {
+            reader.get<int>(file.variable("large").require());
+            FAIL("no exception");
+        } catch (const netCDF::Exception& e) {
+            REQUIRE(e.return_code() == NC_ERANGE);
+        }
+    }
+}
+#endif
+
+#ifdef NETCDFPP_WITH_HDF5
+TEST_CASE("direct chunk io") {
+    std::vector<int> values(6 * 30 * 40);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<int>(i % 1000);
+    }
+    const netCDF::DirectChunkIO io(3);
+    REQUIRE(io.threads() == 3);
+
+    netCDF::File file("test_direct_chunks.nc", 'w');
+    file.add_dimension("z", 6);
+    file.add_dimension("y", 30);
+    file.add_dimension("x", 40);
+    auto group = file.add_group("group");
+    auto compressed = group.add_variable<int>("compressed", std::vector<std::string>{"z", "y", "x"});
+    compressed.set_chunking({2, 7, 16});
+    compressed.set_compression(true, 2);
+    compressed.set<int>(values);
+    auto checked = file.add_variable<int>("checked", std::vector<std::string>{"z", "y", "x"});
+    checked.set_checksum_enabled(true);
+    checked.set<int>(values);
+    auto written = file.add_variable<int>("written", std::vector<std::string>{"z", "y", "x"});
+    written.set_chunking({4, 8, 8});
+    written.set_compression(false, 4);
+    written.set_fill<int>(-1);
+
+    REQUIRE(io.supported<int>(compressed));
+    REQUIRE(!io.supported<double>(compressed));
+    REQUIRE(!io.supported<int>(checked));
+    REQUIRE(io.get<int>(compressed) == values);
+    REQUIRE(io.get<int>(checked) == values);
+    REQUIRE(io.get<double>(compressed)[999] == 999.0);
+
+    const std::array<std::size_t, 3> start = {1, 3, 5};
+    const std::array<std::size_t, 3> count = {4, 20, 30};
+    std::vector<int> expected(4 * 20 * 30);
+    compressed.read(expected.data(), start.data(), count.data());
+    std::vector<int> res(expected.size());
+    io.read(compressed, res.data(), start.data(), count.data());
+    REQUIRE(res == expected);
+
+    // partly written chunks keep the fill value or earlier values
+    io.write(written, expected.data(), start.data(), count.data());
+    std::fill(std::begin(res), std::end(res), 0);
+    written.read(res.data(), start.data(), count.data());
+    REQUIRE(res == expected);
+    auto all = written.get<int>();
+    REQUIRE(all[0] == -1);
+    REQUIRE(all.back() == -1);
+    REQUIRE(io.get<int>(written) == all);
+
+    const std::array<std::size_t, 3> zero = {0, 0, 0};
+    const std::array<std::size_t, 3> shape = {6, 30, 40};
+    io.write(written, values.data(), zero.data(), shape.data());
+    REQUIRE(written.get<int>() == values);
+
+    const std::array<std::size_t, 3> beyond = {6, 31, 40};
+    REQUIRE_THROWS_AS(io.read(compressed, res.data(), zero.data(), beyond.data()), netCDF::Exception);
+
+    // classic model files are still in define mode after adding a variable
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_NETCDF4_CLASSIC;
+    netCDF::File classic("test_direct_chunks_classic.nc", 'w', options);
+    classic.add_dimension("x", 40);
+    auto v = classic.add_variable<int>("v", {"x"});
+    v.set_chunking({16});
+    v.set_compression(true, 1);
+    const std::size_t n = 40;
+    io.write(v, values.data(), zero.data(), &n);
+    REQUIRE(v.get<int>() == std::vector<int>(values.begin(), values.begin() + 40));
+}
+#endif
+
+TEST_CASE("type conversion") {
+    std::vector<short> shorts(200);
+    for (std::size_t i = 0; i < shorts.size(); ++i) {
+        shorts[i] = static_cast<short>(static_cast<int>(i) * 300 - 30000);
+    }
+    std::vector<double> doubles(shorts.size());
+    std::transform(std::begin(shorts), std::end(shorts), std::begin(doubles), [](short s) { return s / 4.0; });
+
+    netCDF::File file("test_type_conversion.nc", 'w');
+    file.add_dimension("x", shorts.size());
+    auto s = file.add_variable<short>("short", std::vector<std::string>{"x"});
+    s.set<short>(shorts);
+    auto d = file.add_variable<double>("double", std::vector<std::string>{"x"});
+    auto f = file.add_variable<float>("float", std::vector<std::string>{"x"});
+    auto i64 = file.add_variable<long long>("int64", std::vector<std::string>{"x"});
+
+    // bulk conversion gives the same values as NetCDF-C element by element
+    const auto as_double = s.get<double>();
+    const auto as_int = s.get<int>();
+    for (std::size_t i = 0; i < shorts.size(); i += 17) {
+        REQUIRE(as_double[i] == s.get<double, 1>({i}));
+        REQUIRE(as_int[i] == s.get<int, 1>({i}));
+    }
+    std::vector<float> part(100);
+    const std::size_t start = 50;
+    const std::size_t count = 100;
+    s.read(part.data(), &start, &count);
+    REQUIRE(part[0] == static_cast<float>(shorts[50]));
+    REQUIRE(part[99] == static_cast<float>(shorts[149]));
+
+    // contiguous variables are converted in blocks
+    {
+        file.add_dimension("z", 3);
+        file.add_dimension("y", 300);
+        auto grid = file.add_variable<short>("grid", std::vector<std::string>{"z", "y", "x"});
+        std::vector<short> values(3 * 300 * shorts.size());
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<short>(i % 30000);
+        }
+        grid.set<short>(values);
+        const std::array<std::size_t, 3> grid_start = {1, 1, 20};
+        const std::array<std::size_t, 3> grid_count = {2, 299, 150};
+        std::vector<short> expected(2 * 299 * 150);
+        std::vector<int> converted(expected.size());
+        grid.read(expected.data(), grid_start.data(), grid_count.data());
+        grid.read(converted.data(), grid_start.data(), grid_count.data());
+        REQUIRE(std::equal(std::begin(expected), std::end(expected), std::begin(converted)));
+        std::transform(std::begin(converted), std::end(converted), std::begin(converted), [](int v) { return v + 1; });
+        grid.write(converted.data(), grid_start.data(), grid_count.data());
+        grid.read(expected.data(), grid_start.data(), grid_count.data());
+        REQUIRE(expected[0] == values[300 * 200 + 200 + 20] + 1);
+        REQUIRE(std::equal(std::begin(expected), std::end(expected), std::begin(converted)));
+    }
+
+    d.set<float>(std::vector<float>(std::begin(doubles), std::end(doubles)));
+    REQUIRE(d.get<double>() == doubles);
+    f.set<double>(doubles);
+    REQUIRE(f.get<double>() == doubles);
+    i64.set<double>(doubles);
+    REQUIRE(i64.get<short>()[1] == static_cast<short>(doubles[1]));
+
+    // out of range values are converted by NetCDF-C, the others in bulk, and then throw like NetCDF-C does
+    std::vector<unsigned short> res(shorts.size());
+    try {
+        s.read(res.data());
+        FAIL("no exception");
+    } catch (const netCDF::Exception& e) {
+        REQUIRE(e.return_code() == NC_ERANGE);
+        REQUIRE(std::string(e.what()) == "NetCDF: Numeric conversion not representable: test_type_conversion.nc:short");
+    }
+    std::vector<unsigned short> expected(shorts.size());
+    REQUIRE(nc_get_var_ushort(file.id(), s.id(), expected.data()) == NC_ERANGE);
+    REQUIRE(res == expected);
+    REQUIRE(res.back() == static_cast<unsigned short>(shorts.back()));
+
+    auto large = doubles;
+    large[3] = 1e300;
+    large[4] = 1e19;
+    REQUIRE_THROWS_WITH_AS(f.set<double>(large), "NetCDF: Numeric conversion not representable: test_type_conversion.nc:float", netCDF::Exception);
+    REQUIRE(std::isinf(f.get<float>()[3]));
+    REQUIRE_THROWS_AS(i64.set<double>(large), netCDF::Exception);
+    auto i64_c = file.add_variable<long long>("int64_c", std::vector<std::string>{"x"});
+    REQUIRE(nc_put_var_double(file.id(), i64_c.id(), large.data()) == NC_ERANGE);
+    REQUIRE(i64.get<long long>() == i64_c.get<long long>());
+    REQUIRE(i64.get<long long>()[5] == static_cast<long long>(doubles[5]));
+
+    // classic formats store the fill value instead, whatever the number of values
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_CLASSIC;
+    netCDF::File classic("test_type_conversion_classic.nc", 'w', options);
+    classic.add_dimension("x", 64);
+    auto c = classic.add_variable<short>("short", std::vector<std::string>{"x"});
+    const std::vector<double> too_large(64, 1e6);
+    const std::size_t begin = 0;
+    std::size_t n = 63;
+    REQUIRE_THROWS_AS(c.write(too_large.data(), &begin, &n), netCDF::Exception);
+    REQUIRE(c.get<short, 1>({0}) == NC_FILL_SHORT);
+    n = 64;
+    REQUIRE_THROWS_AS(c.write(too_large.data(), &begin, &n), netCDF::Exception);
+    REQUIRE(c.get<short>() == std::vector<short>(64, NC_FILL_SHORT));
+
+    // NetCDF-C does not report NaN converted to integers, so neither bulk conversion nor the small transfers left to it throw
+    auto nan = doubles;
+    nan[0] = std::numeric_limits<double>::quiet_NaN();
+    d.set<double>(nan);
+    std::vector<int> expected_ints(nan.size());
+    REQUIRE(nc_get_var_int(file.id(), d.id(), expected_ints.data()) == NC_NOERR);
+    for (const std::size_t size : {std::size_t{10}, nan.size()}) {
+        const std::size_t first = 0;
+        std::vector<int> ints(size);
+        d.read(ints.data(), &first, &size);
+        REQUIRE(std::equal(ints.begin(), ints.end(), expected_ints.begin()));
+        i64.write(nan.data(), &first, &size);
+        REQUIRE(i64.get<long long, 1>({size - 1}) == static_cast<long long>(nan[size - 1]));
+    }
+}
+
+struct AnyBytes {
+    template<typename T>
+    std::size_t operator()(netCDF::AnyArray::View<const T> v) const {
+        return v.size() * sizeof(T);
+    }
+};
+
+TEST_CASE("any arrays") {
+    {
+        netCDF::File file("test_any_arrays.nc", 'w');
+        file.add_dimension("y", 3);
+        file.add_dimension("x", 4);
+        file.add_variable<short>("short", std::vector<std::string>{"y", "x"}).set<short>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+        file.add_variable<std::string>("string", std::vector<std::string>{"x"}).set<std::string>({"a", "bb", "ccc", "dddd"});
+        auto point = file.add_type_compound_bound<BoundCompound>("BoundCompound");
+        file.add_variable("compound", point, {"x"}).set<BoundCompound>({{1.0, {1, 2}, 'a'}, {2.0, {3, 4}, 'b'}, {3.0, {5, 6}, 'c'}, {4.0, {7, 8}, 'd'}});
+        netCDF::VLenArray<int> ints;
+        for (int i = 0; i < 4; ++i) {
+            ints.push_back(std::vector<int>(static_cast<std::size_t>(i), i));
+        }
+        file.add_variable("ints", file.add_type_vlen<int>("Ints"), {"x"}).set_vlen(ints);
+    }
+
+    netCDF::File in("test_any_arrays.nc", 'r');
+    const auto shorts = in.variable("short").require().read_any({1, 1}, {2, 3});
+    REQUIRE(shorts.type() == NC_SHORT);
+    REQUIRE(shorts.element_size() == sizeof(short));
+    REQUIRE(shorts.size() == 6);
+    REQUIRE(shorts.is<short>());
+    REQUIRE(!shorts.is<int>());
+    const auto view = shorts.view<short>();
+    REQUIRE(std::vector<short>(view.begin(), view.end()) == std::vector<short>{5, 6, 7, 9, 10, 11});
+    REQUIRE(static_cast<const short*>(shorts.data()) == view.data());
+    REQUIRE(shorts.visit<std::size_t>(AnyBytes()) == 6 * sizeof(short));
+    REQUIRE_THROWS_WITH_AS(shorts.view<int>(), "Unexpected type", netCDF::Exception);
+    REQUIRE_THROWS_WITH_AS(in.variable("short").require().read_any({1}, {2}), "Unexpected hyperslab rank: test_any_arrays.nc:short", netCDF::Exception);
+
+    auto strings = in.variable("string").require().read_any();
+    REQUIRE(std::string(strings.view<char*>()[2]) == "ccc");
+    const netCDF::AnyArray moved = std::move(strings);
+    REQUIRE(strings.size() == 0);
+    REQUIRE(std::string(moved.view<char*>()[3]) == "dddd");
+
+    const auto compounds = in.variable("compound").require().read_any();
+    REQUIRE(compounds.type_class() == NC_COMPOUND);
+    REQUIRE(compounds.view<BoundCompound>()[1] == BoundCompound{2.0, {3, 4}, 'b'});
+    REQUIRE_THROWS_AS(compounds.visit<std::size_t>(AnyBytes()), std::runtime_error);
+
+    {
+        netCDF::File out("test_any_arrays_copy.nc", 'w');
+        out.add_dimension("y", 3);
+        out.add_dimension("x", 4);
+        out.add_type_compound_bound<BoundCompound>("BoundCompound");
+        auto s = out.add_variable<short>("short", std::vector<std::string>{"y", "x"});
+        s.write_any(shorts, {0, 0}, {2, 3});
+        REQUIRE(s.get<short, 2>({1, 2}) == 11);
+        REQUIRE_THROWS_WITH_AS(s.write_any(shorts, {0, 0}, {2, 2}), "Unexpected number of values: test_any_arrays_copy.nc:short", netCDF::Exception);
+        REQUIRE_THROWS_WITH_AS(out.add_variable<int>("int", std::vector<std::string>{"x"}).write_any(moved), "Unexpected type: test_any_arrays_copy.nc:int",
+                               netCDF::Exception);
+        out.add_variable<std::string>("string", std::vector<std::string>{"x"}).write_any(moved);
+        out.add_variable("compound", out.user_type("BoundCompound").require(), {"x"}).write_any(compounds);
+
+        // user-defined types of the same class and size, but another layout
+        auto other_compound = out.add_type_compound("OtherCompound", sizeof(BoundCompound));
+        other_compound.add_compound_field<double>("value", 0);
+        REQUIRE_THROWS_WITH_AS(out.add_variable("other_compound", other_compound, {"x"}).write_any(compounds),
+                               "Unexpected type: test_any_arrays_copy.nc:other_compound", netCDF::Exception);
+        const auto ints = in.variable("ints").require().read_any();
+        REQUIRE_THROWS_WITH_AS(out.add_variable("doubles", out.add_type_vlen<double>("Doubles"), {"x"}).write_any(ints),
+                               "Unexpected type: test_any_arrays_copy.nc:doubles", netCDF::Exception);
+        out.add_variable("ints", out.add_type_vlen<int>("Ints"), {"x"}).write_any(ints);
+    }
+    netCDF::File copy("test_any_arrays_copy.nc", 'r');
+    REQUIRE(copy.variable("string").require().get<std::string>() == std::vector<std::string>{"a", "bb", "ccc", "dddd"});
+    REQUIRE(copy.variable("compound").require().get<BoundCompound>()[3] == BoundCompound{4.0, {7, 8}, 'd'});
+    const auto ints = copy.variable("ints").require().get_vlen<int>();
+    REQUIRE(std::vector<int>(ints.begin(3), ints.end(3)) == std::vector<int>{3, 3, 3});
+}
+
+TEST_CASE("lazy expressions") {
+    netCDF::File file("test_lazy_expressions.nc", 'w');
+    file.add_dimension("y", 30);
+    file.add_dimension("x", 40);
+    const std::vector<std::string> dims{"y", "x"};
+    auto u = file.add_variable<float>("u", dims);
+    u.set_chunking({7, 16});
+    auto v = file.add_variable<short>("v", dims);
+    auto speed = file.add_variable<double>("speed", dims);
+    std::vector<float> us(30 * 40);
+    std::vector<short> vs(us.size());
+    for (std::size_t i = 0; i < us.size(); ++i) {
+        us[i] = static_cast<float>(i % 37) - 18.5f;
+        vs[i] = static_cast<short>(i % 11) - 5;
+    }
+    u.set<float>(us);
+    v.set<short>(vs);
+
+    // small blocks so that blocks end inside chunks and rows
+    const auto lu = netCDF::lazy<double>(u);
+    const auto lv = netCDF::lazy<double>(v);
+    netCDF::assign(speed, sqrt(lu * lu + lv * lv), 100);
+    const auto res = speed.get<double>();
+    for (std::size_t i = 0; i < us.size(); ++i) {
+        REQUIRE(res[i] == std::sqrt(static_cast<double>(us[i]) * us[i] + static_cast<double>(vs[i]) * vs[i]));
+    }
+
+    double expected = 0;
+    float largest = -1;
+    for (std::size_t i = 0; i < us.size(); ++i) {
+        expected += 2 * std::abs(us[i]) - 1;
+        largest = std::max(largest, std::abs(us[i]) / 2);
+    }
+    REQUIRE(netCDF::sum(2.0 * abs(lu) - 1, 64) == expected);
+    REQUIRE(netCDF::reduce(abs(netCDF::lazy<float>(u)) / 2, -1.0f, [](float a, float b) { return std::max(a, b); }) == largest);
+    REQUIRE(netCDF::sum(netCDF::min(netCDF::lazy<int>(v), 0) + netCDF::max(netCDF::lazy<int>(v), 0) - netCDF::lazy<int>(v)) == 0);
+    int negative = 0;
+    for (const auto x : vs) {
+        negative += std::min(static_cast<int>(x), 0);
+    }
+    REQUIRE(netCDF::sum(netCDF::min(netCDF::lazy<int>(v), 0)) == negative);
+
+    // evaluating again reads the current values
+    const auto once = netCDF::sum(lu);
+    std::transform(std::begin(us), std::end(us), std::begin(us), [](float x) { return 2 * x; });
+    u.set<float>(us);
+    REQUIRE(netCDF::sum(lu) == 2 * once);
+    REQUIRE(netCDF::sum(lu, 100) == 2 * once);
+
+    file.add_dimension("z", 3);
+    auto other = file.add_variable<float>("other", std::vector<std::string>{"z", "x"});
+    REQUIRE_THROWS_WITH_AS(netCDF::sum(lu + netCDF::lazy<double>(other)), "Unexpected shape: test_lazy_expressions.nc:other differs from test_lazy_expressions.nc:u", netCDF::Exception);
+    try {
+        netCDF::assign(other, lu * 2);
+        FAIL("no exception");
+    } catch (const netCDF::Exception& e) {
+        REQUIRE(e.return_code() == NC_EEDGE);
+        REQUIRE(std::string(e.what()) == "Unexpected shape: test_lazy_expressions.nc:other differs from test_lazy_expressions.nc:u");
+    }
+}
+
+TEST_CASE("aggregations") {
+    const std::vector<std::size_t> records{2, 0, 3};
+    std::vector<std::string> filenames;
+    for (std::size_t i = 0, first = 0; i < records.size(); first += records[i], ++i) {
+        filenames.push_back("test_aggregation_" + std::to_string(i) + ".nc");
+        netCDF::File file(filenames.back(), 'w');
+        file.add_dimension("time");
+        file.add_dimension("x", 4);
+        auto lon = file.add_variable<double>("lon", std::vector<std::string>{"x"});
+        lon.set<double>({0, 90, 180, 270});
+        auto t = file.add_group("fields").add_variable<int>("t", std::vector<std::string>{"time", "x"});
+        auto transposed = file.add_variable<int>("transposed", std::vector<std::string>{"x", "time"});
+        std::vector<int> values(records[i] * 4);
+        std::vector<int> transposed_values(values.size());
+        for (std::size_t r = 0; r < records[i]; ++r) {
+            for (std::size_t x = 0; x < 4; ++x) {
+                values[r * 4 + x] = static_cast<int>((first + r) * 10 + x);
+                transposed_values[x * records[i] + r] = values[r * 4 + x];
+            }
+        }
+        const std::array<std::size_t, 2> start = {0, 0};
+        const std::array<std::size_t, 2> count = {records[i], 4};
+        const std::array<std::size_t, 2> transposed_count = {4, records[i]};
+        t.write(values.data(), start.data(), count.data());
+        transposed.write(transposed_values.data(), start.data(), transposed_count.data());
+    }
+
+    netCDF::Aggregation aggregation(filenames, "time", 1);
+    REQUIRE(aggregation.size() == 5);
+    REQUIRE(aggregation.records() == records);
+    REQUIRE(aggregation.file_index(2) == 2);
+    REQUIRE(aggregation.open_file_count() == 1);
+
+    const auto t = aggregation.variable("fields/t");
+    REQUIRE(t.aggregated());
+    REQUIRE((t.sizes() == std::vector<std::size_t>{5, 4}));
+    const auto all = t.get<int>();
+    for (std::size_t r = 0; r < 5; ++r) {
+        REQUIRE(all[r * 4 + 3] == static_cast<int>(r * 10 + 3));
+    }
+
+    // only the files covering the records are read, and the handle cache stays bounded
+    std::array<int, 4> part{};
+    const std::array<std::size_t, 2> start = {1, 1};
+    const std::array<std::size_t, 2> count = {2, 2};
+    t.read(part.data(), start.data(), count.data());
+    REQUIRE((part == std::array<int, 4>{11, 12, 21, 22}));
+    REQUIRE(aggregation.open_file_count() == 1);
+
+    const auto transposed = aggregation.variable("transposed");
+    const std::array<std::size_t, 2> transposed_start = {2, 1};
+    const std::array<std::size_t, 2> transposed_count = {2, 3};
+    std::array<int, 6> transposed_part{};
+    transposed.read(transposed_part.data(), transposed_start.data(), transposed_count.data());
+    REQUIRE((transposed_part == std::array<int, 6>{12, 22, 32, 13, 23, 33}));
+
+    const auto lon = aggregation.variable("lon");
+    REQUIRE_FALSE(lon.aggregated());
+    REQUIRE((lon.get<double>() == std::vector<double>{0, 90, 180, 270}));
+
+    // a known index does not open any files
+    netCDF::Aggregation indexed(filenames, "time", records);
+    REQUIRE(indexed.open_file_count() == 0);
+    REQUIRE(indexed.variable("fields/t").get<int>() == all);
+    const std::array<std::size_t, 2> beyond = {4, 2};
+    REQUIRE_THROWS_AS(t.read(part.data(), beyond.data(), count.data()), netCDF::Exception);
+
+    // variables keep the aggregation state alive after it is moved from or destroyed
+    std::unique_ptr<netCDF::AggregatedVariable> kept;
+    {
+        netCDF::Aggregation moved(std::move(indexed));
+        kept.reset(new netCDF::AggregatedVariable(moved.variable("fields/t")));
+    }
+    REQUIRE(kept->get<int>() == all);
+
+#ifdef NETCDFPP_HAS_PROCESSES
+    netCDF::ProcessReader reader(2);
+    REQUIRE(reader.get<int>(t) == all);
+    std::vector<int> transposed_all(5 * 4);
+    const std::array<std::size_t, 2> zero = {0, 0};
+    const std::array<std::size_t, 2> transposed_sizes = {4, 5};
+    reader.read(transposed, transposed_all.data(), zero.data(), transposed_sizes.data());
+    REQUIRE(transposed_all[1 * 5 + 4] == 41);
+#endif
+}
+
+TEST_CASE("polling") {
+    netCDF::FileOptions options;
+    options.format = NC_FORMAT_CLASSIC;
+    options.share = true;
+    netCDF::File writer("test_polling.nc", 'w', options);
+    writer.add_dimension("time");
+    writer.add_dimension("x", 3);
+    auto t = writer.add_variable<int>("t", std::vector<std::string>{"time", "x"});
+    const auto append = [&](std::size_t first, std::size_t n) {
+        std::vector<int> values(n * 3, static_cast<int>(first));
+        const std::array<std::size_t, 2> start = {first, 0};
+        const std::array<std::size_t, 2> count = {n, 3};
+        t.write(values.data(), start.data(), count.data());
+        writer.sync();
+    };
+    append(0, 2);
+
+    netCDF::File reader("test_polling.nc", 'r', options);
+    const auto time = reader.dimension("time").require();
+    REQUIRE(time.size() == 2);
+    auto polled = reader.poll();
+    REQUIRE(polled.size() == 1);
+    REQUIRE(polled[0].first.name() == "time");
+    REQUIRE((polled[0].second.begin == 0 && polled[0].second.end == 2));
+    REQUIRE(reader.poll().empty());
+
+    append(2, 3);
+    polled = reader.poll();
+    REQUIRE(polled.size() == 1);
+    REQUIRE((polled[0].second.begin == 2 && polled[0].second.count() == 3));
+    REQUIRE(time.size() == 2);  // cached
+    const auto range = time.refresh();
+    REQUIRE((range.begin == 2 && range.end == 5));
+    REQUIRE(time.size() == 5);
+    REQUIRE(time.refresh().empty());
+    REQUIRE(reader.variable("t").require().get<int, 2>({4, 1}) == 2);
+}
+
+#ifdef NETCDFPP_WITH_INSTRUMENTATION
+TEST_CASE("instrumentation") {
+    netCDF::File file("test_instrumentation.nc", 'w');
+    file.add_dimension("x", 100);
+    auto v = file.add_variable<float>("v", std::vector<std::string>{"x"});
+    v.set_chunking({10});
+    std::vector<float> values(100, 1.0f);
+
+    netCDF::IOStatistics statistics;
+    REQUIRE(netCDF::set_instrumentation_sink(&statistics) == nullptr);
+    v.write(values.data());
+    std::size_t start = 10;
+    std::size_t count = 20;
+    v.read(values.data(), &start, &count);
+    REQUIRE(v.get<float, 1>({5}) == 1.0f);
+    start = 95;
+    REQUIRE_THROWS_AS(v.read(values.data(), &start, &count), netCDF::Exception);
+    REQUIRE(netCDF::set_instrumentation_sink(nullptr) == &statistics);
+    v.get<float>();
+
+    const auto counters = statistics.counters();
+    const auto it = std::find_if(std::begin(counters), std::end(counters), [](const netCDF::IOCounters& c) { return c.path == "test_instrumentation.nc:v"; });
+    REQUIRE(it != std::end(counters));
+    REQUIRE(it->writes == 1);
+    REQUIRE(it->bytes_written == 400);
+    REQUIRE(it->reads == 3);
+    REQUIRE(it->bytes_read == 84);  // nothing for the failed read
+    REQUIRE(it->calls >= 4);
+    REQUIRE(it->errors == 1);
+    REQUIRE(it->seconds > 0);
+    REQUIRE(it->chunk_cache_size > 0);
+
+    const auto files = statistics.file_counters();
+    REQUIRE(files.size() == 1);
+    REQUIRE(files[0].path == "test_instrumentation.nc");
+    REQUIRE(files[0].bytes_written == 400);
+    REQUIRE(files[0].calls >= it->calls);
+    statistics.reset();
+    REQUIRE(statistics.counters().empty());
+
+    // operations report their outcome, and computing their bytes makes no calls
+    struct Outcomes : netCDF::InstrumentationSink {
+        std::vector<int> reads;
+        std::size_t calls = 0;
+        void record(const netCDF::IOEvent& event) override {
+            if (event.operation == netCDF::IOOperation::read) {
+                reads.push_back(event.return_code);
+            } else if (event.operation == netCDF::IOOperation::call) {
+                ++calls;
+            }
+        }
+    } outcomes;
+    netCDF::set_instrumentation_sink(&outcomes);
+    v.read(values.data());
+    REQUIRE_THROWS_AS(v.read(values.data(), &start, &count), netCDF::Exception);
+    REQUIRE(v.try_read(values.data(), &start, &count) == NC_EEDGE);
+    netCDF::set_instrumentation_sink(nullptr);
+    REQUIRE(outcomes.reads == std::vector<int>{NC_NOERR, NC_EEDGE, NC_EEDGE});
+    REQUIRE(outcomes.calls == 5);  // two for the full read, two for the failed one, and the returned error
+}
+
+TEST_CASE("tracing") {
+    netCDF::ChromeTracer tracer(4);
+    netCDF::set_instrumentation_sink(&tracer);
+    {
+        netCDF::File file("test_tracing.nc", 'w');
+        file.add_dimension("x", 10);
+        auto v = file.add_variable<int>("v", std::vector<std::string>{"x"});
+        v.set<int>(std::vector<int>(10, 1));
+        file.sync();
+        netCDF::File copy("test_tracing_copy.nc", 'w');
+        copy.copy_from(file, true);
+    }
+    netCDF::set_instrumentation_sink(nullptr);
+
+    // the newest events of this thread: copying the variable and the file, then closing both files
+    REQUIRE(tracer.size() == 4);
+    std::ostringstream json;
+    tracer.write_json(json);
+    const auto trace = json.str();
+    REQUIRE(trace.find("{\"name\": \"copy\", \"cat\": \"netcdf\", \"ph\": \"X\", \"ts\": ") != std::string::npos);
+    REQUIRE(trace.find("\"args\": {\"path\": \"test_tracing_copy.nc:v\", \"bytes\": 40}}") != std::string::npos);
+    REQUIRE(trace.find("\"name\": \"close\"") != std::string::npos);
+    REQUIRE(trace.find("\"name\": \"read\"") == std::string::npos);
+    tracer.clear();
+    REQUIRE(tracer.size() == 0);
+
+    // switching between tracers keeps one ring per tracer and thread
+    netCDF::ChromeTracer other(4);
+    {
+        netCDF::File file("test_tracing.nc", 'a');
+        for (int i = 0; i < 3; ++i) {
+            netCDF::set_instrumentation_sink(&tracer);
+            file.sync();
+            file.sync();
+            netCDF::set_instrumentation_sink(&other);
+            file.sync();
+        }
+        netCDF::set_instrumentation_sink(nullptr);
+    }
+    REQUIRE(tracer.size() == 4);
+    REQUIRE(other.size() == 3);
+
+    // other threads get their own ring, long paths keep their end
+    tracer.clear();
+    {
+        netCDF::File file("test_tracing.nc", 'w');
+        auto v = file.add_group(std::string(60, 'g')).add_variable<int>(std::string(60, 'v'), std::vector<std::string>{});
+        netCDF::set_instrumentation_sink(&tracer);
+        std::thread writer([&]() { v.set<int>({1}); });
+        writer.join();
+        netCDF::set_instrumentation_sink(nullptr);
+    }
+    REQUIRE(tracer.size() == 1);
+    json.str("");
+    tracer.write_json(json);
+    REQUIRE(json.str().find("\"tid\": 2, \"args\": {\"path\": \"..." + std::string(35, 'g') + "/" + std::string(60, 'v') + "\", \"bytes\": 4}}")
+            != std::string::npos);
+
+    // events are dropped instead of throwing from noexcept functions if a ring cannot be allocated
+    netCDF::ChromeTracer too_large(std::numeric_limits<std::size_t>::max() / 2);
+    {
+        netCDF::File file("test_tracing.nc", 'r');
+        const auto v = file.group(std::string(60, 'g')).require().variable(std::string(60, 'v')).require();
+        int value = 0;
+        netCDF::set_instrumentation_sink(&too_large);
+        REQUIRE(v.try_read(&value, nullptr) == NC_NOERR);
+        netCDF::set_instrumentation_sink(nullptr);
+        REQUIRE(value == 1);
+    }
+    REQUIRE(too_large.size() == 0);
+}
+#endif
+
+TEST_CASE("error results") {
+    netCDF::File file("test_error_results.nc", 'w');
+    file.add_dimension("x", 4);
+    auto v = file.add_group("g").add_variable<int>("v", std::vector<std::string>{"x"});
+    const std::array<int, 4> values = {1, 2, 3, 4};
+    std::size_t start = 0;
+    std::size_t count = 4;
+    REQUIRE(v.try_write(values.data(), &start, &count) == NC_NOERR);
+    std::array<double, 4> read{};
+    REQUIRE(v.try_read(read.data(), &start, &count) == NC_NOERR);
+    REQUIRE(read[3] == 4.0);
+
+    start = 2;
+    REQUIRE(v.try_read(read.data(), &start, &count) == NC_EEDGE);
+    std::size_t index = 9;
+    int one;
+    static_assert(noexcept(v.try_read(&one, &index)), "try_read must not throw");
+    REQUIRE(v.try_read(&one, &index) == NC_EINVALCOORDS);
+    REQUIRE(v.try_write(&one, &index) == NC_EINVALCOORDS);
+
+    // messages are formatted when first asked for
+    try {
+        file.group("g").require().variable("missing").require();
+        FAIL("no exception");
+    } catch (const netCDF::Exception& e) {
+        REQUIRE(e.return_code() == NC_ENOTFOUND);
+        REQUIRE(std::string(e.what()) == "Variable not found: test_error_results.nc:g/missing");
+    }
+    REQUIRE_THROWS_WITH_AS(v.read(read.data(), &start, &count), "NetCDF: Start+count exceeds dimension bound: test_error_results.nc:g/v", netCDF::Exception);
+}
+
+TEST_CASE("object paths") {
+    const auto b = [] {
+        netCDF::File file("test_object_paths.nc", 'w');
+        file.add_dimension("x", 2);
+        file.add_variable<int>("r", std::vector<std::string>{"x"});
+        auto g = file.add_group("g");
+        g.add_variable<int>("a", std::vector<std::string>{"x"});
+        g.add_variable<int>("b", std::vector<std::string>{"x"});
+        auto a = g.variable("a").require();
+        a.rename("c");
+        const auto variables = g.variables();
+        REQUIRE(variables.size() == 2);
+        REQUIRE(variables[0].name() == "c");
+        REQUIRE(variables[1].name() == "b");
+        REQUIRE(variables[0].dimensions()[0].name() == "x");
+        REQUIRE(variables[0].parent().name() == "g");
+        return variables[1];
+    }();
+    // handles keep their paths after the file is gone
+    REQUIRE(b.name() == "b");
+    REQUIRE_THROWS_WITH_AS(b.dimension_count(), "NetCDF: Not a valid ID: test_object_paths.nc:g/b", netCDF::Exception);
+
+    netCDF::File file("test_object_paths.nc", 'r');
+    const auto r = file.variable("r").require();
+    REQUIRE(file.group("g").require().variables()[0].name() == "c");
+    file.open("test_object_paths_reopened.nc", 'w');
+    file.add_dimension("y", 1);
+    file.add_variable<int>("s", std::vector<std::string>{"y"});
+    REQUIRE(file.variables()[0].name() == "s");
+    REQUIRE(r.name() == "r");
+
+    // ids renumbered behind the back of the handles, here by deleting an attribute
+    file.add_attribute("p").set<int>(1);
+    file.add_attribute("q").set<int>(2);
+    const auto p = file.attributes()[0];
+    REQUIRE(nc_del_att(file.id(), NC_GLOBAL, "p") == NC_NOERR);
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(file.attributes()[0].name() == "q");
+    }
+    REQUIRE(file.attributes()[0].get<int>() == std::vector<int>{2});
+    REQUIRE(p.name() == "p");
+}
+
+TEST_CASE("chunk advisor") {
+    const std::vector<std::size_t> shape = {1000, 90, 180};
+    const auto bytes = [](const std::vector<std::size_t>& chunks) { return 4 * chunks[0] * chunks[1] * chunks[2]; };
+
+    {
+        netCDF::ChunkAdvisor advisor(shape, 4);
+        advisor.add_pattern({0, 1, 1});
+        const auto chunks = advisor.advise();
+        REQUIRE(chunks[0] == 1000);
+        REQUIRE(bytes(chunks) <= 1 << 20);
+        REQUIRE(advisor.expected_chunks(chunks) == 1.0);
+    }
+
+    {
+        netCDF::ChunkAdvisor advisor(shape, 4);
+        advisor.add_pattern({1, 0, 0});
+        REQUIRE(advisor.advise() == std::vector<std::size_t>{16, 90, 180});
+    }
+
+    {
+        netCDF::ChunkAdvisor advisor(shape, 4);
+        advisor.target_bytes(4 << 20).add_pattern({0, 1, 1}, 3.0).add_pattern({1, 0, 0});
+        const auto chunks = advisor.advise();
+        REQUIRE(bytes(chunks) <= 4 << 20);
+        REQUIRE(advisor.expected_chunks(chunks) < advisor.expected_chunks({1, 90, 180}));
+        REQUIRE(advisor.expected_chunks(chunks) < advisor.expected_chunks({1000, 16, 16}));
+        REQUIRE_THROWS_WITH_AS(advisor.add_pattern({1, 1}), "Access pattern rank does not match", netCDF::Exception);
+    }
+
+    {
+        netCDF::File file("test_chunk_advisor.nc", 'w');
+        file.add_dimension("time", 1000);
+        file.add_dimension("lat", 90);
+        file.add_dimension("lon", 180);
+        auto v = file.add_variable<double>("v", std::vector<std::string>{"time", "lat", "lon"});
+        netCDF::ChunkAdvisor advisor(v);
+        advisor.add_pattern({0, 1, 1});
+        advisor.apply(v);
+        REQUIRE(v.get_chunking() == advisor.advise());
+        REQUIRE(v.get_chunking()[0] == 1000);
+    }
+}
+
+TEST_CASE("rechunking") {
+    std::vector<double> values(40 * 20 * 30);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = static_cast<double>(i);
+    }
+    {
+        netCDF::File file("test_rechunking.nc", 'w');
+        file.add_dimension("time", 40);
+        file.add_dimension("lat", 20);
+        file.add_dimension("lon", 30);
+        auto temperature = file.add_variable<double>("temperature", std::vector<std::string>{"time", "lat", "lon"});
+        temperature.set_chunking({1, 20, 30});
+        temperature.set_compression(false, 1);
+        temperature.add_attribute("units").set<std::string>("K");
+        temperature.set<double>(values);
+        file.add_variable<std::string>("names", {"time"}).set<std::string>(std::vector<std::string>(40, "name"));
+        auto group = file.add_group("group");
+        group.add_variable<int>("counts", {"lat"}).set<int>(std::vector<int>(20, 7));
+    }
+
+    {
+        netCDF::File infile("test_rechunking.nc", 'r');
+        netCDF::File outfile("test_rechunking_out.nc", 'w');
+        netCDF::VariableLayout space_major;
+        space_major.chunks = {40, 5, 5};
+#ifdef NETCDFPP_HAS_FILTERS
+        space_major.replace_filters = true;
+#endif
+        netCDF::VariableLayout contiguous;
+        contiguous.contiguous = true;
+        netCDF::Rechunker rechunker(32 << 10);  // too small for a single pass
+        rechunker.set_layout("temperature", space_major).set_layout("group/counts", contiguous);
+        rechunker.copy(infile, outfile);
+    }
+
+    {
+        netCDF::File file("test_rechunking_out.nc", 'r');
+        const auto temperature = file.variable("temperature").require();
+        REQUIRE(temperature.get_chunking() == std::vector<std::size_t>{40, 5, 5});
+#ifdef NETCDFPP_HAS_FILTERS
+        REQUIRE(temperature.get_compression() == std::make_pair(false, -1));
+#endif
+        REQUIRE(temperature.attribute("units").require().get_string() == "K");
+        REQUIRE(temperature.get<double>() == values);
+        REQUIRE(file.variable("names").require().get<std::string>() == std::vector<std::string>(40, "name"));
+        const auto counts = file.group("group").require().variable("counts").require();
+        REQUIRE(counts.get_chunking().empty());
+        REQUIRE(counts.get<int>() == std::vector<int>(20, 7));
+        REQUIRE(!std::ifstream("test_rechunking_out.nc.rechunk.tmp").good());
+    }
+
+    {
+        // the temporary file is removed when copying fails, here writing to a read-only file
+        netCDF::File infile("test_rechunking.nc", 'r');
+        netCDF::File outfile("test_rechunking_out.nc", 'r');
+        REQUIRE_THROWS_AS(netCDF::Rechunker(32 << 10).copy_values(infile.variable("temperature").require(), outfile.variable("temperature").require()),
+                          netCDF::Exception);
+        REQUIRE(!std::ifstream("test_rechunking_out.nc.rechunk.tmp").good());
+    }
+}
+
+#ifdef NETCDFPP_WITH_INSTRUMENTATION
+TEST_CASE("rechunking contiguous") {
+    {
+        netCDF::FileOptions options;
+        options.format = NC_FORMAT_CLASSIC;
+        netCDF::File file("test_rechunking_contiguous.nc", 'w', options);
+        file.add_dimension("y", 100);
+        file.add_dimension("x", 100);
+        file.add_variable<float>("v", std::vector<std::string>{"y", "x"}).set<float>(std::vector<float>(100 * 100, 1.5f));
+    }
+
+    // checked NetCDF-C calls on the input variable, including one read per block
+    const auto calls = [](std::size_t max_memory) {
+        netCDF::File in("test_rechunking_contiguous.nc", 'r');
+        netCDF::File out("test_rechunking_contiguous_out.nc", 'w');
+        netCDF::VariableLayout contiguous;
+        contiguous.contiguous = true;
+        netCDF::IOStatistics statistics;
+        netCDF::set_instrumentation_sink(&statistics);
+        netCDF::Rechunker(max_memory).set_default_layout(contiguous).copy(in, out);
+        netCDF::set_instrumentation_sink(nullptr);
+        REQUIRE(out.variable("v").require().get<float>() == std::vector<float>(100 * 100, 1.5f));
+        for (const auto& c : statistics.counters()) {
+            if (c.path == "test_rechunking_contiguous.nc:v") {
+                return c.calls;
+            }
+        }
+        return std::size_t(0);
+    };
+    const auto whole = calls(100 * 100 * sizeof(float));
+    REQUIRE(whole > 0);
+    REQUIRE(whole < 100);  // one block instead of one call per value
+    REQUIRE(calls(10 * 100 * sizeof(float)) == whole + 9);  // slabs of 10 rows
+}
+#endif
+
+#ifdef NETCDFPP_HAS_FILTERS
+TEST_CASE("filters") {
+    std::vector<float> values(100);
+    for (std::size_t i = 0; i < values.size(); ++i) {
+        values[i] = 1.2345f * static_cast<float>(i);
+    }
+    {
+        netCDF::File file("test_filters.nc", 'w');
+        file.add_dimension("x", 100);
+
+        auto zstd = file.add_variable<float>("zstd", {"x"});
+        zstd.set_compression(true, -1);
+        zstd.set_zstd_compression(3);
+        zstd.set_quantization(NC_QUANTIZE_BITROUND, 8);
+        zstd.set<float>(values);
+
+        auto bzip2 = file.add_variable<float>("bzip2", {"x"});
+        bzip2.set_bzip2_compression(9);
+        bzip2.set_checksum_enabled(true);
+        bzip2.set<float>(values);
+
+        auto szip = file.add_variable<float>("szip", {"x"});
+        szip.set_szip_compression(NC_SZIP_NN, 8);
+        szip.set<float>(values);
+
+        auto generic = file.add_variable<float>("generic", {"x"});
+        generic.add_filter(H5Z_FILTER_DEFLATE, {5});
+        generic.set<float>(values);
+    }
+
+    {
+        netCDF::File infile("test_filters.nc", 'r');
+        const auto zstd = infile.variable("zstd").require();
+        REQUIRE(zstd.get_zstd_compression() == 3);
+        REQUIRE(zstd.get_bzip2_compression() == -1);
+        REQUIRE(zstd.get_compression() == std::make_pair(true, -1));
+        REQUIRE(zstd.get_quantization() == std::make_pair(NC_QUANTIZE_BITROUND, 8));
+        REQUIRE(infile.variable("bzip2").require().get_bzip2_compression() == 9);
+        REQUIRE(infile.variable("szip").require().get_szip_compression() == std::make_pair(NC_SZIP_NN, 8));
+        REQUIRE(infile.variable("szip").require().get<float>() == values);
+        REQUIRE(infile.variable("generic").require().get_compression() == std::make_pair(false, 5));
+
+        netCDF::File outfile("test_filters_copy.nc", 'w');
+        outfile.copy_from(infile, true);
+    }
+
+    {
+        netCDF::File infile("test_filters.nc", 'r');
+        netCDF::File outfile("test_filters_copy.nc", 'r');
+        for (const auto& name : {"zstd", "bzip2", "szip", "generic"}) {
+            const auto in = infile.variable(name).require();
+            const auto out = outfile.variable(name).require();
+            const auto in_filters = in.get_filters();
+            const auto out_filters = out.get_filters();
+            REQUIRE(in_filters.size() == out_filters.size());
+            for (std::size_t i = 0; i < in_filters.size(); ++i) {
+                REQUIRE(in_filters[i].id == out_filters[i].id);
+                REQUIRE(in_filters[i].params == out_filters[i].params);
+            }
+            REQUIRE(in.get_quantization() == out.get_quantization());
+            REQUIRE(in.get<float>() == out.get<float>());
+        }
+    }
+}
+#endif
+
 TEST_CASE("copying") {
     {
         netCDF::File infile("test.nc", 'r');
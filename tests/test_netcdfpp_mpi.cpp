@@ -0,0 +1,69 @@
+// Run with e.g. `mpirun -np 4 test_netcdfpp_mpi`, needs NetCDF-C with parallel I/O
+#define DOCTEST_CONFIG_IMPLEMENT
+#include "doctest.h"
+// make sure doctest comes before including tested classes
+
+#define NETCDFPP_WITH_MPI
+#include "netcdfpp.h"
+
+#include <numeric>
+
+TEST_CASE("parallel writes and reads") {
+    int rank;
+    int size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    const std::size_t n = 10 * static_cast<std::size_t>(size) + 1;
+
+    {
+        netCDF::File file("test_parallel.nc", 'w', MPI_COMM_WORLD);
+        file.add_dimension("x", n);
+        file.add_dimension("y", 2);
+        auto v = file.add_variable<int>("v", std::vector<std::string>{"x", "y"});
+        v.set_chunking({3, 2});
+        v.set_parallel_access(NC_COLLECTIVE);
+
+        const auto slab = v.partition(MPI_COMM_WORLD);
+        std::vector<int> values(slab.count[0] * 2);
+        std::iota(std::begin(values), std::end(values), static_cast<int>(slab.start[0] * 2));
+        v.write(values.data(), slab.start.data(), slab.count.data());  // empty parts still take part in collective writes
+    }
+
+    {
+        netCDF::File file("test_parallel.nc", 'r', MPI_COMM_WORLD);
+        auto v = file.variable("v").require();
+        v.set_parallel_access(NC_INDEPENDENT);
+        const auto values = v.get<int>();
+        REQUIRE(values.size() == n * 2);
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            CHECK(values[i] == static_cast<int>(i));
+        }
+    }
+
+    // a classic format file goes through PnetCDF
+    {
+        netCDF::FileOptions options;
+        options.format = NC_FORMAT_CDF5;
+        netCDF::File file("test_parallel_cdf5.nc", 'w', MPI_COMM_WORLD, MPI_INFO_NULL, options);
+        file.add_dimension("x", n);
+        auto v = file.add_variable<double>("v", std::vector<std::string>{"x"});
+        v.set_parallel_access(NC_COLLECTIVE);
+        const auto slab = v.partition(MPI_COMM_WORLD);
+        std::vector<double> values(slab.count[0], static_cast<double>(rank));
+        v.write(values.data(), slab.start.data(), slab.count.data());
+        file.close();
+
+        file.open_parallel("test_parallel_cdf5.nc", 'r', MPI_COMM_WORLD);
+        const auto res = file.variable("v").require().get<double>();
+        CHECK(res.front() == 0.0);
+        CHECK(res.back() == static_cast<double>(size - 1));
+    }
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    doctest::Context context(argc, argv);
+    const int res = context.run();
+    MPI_Finalize();
+    return res;
+}
@@ -0,0 +1,157 @@
+// Copies a NetCDF file while changing chunking, filters, and endianness of its variables.
+//
+// Usage: netcdfpp-rechunk [options] input.nc output.nc
+//
+// Options take a variable path relative to the root group, e.g. `group/var`,
+// or `*` for all variables without their own options:
+//   -c VAR:C1,C2,...  chunk sizes
+//   -C VAR            contiguous storage
+//   -s VAR            add shuffle (replaces the source filters)
+//   -d VAR:LEVEL      add deflate (replaces the source filters)
+//   -z VAR:LEVEL      add zstd (replaces the source filters)
+//   -f VAR:ID[,P...]  add any HDF5 filter by id (replaces the source filters)
+//   -F VAR            remove all filters
+//   -e VAR:ENDIAN     endianness: native, little, or big
+//   -m BYTES          memory limit for values (default 256 MiB)
+//   -t PATH           temporary file for two-pass rechunking
+//
+// Setting filters (-s, -d, -z, -f, -F) needs NetCDF-C 4.9.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "netcdfpp.h"
+
+namespace {
+
+void usage() { std::cerr << "Usage: netcdfpp-rechunk [-c VAR:C1,C2,...] [-C VAR] [-s VAR] [-d VAR:LEVEL] [-z VAR:LEVEL] [-f VAR:ID[,P...]] [-F VAR] [-e VAR:ENDIAN] [-m BYTES] [-t PATH] input.nc output.nc\n"; }
+
+std::vector<unsigned long> parse_list(const std::string& s) {
+    std::vector<unsigned long> res;
+    std::size_t begin = 0;
+    while (begin <= s.size()) {
+        const auto end = std::min(s.find(',', begin), s.size());
+        res.push_back(std::stoul(s.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+    return res;
+}
+
+std::pair<std::string, std::string> split_variable(const std::string& arg) {
+    const auto pos = arg.rfind(':');
+    if (pos == std::string::npos) {
+        throw std::invalid_argument("Expected VAR:VALUE: " + arg);
+    }
+    return std::make_pair(arg.substr(0, pos), arg.substr(pos + 1));
+}
+
+void add_filter(netCDF::VariableLayout& layout, unsigned int id, std::vector<unsigned int> params) {
+    layout.replace_filters = true;
+    layout.filters.push_back(netCDF::Filter{id, std::move(params)});
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::map<std::string, netCDF::VariableLayout> layouts;
+    std::size_t max_memory = 256 << 20;
+    std::string temporary_path;
+    std::vector<std::string> files;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg.size() != 2 || arg[0] != '-') {
+                files.push_back(arg);
+                continue;
+            }
+            if (i + 1 >= argc) {
+                usage();
+                return 1;
+            }
+            const std::string value = argv[++i];
+            switch (arg[1]) {
+                case 'c': {
+                    const auto v = split_variable(value);
+                    const auto chunks = parse_list(v.second);
+                    layouts[v.first].chunks.assign(std::begin(chunks), std::end(chunks));
+                } break;
+                case 'C':
+                    layouts[value].contiguous = true;
+                    break;
+#ifdef NETCDFPP_HAS_FILTERS
+                case 's':
+                    add_filter(layouts[value], H5Z_FILTER_SHUFFLE, {});
+                    break;
+                case 'd': {
+                    const auto v = split_variable(value);
+                    add_filter(layouts[v.first], H5Z_FILTER_DEFLATE, {static_cast<unsigned int>(std::stoul(v.second))});
+                } break;
+                case 'z': {
+                    const auto v = split_variable(value);
+                    add_filter(layouts[v.first], H5Z_FILTER_ZSTD, {static_cast<unsigned int>(std::stoul(v.second))});
+                } break;
+#else
+                case 's':
+                case 'd':
+                case 'z':
+                    throw std::invalid_argument("Option not supported, setting filters needs NetCDF-C 4.9: " + arg);
+#endif
+                case 'f': {
+                    const auto v = split_variable(value);
+                    const auto list = parse_list(v.second);
+                    add_filter(layouts[v.first], list[0], std::vector<unsigned int>(std::begin(list) + 1, std::end(list)));
+                } break;
+                case 'F':
+                    layouts[value].replace_filters = true;
+                    layouts[value].filters.clear();
+                    break;
+                case 'e': {
+                    const auto v = split_variable(value);
+                    if (v.second == "native") {
+                        layouts[v.first].endianness = NC_ENDIAN_NATIVE;
+                    } else if (v.second == "little") {
+                        layouts[v.first].endianness = NC_ENDIAN_LITTLE;
+                    } else if (v.second == "big") {
+                        layouts[v.first].endianness = NC_ENDIAN_BIG;
+                    } else {
+                        throw std::invalid_argument("Unknown endianness: " + v.second);
+                    }
+                } break;
+                case 'm':
+                    max_memory = std::stoull(value);
+                    break;
+                case 't':
+                    temporary_path = value;
+                    break;
+                default:
+                    usage();
+                    return 1;
+            }
+        }
+        if (files.size() != 2) {
+            usage();
+            return 1;
+        }
+
+        netCDF::Rechunker rechunker(max_memory);
+        rechunker.set_temporary_path(temporary_path);
+        for (const auto& it : layouts) {
+            if (it.first == "*") {
+                rechunker.set_default_layout(it.second);
+            } else {
+                rechunker.set_layout(it.first, it.second);
+            }
+        }
+
+        netCDF::File in(files[0], 'r');
+        netCDF::File out(files[1], 'w');
+        rechunker.copy(in, out);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}